@@ -9,12 +9,82 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#ifdef VIRTUAL_CAM
+#include <string.h>
+#include <pthread.h>
+#endif
 #include <cc3.h>
 
 #include "ISC_in_cmucam.h"
 #include "ISC_util_assert.h"
+#include "ISC_util_common.h"
 #include "ISC_util_imagecontext.h"
 
+#ifdef VIRTUAL_CAM
+// The loader thread: load the next frame and read all of it out of the pixbuf
+// into the buffer that isn't being used.
+__attribute__((gnu_inline)) inline static void *LoadFrame( void *argument )
+{
+	ISC_in_cmucam *iic = argument;
+
+	cc3_pixbuf_load();
+	if ( cc3_g_pixbuf_frame.width * cc3_g_pixbuf_frame.channels != iic->rowBytes || cc3_g_pixbuf_frame.height != iic->bufferRows )
+		ISC_util_assert_message( "FATAL: The frame size changed while ISC_in_cmucam was prefetching!\n" );
+	cc3_pixbuf_read_rows( iic->buffers[iic->nextBuffer], iic->bufferRows );
+
+	return NULL;
+}
+
+// Start the loader thread on the next frame.
+__attribute__((gnu_inline)) inline static void StartLoading( ISC_in_cmucam *iic )
+{
+	if ( pthread_create( &iic->loader, NULL, LoadFrame, iic ) != 0 )
+		ISC_util_assert_message( "FATAL: Couldn't start the ISC_in_cmucam loader thread!\n" );
+	iic->loading = true;
+}
+
+// Wait for the loader thread to finish the frame it is on.
+__attribute__((gnu_inline)) inline static void FinishLoading( ISC_in_cmucam *iic )
+{
+	if ( !iic->loading )
+		return;
+	pthread_join( iic->loader, NULL );
+	iic->loading = false;
+}
+#endif
+
+// Read the next row of the frame.
+__attribute__((gnu_inline)) inline static void ReadRow( ISC_in_cmucam *iic, uint8_t *row )
+{
+#ifdef VIRTUAL_CAM
+	if ( iic->frame )
+	{
+		memcpy( row, iic->frame + ( iic->bufferRows - iic->linesLeft ) * iic->rowBytes, iic->rowBytes );
+		return;
+	}
+#else
+	(void)iic;
+#endif
+	cc3_pixbuf_read_rows( row, 1 );
+}
+
+// Count a row as read, and see if that was the last one.
+__attribute__((gnu_inline)) inline static void RowDone( ISC_in_cmucam *iic )
+{
+	iic->linesLeft--;
+	if ( iic->linesLeft > 0 )
+		return;
+	iic->finished = 1;
+
+#ifndef VIRTUAL_CAM
+	// The FIFO is free now, so the next frame can come in while the rest of
+	// the pipeline finishes this one.  (On virtual-cam the loader thread got
+	// going when this frame started.)
+	if ( iic->prefetch )
+		cc3_pixbuf_load();
+#endif
+}
+
 /**
  * \brief Creates a new ISC_in_cmucam module.
  *
@@ -41,6 +111,14 @@ __attribute__((gnu_inline)) inline ISC_in_cmucam *ISC_in_cmucam_start(ISC_util_i
 	// Set up initial variables.
 	iic->linesLeft = cc3_g_pixbuf_frame.height;
 	iic->finished = 0;
+	iic->skipRow = NULL;
+	iic->prefetch = false;
+#ifdef VIRTUAL_CAM
+	iic->buffers[0] = NULL;
+	iic->buffers[1] = NULL;
+	iic->frame = NULL;
+	iic->loading = false;
+#endif
 
 	iic->theContext = context;
 
@@ -48,6 +126,43 @@ __attribute__((gnu_inline)) inline ISC_in_cmucam *ISC_in_cmucam_start(ISC_util_i
 	return iic;
 }
 
+/**
+ * \brief Creates a new ISC_in_cmucam module that prefetches frames.
+ *
+ * ISC_in_cmucam_start_prefetch is ISC_in_cmucam_start for a module that loads
+ * each next frame itself, as soon as it can.  Load the first frame with
+ * cc3_pixbuf_load before calling it; after that, leave the pixbuf to the
+ * module until it is ended.  On virtual-cam this reads the first frame out
+ * of the pixbuf and starts loading the second right away.
+ *
+ * \param context The Image Context of the image coming from the CMUcam3.
+ * \return An allocated memory structure containing the current state of the ISC_in_cmucam module.
+ */
+__attribute__((gnu_inline)) inline ISC_in_cmucam *ISC_in_cmucam_start_prefetch( ISC_util_imagecontext context )
+{
+	ISC_in_cmucam *iic = ISC_in_cmucam_start( context );
+
+	iic->prefetch = true;
+
+#ifdef VIRTUAL_CAM
+	iic->rowBytes = cc3_g_pixbuf_frame.width * cc3_g_pixbuf_frame.channels;
+	iic->bufferRows = cc3_g_pixbuf_frame.height;
+
+	// MEMORY IS ALLOCATED HERE.
+	iic->buffers[0] = malloc( iic->rowBytes * iic->bufferRows );
+	iic->buffers[1] = malloc( iic->rowBytes * iic->bufferRows );
+	if ( !iic->buffers[0] || !iic->buffers[1] )
+		ISC_util_assert_message( "FATAL: Not enough memory for the ISC_in_cmucam frame buffers!\n" );
+
+	cc3_pixbuf_read_rows( iic->buffers[0], iic->bufferRows );
+	iic->frame = iic->buffers[0];
+	iic->nextBuffer = 1;
+	StartLoading( iic );
+#endif
+
+	return iic;
+}
+
 /**
  * \brief Returns the ISC_in_cmucam module's Image Context.
  *
@@ -83,22 +198,88 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_in_cmucam_process( ISC_in_cmucam
 	{
 		// Get the memory for the new row.
 		// MEMORY IS ALLOCATED HERE, ASSUMED TO BE HANDLED EXTERNALLY.
-		outRow = cc3_malloc_rows(1);
+		outRow = MallocRow( &iic->theContext );
 
 		// Get the row we need.
-		cc3_pixbuf_read_rows( outRow, 1 );
+		ReadRow( iic, outRow );
 
-		// One more row done.
-		iic->linesLeft--;
-		// If we don't have to do anything more, let the module know.
-		if ( iic->linesLeft == 0 )
-			iic->finished = 1;
+		// One more row done.  If it was the last, let the module know.
+		RowDone( iic );
 
 		// Bring back what we've gotten from the 'cam.
 		return outRow;
 	}
 }
 
+/**
+ * \brief Throws away the next row from the CMUcam3.
+ *
+ * ISC_in_cmucam_skip is for rows nobody downstream wants, like the ones a
+ * sampling histogrammer doesn't count.  The FIFO can only be read in order,
+ * so the row still has to be clocked out, but it goes into one scratch row
+ * that is reused instead of a new row that has to be allocated, passed on
+ * and freed.
+ *
+ * \param iic The ISC_in_cmucam state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_in_cmucam_skip( ISC_in_cmucam *iic )
+{
+	if ( iic->finished )
+		return;
+
+	// MEMORY IS ALLOCATED HERE.
+	if ( !iic->skipRow )
+	{
+		iic->skipRow = cc3_malloc_rows(1);
+		if ( !iic->skipRow )
+			ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_in_cmucam skip row!\n" );
+	}
+
+#ifdef VIRTUAL_CAM
+	// Buffered rows don't have to be read to get past them.
+	if ( !iic->frame )
+#endif
+	cc3_pixbuf_read_rows( iic->skipRow, 1 );
+
+	RowDone( iic );
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * ISC_in_cmucam_reset lets one ISC_in_cmucam read frame after frame instead
+ * of being ended and started again for each one.  Call it after
+ * cc3_pixbuf_load has loaded the next frame, or, if the module prefetches,
+ * instead of cc3_pixbuf_load.  A prefetching module reset before the end of
+ * a frame drops the rest of it.
+ *
+ * \param iic The ISC_in_cmucam state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_in_cmucam_reset( ISC_in_cmucam *iic )
+{
+#ifdef VIRTUAL_CAM
+	if ( iic->prefetch )
+	{
+		// Move on to the frame the loader thread read, and have it load the
+		// one after into the buffer this frame was in.
+		FinishLoading( iic );
+		iic->frame = iic->buffers[iic->nextBuffer];
+		iic->nextBuffer ^= 1;
+		iic->linesLeft = iic->bufferRows;
+		iic->finished = 0;
+		StartLoading( iic );
+		return;
+	}
+#else
+	// The next frame wasn't loaded if this one was cut short.
+	if ( iic->prefetch && !iic->finished )
+		cc3_pixbuf_load();
+#endif
+
+	iic->linesLeft = cc3_g_pixbuf_frame.height;
+	iic->finished = 0;
+}
+
 /**
  * \brief Cleans up the spent ISC_in_cmucam module.
  *
@@ -113,6 +294,12 @@ __attribute__((gnu_inline)) inline void ISC_in_cmucam_end( ISC_in_cmucam *iic )
 {
 	// Clean up after ISC_in_cmucam_start.
 	//free( iic->outRow );
+#ifdef VIRTUAL_CAM
+	FinishLoading( iic );
+	free( iic->buffers[0] );
+	free( iic->buffers[1] );
+#endif
+	free( iic->skipRow );
 	free( iic );
 }
 
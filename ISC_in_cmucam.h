@@ -10,6 +10,9 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#ifdef VIRTUAL_CAM
+#include <pthread.h>
+#endif
 #include "ISC_util_imagecontext.h"
 
 #ifndef _ISC_IN_CMUCAM_H_
@@ -19,23 +22,52 @@
  * \brief In-Module for CMUcam3.
  *
  * ISC_in_cmucam extracts image rows from the CMUcam3's FIFO pixbuf.
+ *
+ * Started with ISC_in_cmucam_start_prefetch, the module loads the next frame
+ * itself as soon as the last row of the current one has been read, instead
+ * of waiting for the program to call cc3_pixbuf_load once it is done with
+ * the frame.  On the CMUcam3 the load still happens right there, but the
+ * rest of the pipeline (the bottom rows of a convolution, exporting a
+ * histogram) no longer has to finish first.  On virtual-cam the frames are
+ * read out of the pixbuf into two buffers, and while the pipeline works on
+ * one of them a thread loads the next image file and reads it into the
+ * other, so loading costs nothing if there is a spare core.
+ *
+ * With prefetch, the program calls cc3_pixbuf_load once before starting the
+ * module and never again; ISC_in_cmucam_reset moves on to the frame that was
+ * prefetched.  One frame more than is used ends up being loaded.  The frame
+ * size must not change while the module is prefetching.
  */
 typedef struct
 {
 	// USER-DEFINED
 	ISC_util_imagecontext theContext; /*!< The Image Context of the camera's output. */
+	bool prefetch; /*!< Does the module load the next frame itself? */
 
 	// HANDLED BY FUNCTIONS
 	//uint8_t *outRow; /*!< The latest row coming out of the camera. */
 	uint16_t linesLeft; /*!< The amount of rows left to come out of the camera. */
+	uint8_t *skipRow; /*!< Where skipped rows are read to.  Made the first time a row is skipped. */
+#ifdef VIRTUAL_CAM
+	uint8_t *buffers[2]; /*!< Frames read out of the pixbuf.  Only made for prefetch. */
+	uint8_t *frame; /*!< The buffer rows are coming from, or NULL to read the pixbuf. */
+	uint8_t nextBuffer; /*!< The buffer the loader thread fills. */
+	uint16_t bufferRows; /*!< The height of the frames in the buffers. */
+	uint32_t rowBytes; /*!< The size of a row. */
+	pthread_t loader; /*!< Loads the next frame. */
+	bool loading; /*!< Is the loader thread running? */
+#endif
 
 	// ISC_PIPELINE REQUIREMENTS
 	bool finished; /*!< Is the module done with the frame in question? */
 } ISC_in_cmucam;
 
 ISC_in_cmucam *ISC_in_cmucam_start( ISC_util_imagecontext context );
+ISC_in_cmucam *ISC_in_cmucam_start_prefetch( ISC_util_imagecontext context );
 ISC_util_imagecontext ISC_in_cmucam_context( ISC_in_cmucam * );
 uint8_t *ISC_in_cmucam_process( ISC_in_cmucam * );
+void ISC_in_cmucam_skip( ISC_in_cmucam * );
+void ISC_in_cmucam_reset( ISC_in_cmucam * );
 void ISC_in_cmucam_end( ISC_in_cmucam * );
 bool ISC_in_cmucam_running( ISC_in_cmucam * );
 
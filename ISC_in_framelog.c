@@ -0,0 +1,353 @@
+/***************************************************************************//**
+ * \file ISC_in_framelog.c
+ * \brief Module for reading frames back out of a frame log.
+ *
+ * ISC_in_framelog.c contains the functions for mapping a frame log, finding
+ * its frames, and handing out their rows.
+*******************************************************************************/
+
+#ifndef VIRTUAL_CAM
+#error "ISC_in_framelog uses mmap and only builds for virtual-cam on the PC."
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cc3.h>
+
+#include "ISC_in_framelog.h"
+#include "ISC_out_framelog.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+
+// The header has to reach at least this far for the fields version 1 has.
+#define FRAMELOG_MINHEADERBYTES 42
+
+// Get a 16-bit number that was stored least significant byte first.
+__attribute__((gnu_inline)) inline static uint16_t GetLE16( const uint8_t *buffer )
+{
+	return buffer[0] | buffer[1] << 8;
+}
+
+// Get a 32-bit number that was stored least significant byte first.
+__attribute__((gnu_inline)) inline static uint32_t GetLE32( const uint8_t *buffer )
+{
+	return buffer[0] | buffer[1] << 8 | buffer[2] << 16 | (uint32_t)buffer[3] << 24;
+}
+
+// Walk the headers and remember where each whole frame starts.  The walk
+// stops at the first thing that isn't a frame header, at a frame of a version
+// this reader doesn't know or at a frame that runs past the end of the file.
+__attribute__((gnu_inline)) inline static void FindFrames( ISC_in_framelog *ilf )
+{
+	size_t offset = 0, allocated = 0, *bigger;
+	const uint8_t *header;
+	uint32_t rowsBytes;
+
+	while ( ilf->logBytes - offset >= FRAMELOG_MINHEADERBYTES )
+	{
+		header = ilf->log + offset;
+		if ( memcmp( header, ISC_OUT_FRAMELOG_MAGIC, 4 ) != 0 || header[5] < FRAMELOG_MINHEADERBYTES )
+			break;
+		if ( header[4] != ISC_OUT_FRAMELOG_VERSION )
+			break;
+
+		rowsBytes = GetLE32( header + 20 );
+		if ( rowsBytes != (uint32_t)GetLE16( header + 8 ) * GetLE16( header + 10 ) * header[6] )
+			break;
+		if ( ilf->logBytes - offset < header[5] || ilf->logBytes - offset - header[5] < rowsBytes )
+			break;
+
+		if ( ilf->frames == allocated )
+		{
+			allocated = allocated ? allocated * 2 : 64;
+			// MEMORY IS ALLOCATED HERE.
+			bigger = realloc( ilf->frameOffsets, allocated * sizeof( size_t ) );
+			if ( !bigger )
+				ISC_util_assert_message( "FATAL: Not enough memory for the ISC_in_framelog frame list!" );
+			ilf->frameOffsets = bigger;
+		}
+		ilf->frameOffsets[ilf->frames++] = offset;
+		offset += header[5] + rowsBytes;
+	}
+}
+
+/**
+ * \brief Opens a frame log.
+ *
+ * ISC_in_framelog_start maps the log, finds its frames and gets the first one
+ * ready to be read.
+ *
+ * \param path The name of the log file.
+ * \return The State Structure for a ISC_in_framelog module, or NULL if the file couldn't be opened or mapped.
+ */
+__attribute__((gnu_inline)) inline ISC_in_framelog *ISC_in_framelog_start( const char *path )
+{
+	ISC_in_framelog *ilf;
+	struct stat status;
+	void *mapped = NULL;
+	int fd;
+
+	fd = open( path, O_RDONLY );
+	if ( fd < 0 )
+		return NULL;
+	if ( fstat( fd, &status ) != 0 )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	// An empty file can't be mapped, but it's still a log with no frames.
+	if ( status.st_size > 0 )
+	{
+		mapped = mmap( NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( mapped == MAP_FAILED )
+		{
+			close( fd );
+			return NULL;
+		}
+		// Replays mostly go through the log from front to back.
+		madvise( mapped, status.st_size, MADV_SEQUENTIAL );
+	}
+	// The mapping stays good after the file is closed.
+	close( fd );
+
+	// MEMORY IS ALLOCATED HERE.
+	ilf = malloc( sizeof( ISC_in_framelog ) );
+	if ( !ilf )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_in_framelog!" );
+
+	ilf->log = mapped;
+	ilf->logBytes = status.st_size;
+	ilf->frameOffsets = NULL;
+	ilf->frames = 0;
+	FindFrames( ilf );
+
+	if ( !ISC_in_framelog_seek( ilf, 0 ) )
+	{
+		memset( &ilf->theContext, 0, sizeof( ISC_util_imagecontext ) );
+		ilf->currentFrame = 0;
+		ilf->rows = NULL;
+		ilf->rowBytes = 0;
+		ilf->nextRow = 0;
+		ilf->finished = true;
+	}
+
+	return ilf;
+}
+
+/**
+ * \brief Returns the number of frames in the log.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return The number of whole frames.
+ */
+__attribute__((gnu_inline)) inline uint32_t ISC_in_framelog_frames( ISC_in_framelog *ilf )
+{
+	return ilf->frames;
+}
+
+/**
+ * \brief Goes to a frame.
+ *
+ * ISC_in_framelog_seek makes a frame the current one and starts it from its
+ * first row.  Nothing is read; it only looks at the frame's header.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \param frame Which frame, counting from 0 at the start of the log.
+ * \return TRUE if there is such a frame, FALSE if not (the current frame stays as it was).
+ */
+__attribute__((gnu_inline)) inline bool ISC_in_framelog_seek( ISC_in_framelog *ilf, uint32_t frame )
+{
+	const uint8_t *header;
+	cc3_frame_t *context = &ilf->theContext.frame;
+
+	if ( frame >= ilf->frames )
+		return false;
+
+	header = ilf->log + ilf->frameOffsets[frame];
+
+	memset( &ilf->theContext, 0, sizeof( ISC_util_imagecontext ) );
+	context->channels = header[6];
+	ilf->theContext.colorspace = header[7];
+	context->width = GetLE16( header + 8 );
+	context->height = GetLE16( header + 10 );
+	ilf->theContext.resolution = header[24];
+	context->coi = header[25];
+	context->subsample_mode = header[26];
+	context->x_step = header[27];
+	context->y_step = header[28];
+	context->raw_width = GetLE16( header + 30 );
+	context->raw_height = GetLE16( header + 32 );
+	context->x0 = GetLE16( header + 34 );
+	context->y0 = GetLE16( header + 36 );
+	context->x1 = GetLE16( header + 38 );
+	context->y1 = GetLE16( header + 40 );
+
+	ilf->currentFrame = frame;
+	ilf->rows = header + header[5];
+	ilf->rowBytes = (uint32_t)context->width * context->channels;
+	ilf->nextRow = 0;
+	ilf->finished = context->height == 0;
+	return true;
+}
+
+/**
+ * \brief Goes on to the next frame.
+ *
+ * ISC_in_framelog_next is what cc3_pixbuf_load followed by
+ * ISC_in_cmucam_reset is for the camera: call it when the pipeline is done
+ * with a frame.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return TRUE if there was another frame, FALSE at the end of the log.
+ */
+__attribute__((gnu_inline)) inline bool ISC_in_framelog_next( ISC_in_framelog *ilf )
+{
+	if ( ISC_in_framelog_seek( ilf, ilf->currentFrame + 1 ) )
+		return true;
+
+	ilf->finished = true;
+	return false;
+}
+
+/**
+ * \brief Returns the frame number ISC_out_framelog gave the current frame.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return The frame number from the header.
+ */
+__attribute__((gnu_inline)) inline uint32_t ISC_in_framelog_frameid( ISC_in_framelog *ilf )
+{
+	if ( ilf->frames == 0 )
+		return 0;
+	return GetLE32( ilf->log + ilf->frameOffsets[ilf->currentFrame] + 12 );
+}
+
+/**
+ * \brief Returns when the current frame was captured.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return The camera's cc3_timer_get_current_ms when the frame was logged.
+ */
+__attribute__((gnu_inline)) inline uint32_t ISC_in_framelog_timestamp( ISC_in_framelog *ilf )
+{
+	if ( ilf->frames == 0 )
+		return 0;
+	return GetLE32( ilf->log + ilf->frameOffsets[ilf->currentFrame] + 16 );
+}
+
+/**
+ * \brief Returns the Image Context of the current frame.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return The Image Context the frame was logged with.
+ */
+__attribute__((gnu_inline)) inline ISC_util_imagecontext ISC_in_framelog_context( ISC_in_framelog *ilf )
+{
+	return ilf->theContext;
+}
+
+/**
+ * \brief Points at a row of the current frame.
+ *
+ * ISC_in_framelog_row gives a pointer into the mapped log.  Nothing is copied
+ * or allocated, so don't free it or write to it, and don't use it after the
+ * module is ended.  It doesn't change which row process gives out next.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \param y The row, counting from 0 at the top.
+ * \return The row, or NULL if the frame doesn't have that many rows.
+ */
+__attribute__((gnu_inline)) inline const uint8_t *ISC_in_framelog_row( ISC_in_framelog *ilf, uint16_t y )
+{
+	if ( !ilf->rows || y >= ilf->theContext.frame.height )
+		return NULL;
+	return ilf->rows + (size_t)y * ilf->rowBytes;
+}
+
+/**
+ * \brief Gets the next row of the current frame.
+ *
+ * ISC_in_framelog_process copies the next row into a new row which, as with
+ * every in-module, belongs to whoever it is fed to.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return The next freshly-allocated image row, or NULL if the frame is finished.
+ */
+__attribute__((gnu_inline)) inline uint8_t *ISC_in_framelog_process( ISC_in_framelog *ilf )
+{
+	uint8_t *outRow;
+
+	if ( ilf->finished )
+		return NULL;
+
+	// MEMORY IS ALLOCATED HERE, ASSUMED TO BE HANDLED EXTERNALLY.
+	outRow = MallocRowBytes( ilf->rowBytes );
+	if ( !outRow )
+		ISC_util_assert_message( "FATAL: Not enough memory for an ISC_in_framelog row!" );
+	memcpy( outRow, ISC_in_framelog_row( ilf, ilf->nextRow ), ilf->rowBytes );
+
+	ISC_in_framelog_skip( ilf );
+	return outRow;
+}
+
+/**
+ * \brief Passes over the next row of the current frame.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_in_framelog_skip( ISC_in_framelog *ilf )
+{
+	if ( ilf->finished )
+		return;
+
+	ilf->nextRow++;
+	if ( ilf->nextRow == ilf->theContext.frame.height )
+		ilf->finished = true;
+}
+
+/**
+ * \brief Starts the current frame over from its first row.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_in_framelog_reset( ISC_in_framelog *ilf )
+{
+	ISC_in_framelog_seek( ilf, ilf->currentFrame );
+}
+
+/**
+ * \brief Closes the log.
+ *
+ * ISC_in_framelog_end unmaps the log and frees the module.  Rows from
+ * ISC_in_framelog_row can't be used after this, but rows from
+ * ISC_in_framelog_process can.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_in_framelog_end( ISC_in_framelog *ilf )
+{
+	if ( ilf->log )
+		munmap( (void *)ilf->log, ilf->logBytes );
+	free( ilf->frameOffsets );
+	free( ilf );
+}
+
+/**
+ * \brief Returns whether the current frame has rows left.
+ *
+ * \param ilf The ISC_in_framelog state structure.
+ * \return TRUE if the module is still running, FALSE if the frame is finished.
+ */
+__attribute__((gnu_inline)) inline bool ISC_in_framelog_running( ISC_in_framelog *ilf )
+{
+	return !ilf->finished;
+}
@@ -0,0 +1,66 @@
+/***************************************************************************//**
+ * \file ISC_in_framelog.h
+ * \brief Module for reading frames back out of a frame log.
+ *
+ * ISC_in_framelog.h describes an in-module that replays the frames written by
+ * ISC_out_framelog.  It maps the whole log into memory, so rows come straight
+ * out of the file with no reading or decoding, and frames go through a
+ * pipeline as fast as the modules can take them.  It uses mmap, so it is only
+ * for virtual-cam builds on the PC.
+*******************************************************************************/
+
+#ifndef _ISC_IN_FRAMELOG_H_
+#define _ISC_IN_FRAMELOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_out_framelog.h"
+
+/**
+ * \brief In-Module for frame logs.
+ *
+ * ISC_in_framelog_start maps the log and walks its headers once to find where
+ * every frame starts, so any frame can be picked with ISC_in_framelog_seek.
+ * A frame whose rows run past the end of the file (the camera lost power
+ * in the middle of it) is left out.
+ *
+ * There are two ways to get rows.  ISC_in_framelog_row points into the mapped
+ * file and copies nothing, which is the way for analysis code that only looks
+ * at the pixels.  ISC_in_framelog_process hands out a newly allocated copy,
+ * like ISC_in_cmucam_process, because the modules downstream free the rows
+ * they are fed.
+ */
+typedef struct
+{
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	const uint8_t *log; //!< The mapped log file.
+	size_t logBytes; //!< The size of the log file.
+	size_t *frameOffsets; //!< Where each frame's header starts.
+	uint32_t frames; //!< The number of whole frames in the log.
+	uint32_t currentFrame; //!< The frame being read.
+	const uint8_t *rows; //!< The first row of the current frame.
+	uint32_t rowBytes; //!< The size of a row of the current frame.
+	ISC_util_imagecontext theContext; //!< The Image Context of the current frame.
+	uint16_t nextRow; //!< The row process will give out next.
+	//-------------------------ISC_PIPELINE REQUIRED----------------------------
+	bool finished; //!< Is the module done with the current frame?
+} ISC_in_framelog;
+
+ISC_in_framelog *ISC_in_framelog_start( const char * );
+uint32_t ISC_in_framelog_frames( ISC_in_framelog * );
+bool ISC_in_framelog_seek( ISC_in_framelog *, uint32_t );
+bool ISC_in_framelog_next( ISC_in_framelog * );
+uint32_t ISC_in_framelog_frameid( ISC_in_framelog * );
+uint32_t ISC_in_framelog_timestamp( ISC_in_framelog * );
+ISC_util_imagecontext ISC_in_framelog_context( ISC_in_framelog * );
+const uint8_t *ISC_in_framelog_row( ISC_in_framelog *, uint16_t );
+uint8_t *ISC_in_framelog_process( ISC_in_framelog * );
+void ISC_in_framelog_skip( ISC_in_framelog * );
+void ISC_in_framelog_reset( ISC_in_framelog * );
+void ISC_in_framelog_end( ISC_in_framelog * );
+bool ISC_in_framelog_running( ISC_in_framelog * );
+
+#endif
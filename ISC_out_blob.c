@@ -0,0 +1,427 @@
+/***************************************************************************//**
+ * \file ISC_out_blob.c
+ * \brief Out-Module for connected-component (blob) statistics.
+ *
+ * ISC_out_blob.c contains the functions for labelling blobs in a single pass
+ * over run-length rows.  Each run is joined to the runs above it that it
+ * touches using a small union-find table, and the moments of each blob are
+ * added up as the runs come in, so nothing but the last row is remembered.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ISC_out_blob.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_process_threshold.h"
+#include "ISC_util_sink.h"
+
+// Find the root slot of a blob, halving the path on the way up.
+__attribute__((gnu_inline)) inline static uint8_t FindRoot( ISC_out_blob *iob, uint8_t slot )
+{
+	while ( iob->slots[slot].parent != slot )
+	{
+		iob->slots[slot].parent = iob->slots[iob->slots[slot].parent].parent;
+		slot = iob->slots[slot].parent;
+	}
+	return slot;
+}
+
+// Join two blobs, folding the statistics of one root into the other.
+__attribute__((gnu_inline)) inline static uint8_t JoinBlobs( ISC_out_blob *iob, uint8_t a, uint8_t b )
+{
+	ISC_out_blob_slot *keep, *gone;
+
+	a = FindRoot( iob, a );
+	b = FindRoot( iob, b );
+	if ( a == b )
+		return a;
+
+	keep = &iob->slots[a];
+	gone = &iob->slots[b];
+
+	keep->area += gone->area;
+	keep->sumX += gone->sumX;
+	keep->sumY += gone->sumY;
+	if ( gone->x0 < keep->x0 ) keep->x0 = gone->x0;
+	if ( gone->y0 < keep->y0 ) keep->y0 = gone->y0;
+	if ( gone->x1 > keep->x1 ) keep->x1 = gone->x1;
+	if ( gone->y1 > keep->y1 ) keep->y1 = gone->y1;
+	if ( gone->lastRow > keep->lastRow ) keep->lastRow = gone->lastRow;
+
+	gone->parent = a;
+	return a;
+}
+
+// Grab an unused slot and start a new blob in it.
+__attribute__((gnu_inline)) inline static uint8_t NewBlob( ISC_out_blob *iob, uint8_t label )
+{
+	uint8_t slot;
+
+	if ( iob->freeCount == 0 )
+		ISC_util_assert_message( "FATAL: Ran out of blob labels!  Raise maxLabels." );
+
+	slot = iob->freeSlots[--iob->freeCount];
+	iob->slots[slot].parent = slot;
+	iob->slots[slot].label = label;
+	iob->slots[slot].area = 0;
+	iob->slots[slot].sumX = 0;
+	iob->slots[slot].sumY = 0;
+	iob->slots[slot].x0 = 0xFFFF;
+	iob->slots[slot].y0 = iob->currentRow;
+	iob->slots[slot].x1 = 0;
+	iob->slots[slot].y1 = iob->currentRow;
+
+	return slot;
+}
+
+// Add a run on the current row to a blob's moments and bounding box.
+__attribute__((gnu_inline)) inline static void AddSpan( ISC_out_blob *iob, uint8_t slot, ISC_out_blob_span *span )
+{
+	ISC_out_blob_slot *s = &iob->slots[slot];
+	uint32_t length = span->end - span->start + 1;
+
+	s->area += length;
+	// Sum of start..end is length*start + length*(length-1)/2.
+	s->sumX += length * span->start + ( ( length * (length-1) ) >> 1 );
+	s->sumY += length * iob->currentRow;
+	if ( span->start < s->x0 ) s->x0 = span->start;
+	if ( span->end > s->x1 ) s->x1 = span->end;
+	s->y1 = iob->currentRow;
+	s->lastRow = iob->currentRow;
+}
+
+// Move a finished blob from its slot into the blob list.
+__attribute__((gnu_inline)) inline static void FinishBlob( ISC_out_blob *iob, uint8_t slot )
+{
+	ISC_out_blob_slot *s = &iob->slots[slot];
+	ISC_out_blob_blob *b;
+	uint8_t count, smallest = 0;
+
+	if ( s->area < iob->minArea )
+		return;
+
+	if ( iob->blobCount < iob->maxBlobs )
+		b = &iob->blobs[iob->blobCount++];
+	else
+	{
+		// The list is full, so the new blob replaces the smallest one if
+		// it's bigger.  Either way something gets dropped.
+		iob->droppedBlobs++;
+		for ( count = 1; count < iob->maxBlobs; count++ )
+			if ( iob->blobs[count].area < iob->blobs[smallest].area )
+				smallest = count;
+		if ( iob->maxBlobs == 0 || iob->blobs[smallest].area >= s->area )
+			return;
+		b = &iob->blobs[smallest];
+	}
+
+	b->label = s->label;
+	b->area = s->area;
+	b->x0 = s->x0;
+	b->y0 = s->y0;
+	b->x1 = s->x1;
+	b->y1 = s->y1;
+	b->centroidX = s->sumX / s->area;
+	b->centroidY = s->sumY / s->area;
+}
+
+// After a row is labelled, finish every blob that didn't continue onto it and
+// give back the slots of blobs that were joined into others.
+__attribute__((gnu_inline)) inline static void RetireSlots( ISC_out_blob *iob, uint16_t spanCount, bool frameDone )
+{
+	uint16_t count;
+	uint8_t slot;
+
+	// Point every run straight at its root so no merged slots are still
+	// referenced by the time they get reused.
+	for ( count = 0; count < spanCount; count++ )
+		iob->curSpans[count].slot = FindRoot( iob, iob->curSpans[count].slot );
+
+	for ( slot = 0; slot < iob->maxLabels; slot++ )
+	{
+		if ( iob->slots[slot].parent == ISC_OUT_BLOB_FREE )
+			continue;
+		if ( iob->slots[slot].parent == slot )
+		{
+			if ( !frameDone && iob->slots[slot].lastRow == iob->currentRow )
+				continue;
+			FinishBlob( iob, slot );
+		}
+		iob->slots[slot].parent = ISC_OUT_BLOB_FREE;
+		iob->freeSlots[iob->freeCount++] = slot;
+	}
+}
+
+/**
+ * \brief Creates an ISC_out_blob module.
+ *
+ * This function creates a new ISC_out_blob module.  The memory it uses is
+ * fixed at start: two rows worth of runs, maxLabels union-find slots and
+ * maxBlobs finished blobs.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param maxLabels The number of blobs that can be open at once, up to 254.  Running out is fatal.
+ * \param maxBlobs The number of finished blobs to keep.  When full, the smallest blobs are dropped.
+ * \param minArea Blobs with fewer pixels than this are ignored.
+ * \param eightConnected TRUE if runs that only touch diagonally belong to the same blob.
+ * \return ISC_out_blob state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_blob *ISC_out_blob_start( ISC_util_imagecontext context, uint8_t maxLabels, uint8_t maxBlobs, uint32_t minArea, bool eightConnected )
+{
+	uint8_t slot;
+	ISC_out_blob *iob;
+
+	if ( maxLabels == 0 || maxLabels >= ISC_OUT_BLOB_FREE )
+		ISC_util_assert_message( "FATAL: maxLabels must be between 1 and 254!" );
+
+	// -MEMORY IS ALLOCATED HERE-
+	iob = malloc( sizeof( ISC_out_blob ) );
+	if ( !iob )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_blob!" );
+
+	iob->theContext = context;
+	iob->maxLabels = maxLabels;
+	iob->maxBlobs = maxBlobs;
+	iob->minArea = minArea;
+	iob->eightConnected = eightConnected;
+
+	// -MEMORY IS ALLOCATED HERE-
+	iob->slots = malloc( sizeof( ISC_out_blob_slot ) * maxLabels );
+	iob->freeSlots = malloc( maxLabels );
+	iob->prevSpans = malloc( sizeof( ISC_out_blob_span ) * context.frame.width );
+	iob->curSpans = malloc( sizeof( ISC_out_blob_span ) * context.frame.width );
+	iob->blobs = malloc( sizeof( ISC_out_blob_blob ) * ( maxBlobs ? maxBlobs : 1 ) );
+	if ( !iob->slots || !iob->freeSlots || !iob->prevSpans || !iob->curSpans || !iob->blobs )
+		ISC_util_assert_message( "FATAL: Not enough memory for ISC_out_blob tables!" );
+
+	// Every slot starts out free.  They're stacked backwards so slot 0 gets
+	// used first, which makes debugging output easier to follow.
+	for ( slot = 0; slot < maxLabels; slot++ )
+	{
+		iob->slots[slot].parent = ISC_OUT_BLOB_FREE;
+		iob->freeSlots[slot] = maxLabels - 1 - slot;
+	}
+	iob->freeCount = maxLabels;
+
+	iob->prevCount = 0;
+	iob->blobCount = 0;
+	iob->droppedBlobs = 0;
+	iob->currentRow = 0;
+	iob->rowsLeft = context.frame.height;
+	iob->finished = false;
+
+	return iob;
+}
+
+/**
+ * \brief Feeds a run-length row into the blob labeller.
+ *
+ * Each run is compared against the runs of the previous row.  Runs of the
+ * same label that touch are joined into one blob.  Both lists are sorted, so
+ * this is a merge and costs about one step per run.
+ *
+ * \param iob The ISC_out_blob state structure.
+ * \param row A run-length row from ISC_process_threshold.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_blob_feed( ISC_out_blob *iob, ISC_process_threshold_runrow *row )
+{
+	uint16_t count, above = 0, scan;
+	uint8_t slot, reach = iob->eightConnected ? 1 : 0;
+	ISC_out_blob_span *span, *swap;
+	bool joined;
+
+	if ( !row || iob->finished )
+		return;
+
+	for ( count = 0; count < row->runCount; count++ )
+	{
+		span = &iob->curSpans[count];
+		span->start = row->runs[count].start;
+		span->end = row->runs[count].start + row->runs[count].length - 1;
+		span->label = row->runs[count].label;
+		joined = false;
+
+		// Skip the runs above that end before this one can touch them.
+		// They can't touch any later run on this row either.
+		while ( above < iob->prevCount && iob->prevSpans[above].end + reach < span->start )
+			above++;
+
+		for ( scan = above; scan < iob->prevCount && iob->prevSpans[scan].start <= span->end + reach; scan++ )
+		{
+			if ( iob->prevSpans[scan].label != span->label )
+				continue;
+			if ( !joined )
+			{
+				span->slot = FindRoot( iob, iob->prevSpans[scan].slot );
+				joined = true;
+			}
+			else
+				span->slot = JoinBlobs( iob, span->slot, iob->prevSpans[scan].slot );
+		}
+
+		if ( !joined )
+			span->slot = NewBlob( iob, span->label );
+
+		slot = FindRoot( iob, span->slot );
+		AddSpan( iob, slot, span );
+	}
+
+	iob->rowsLeft--;
+	if ( iob->rowsLeft == 0 )
+		iob->finished = true;
+
+	RetireSlots( iob, row->runCount, iob->finished );
+
+	// This row is the one above the next row.
+	iob->prevCount = row->runCount;
+	swap = iob->prevSpans;
+	iob->prevSpans = iob->curSpans;
+	iob->curSpans = swap;
+
+	iob->currentRow++;
+
+	// Feed functions are expected to FreeRow the rows they get.
+	FreeRow( (uint8_t *)row );
+}
+
+/**
+ * \brief Gets the list of finished blobs.
+ *
+ * Blobs are added to the list as soon as they end, so the list is only
+ * complete once the module has stopped running.  The blobs are in the order
+ * they finished, which is roughly by their bottom edge.
+ *
+ * \param iob The ISC_out_blob state structure.
+ * \param count Where to put the number of blobs in the list.
+ * \return The blob list.  It belongs to the module, so don't free it.
+ */
+__attribute__((gnu_inline)) inline const ISC_out_blob_blob *ISC_out_blob_getblobs( ISC_out_blob *iob, uint8_t *count )
+{
+	*count = iob->blobCount;
+	return iob->blobs;
+}
+
+/**
+ * \brief Exports the blob list as text to a file or serial port.
+ *
+ * \param iob The ISC_out_blob state structure.
+ * \param fp The file pointer to write the data to.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_blob_export_text( ISC_out_blob *iob, FILE *fp )
+{
+	uint8_t count;
+	ISC_out_blob_blob *b;
+
+	for ( count = 0; count < iob->blobCount; count++ )
+	{
+		b = &iob->blobs[count];
+		fprintf( fp, "BLOB %u: label %u area %lu box %u,%u-%u,%u center %u,%u\n", count, b->label, (unsigned long)b->area, b->x0, b->y0, b->x1, b->y1, b->centroidX, b->centroidY );
+	}
+	if ( iob->droppedBlobs )
+		fprintf( fp, "DROPPED %u\n", iob->droppedBlobs );
+}
+
+// Put a 16-bit number in a buffer, least significant byte first.
+__attribute__((gnu_inline)) inline static uint8_t *PutLE16( uint8_t *buffer, uint16_t value )
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = value >> 8;
+	return buffer + 2;
+}
+
+/**
+ * \brief Exports the blob list in binary form to a file or serial port.
+ *
+ * The format is described in ISC_out_blob.h.  Like export_text, call it once
+ * the module has stopped running.
+ *
+ * \param iob The ISC_out_blob state structure.
+ * \param fp The file pointer to write the data to.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_blob_export_binary( ISC_out_blob *iob, FILE *fp )
+{
+	ISC_util_sink sink = ISC_util_sink_fromfile( fp );
+
+	ISC_out_blob_export_binary_sink( iob, &sink );
+}
+
+/**
+ * \brief Exports the blob list in binary form to a sink.
+ *
+ * Give it ISC_out_serial_sink( ios, ISC_OUT_SERIAL_TYPE_BLOB ) to send the
+ * list as framed serial records; the records add up to the same bytes
+ * export_binary writes.
+ *
+ * \param iob The ISC_out_blob state structure.
+ * \param sink Where to write the data.
+ * \return FALSE if any write to the sink failed.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_blob_export_binary_sink( ISC_out_blob *iob, ISC_util_sink *sink )
+{
+	// The header and a few blobs are gathered here and written together.
+	uint8_t buffer[ISC_OUT_BLOB_HEADERBYTES + 3 * ISC_OUT_BLOB_RECORDBYTES];
+	uint8_t *end = buffer;
+	uint8_t count;
+	ISC_out_blob_blob *b;
+	bool ok = true;
+
+	*end++ = ISC_OUT_BLOB_MAGIC0;
+	*end++ = ISC_OUT_BLOB_MAGIC1;
+	*end++ = ISC_OUT_BLOB_VERSION;
+	*end++ = iob->blobCount;
+	end = PutLE16( end, iob->droppedBlobs );
+
+	for ( count = 0; count < iob->blobCount; count++ )
+	{
+		if ( end + ISC_OUT_BLOB_RECORDBYTES > buffer + sizeof(buffer) )
+		{
+			if ( !ISC_util_sink_write( sink, buffer, end - buffer ) )
+				ok = false;
+			end = buffer;
+		}
+
+		b = &iob->blobs[count];
+		*end++ = b->label;
+		end = PutLE16( PutLE16( end, b->area & 0xFFFF ), b->area >> 16 );
+		end = PutLE16( end, b->x0 );
+		end = PutLE16( end, b->y0 );
+		end = PutLE16( end, b->x1 );
+		end = PutLE16( end, b->y1 );
+		end = PutLE16( end, b->centroidX );
+		end = PutLE16( end, b->centroidY );
+	}
+
+	if ( !ISC_util_sink_write( sink, buffer, end - buffer ) )
+		ok = false;
+	return ok;
+}
+
+/**
+ * \brief Cleans up and ends the ISC_out_blob module.
+ *
+ * \param iob The ISC_out_blob state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_blob_end( ISC_out_blob *iob )
+{
+	free( iob->slots );
+	free( iob->freeSlots );
+	free( iob->prevSpans );
+	free( iob->curSpans );
+	free( iob->blobs );
+	free( iob );
+}
+
+/**
+ * \brief Returns whether ISC_out_blob is running.
+ *
+ * \param iob The ISC_out_blob state structure.
+ * \return TRUE if running, FALSE if finished.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_blob_running( ISC_out_blob *iob )
+{
+	return !iob->finished;
+}
@@ -0,0 +1,134 @@
+/***************************************************************************//**
+ * \file ISC_out_blob.h
+ * \brief Out-Module for connected-component (blob) statistics.
+ *
+ * ISC_out_blob.h describes a module that labels connected regions of the
+ * run-length rows made by ISC_process_threshold in a single pass, and keeps
+ * the area, bounding box and centroid of every blob it finds.  Only the
+ * previous and current rows are ever kept, so it works within the CMUcam3's
+ * memory.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_BLOB_H_
+#define _ISC_OUT_BLOB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_process_threshold.h"
+#include "ISC_util_sink.h"
+
+/**
+ * ISC_OUT_BLOB_FREE marks a union-find slot that isn't in use.  It's also why
+ * there can't be more than 254 labels open at once.
+ */
+#define ISC_OUT_BLOB_FREE 0xFF
+
+/**
+ * The binary export format starts every blob list with a 6-byte header: the
+ * two magic bytes, the format version, the number of blobs, and the number of
+ * dropped blobs (2 bytes).  Each blob follows in ISC_OUT_BLOB_RECORDBYTES
+ * bytes: the label, the area (4 bytes), then x0, y0, x1, y1, centroidX and
+ * centroidY (2 bytes each).  Numbers are least significant byte first.
+ */
+#define ISC_OUT_BLOB_MAGIC0 'I'
+#define ISC_OUT_BLOB_MAGIC1 'B'
+#define ISC_OUT_BLOB_VERSION 1
+#define ISC_OUT_BLOB_HEADERBYTES 6
+#define ISC_OUT_BLOB_RECORDBYTES 17
+
+/**
+ * \brief A finished blob.
+ *
+ * This is what the user gets back from ISC_out_blob_getblobs once the frame
+ * is done.
+ */
+typedef struct
+{
+	uint8_t label; //!< The color class of the blob (the run label).
+	uint32_t area; //!< The number of pixels in the blob.
+	uint16_t x0; //!< Left edge of the bounding box.
+	uint16_t y0; //!< Top edge of the bounding box.
+	uint16_t x1; //!< Right edge of the bounding box (inclusive).
+	uint16_t y1; //!< Bottom edge of the bounding box (inclusive).
+	uint16_t centroidX; //!< X coordinate of the center of mass.
+	uint16_t centroidY; //!< Y coordinate of the center of mass.
+} ISC_out_blob_blob;
+
+/**
+ * \brief A union-find slot for a blob that is still being built.
+ *
+ * Users of ISC_out_blob will most likely never encounter or use this
+ * structure.  Only the root slot of a set has meaningful statistics.
+ */
+typedef struct
+{
+	uint8_t parent; //!< Parent slot, or the slot itself if it is a root.
+	uint8_t label; //!< The color class of the blob.
+	uint16_t lastRow; //!< The last row a run was added to this blob.
+	uint16_t x0; //!< Left edge of the bounding box.
+	uint16_t y0; //!< Top edge of the bounding box.
+	uint16_t x1; //!< Right edge of the bounding box.
+	uint16_t y1; //!< Bottom edge of the bounding box.
+	uint32_t area; //!< Pixel count (zeroth moment).
+	uint32_t sumX; //!< Sum of X coordinates (first moment in X).
+	uint32_t sumY; //!< Sum of Y coordinates (first moment in Y).
+} ISC_out_blob_slot;
+
+/**
+ * \brief A run tagged with the blob slot it belongs to.
+ *
+ * Users of ISC_out_blob will most likely never encounter or use this
+ * structure.
+ */
+typedef struct
+{
+	uint16_t start; //!< The first pixel of the run.
+	uint16_t end; //!< The last pixel of the run (inclusive).
+	uint8_t label; //!< The color class of the run.
+	uint8_t slot; //!< The union-find slot of the run.
+} ISC_out_blob_span;
+
+/**
+ * \brief Out-Module for blob statistics.
+ *
+ * ISC_out_blob labels blobs with a union-find table of at most maxLabels
+ * entries.  When a blob has no runs in the newest row it can't grow any more,
+ * so its statistics are moved to the blob list and its slot is reused.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context.
+	uint8_t maxLabels; //!< Number of blobs that can be open at once.
+	uint8_t maxBlobs; //!< Number of finished blobs that are kept.
+	uint32_t minArea; //!< Blobs smaller than this are thrown away.
+	bool eightConnected; //!< Do diagonal neighbours count as touching?
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	ISC_out_blob_slot *slots; //!< The union-find table.
+	uint8_t *freeSlots; //!< Stack of unused slots.
+	uint8_t freeCount; //!< Number of entries in freeSlots.
+	ISC_out_blob_span *prevSpans; //!< Runs of the previous row.
+	ISC_out_blob_span *curSpans; //!< Runs of the row being labelled.
+	uint16_t prevCount; //!< Number of runs in prevSpans.
+	ISC_out_blob_blob *blobs; //!< The finished blobs.
+	uint8_t blobCount; //!< Number of entries in blobs.
+	uint16_t droppedBlobs; //!< Blobs that didn't fit in the blob list.
+	uint16_t currentRow; //!< The row number of the next row to come in.
+	uint16_t rowsLeft; //!< The number of rows left to process.
+	//-------------------------ISC_PIPELINE REQUIRED----------------------------
+	bool finished; //!< Is the module finished?
+} ISC_out_blob;
+
+ISC_out_blob *ISC_out_blob_start( ISC_util_imagecontext, uint8_t, uint8_t, uint32_t, bool );
+void ISC_out_blob_feed( ISC_out_blob *, ISC_process_threshold_runrow * );
+const ISC_out_blob_blob *ISC_out_blob_getblobs( ISC_out_blob *, uint8_t * );
+void ISC_out_blob_export_text( ISC_out_blob *, FILE * );
+void ISC_out_blob_export_binary( ISC_out_blob *, FILE * );
+bool ISC_out_blob_export_binary_sink( ISC_out_blob *, ISC_util_sink * );
+void ISC_out_blob_end( ISC_out_blob * );
+bool ISC_out_blob_running( ISC_out_blob * );
+
+#endif
@@ -0,0 +1,268 @@
+/***************************************************************************//**
+ * \file ISC_out_classify.c
+ * \brief Out-Module for table-driven tile classification.
+ *
+ * ISC_out_classify.c contains the functions for classifying the tiles of an
+ * image by their color modes.  All of the decision making is in the table
+ * given to the module, so classifying a tile is one table lookup, and new
+ * classes can be added by changing the table instead of the code.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ISC_out_classify.h"
+#include "ISC_out_histogram.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_imagecontext.h"
+
+// Classify the tile row the histogrammer just finished.
+__attribute__((gnu_inline)) inline static void ClassifyTileRow( ISC_out_classify *ico )
+{
+	uint8_t modes[ISC_CLASSIFY_MAXINDEXBITS];
+	uint8_t tile, channel;
+	uint16_t index;
+	uint8_t *gridRow = ico->grid + ico->tileRow * ico->histogram->Xsubdivisions;
+
+	for ( tile = 0; tile < ico->histogram->Xsubdivisions; tile++ )
+	{
+		ISC_out_histogram_getmodes( ico->histogram, tile, modes );
+
+		index = 0;
+		for ( channel = 0; channel < ico->histogram->channels; channel++ )
+			index = ( index << ico->binBits ) | modes[channel];
+
+		gridRow[tile] = ico->table[index];
+	}
+
+	ico->tileRow++;
+}
+
+/**
+ * \brief Creates an ISC_out_classify module.
+ *
+ * This function creates a new ISC_out_classify module.  The tiles are the
+ * subdivisions of an ISC_out_histogram, so the same rules about xSub, ySub
+ * and colorBins apply.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param xSub The number of tiles across.
+ * \param ySub The number of tiles down.
+ * \param colorBins The number of color bins per channel.  Must be a power of two.
+ * \param table The class of every combination of modes, colorBins^channels entries.  It is copied, so it doesn't have to stick around.  Pass NULL to load one later with ISC_out_classify_loadtable.
+ * \return ISC_out_classify state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_classify *ISC_out_classify_start( ISC_util_imagecontext context, uint8_t xSub, uint8_t ySub, uint8_t colorBins, const uint8_t *table )
+{
+	// -MEMORY IS ALLOCATED HERE-
+	ISC_out_classify *ico = malloc( sizeof( ISC_out_classify ) );
+	if ( !ico )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_classify!" );
+
+	ico->theContext = context;
+
+	// Mode tracking is left off; at the bin counts a table allows, scanning
+	// the bins once per tile is cheaper.  ISC_out_classify_trackmodes turns
+	// it on.
+	ico->histogram = ISC_out_histogram_start( context, xSub, ySub, colorBins );
+
+	ico->binBits = 8 - ico->histogram->binShiftFactor;
+	if ( ico->binBits * ico->histogram->channels > ISC_CLASSIFY_MAXINDEXBITS )
+		ISC_util_assert_message( "FATAL: Too many bins or channels for a classify table!" );
+	ico->tableSize = 1 << ( ico->binBits * ico->histogram->channels );
+
+	// -MEMORY IS ALLOCATED HERE-
+	ico->table = malloc( ico->tableSize );
+	ico->grid = malloc( xSub * ySub );
+	if ( !ico->table || !ico->grid )
+		ISC_util_assert_message( "FATAL: Not enough memory for ISC_out_classify tables!" );
+
+	if ( table )
+		memcpy( ico->table, table, ico->tableSize );
+	else
+		memset( ico->table, '?', ico->tableSize );
+	memset( ico->grid, '?', xSub * ySub );
+
+	ico->tileRow = 0;
+
+	return ico;
+}
+
+/**
+ * \brief Turns mode tracking in the histogrammer on or off.
+ *
+ * See ISC_out_histogram_trackmodes.  It is off to begin with, since it was
+ * slower at every bin count benchmark.c tried; BenchClassify times both.
+ * Change it only between frames.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \param track TRUE to keep the tile modes up to date while feeding.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_trackmodes( ISC_out_classify *ico, bool track )
+{
+	ISC_out_histogram_trackmodes( ico->histogram, track );
+}
+
+/**
+ * \brief Loads a new class table from a file.
+ *
+ * This reads tableSize bytes (colorBins^channels) from the file into the
+ * module's table, so classes can be changed on the SD card without
+ * rebuilding the program.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \param fp The file to read the table from.
+ * \return TRUE if a whole table was read.  If not, the old table is kept.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_classify_loadtable( ISC_out_classify *ico, FILE *fp )
+{
+	uint8_t *newTable;
+	bool success;
+
+	// -MEMORY IS ALLOCATED HERE-
+	newTable = malloc( ico->tableSize );
+	if ( !newTable )
+		return false;
+
+	success = fread( newTable, 1, ico->tableSize, fp ) == ico->tableSize;
+	if ( success )
+		memcpy( ico->table, newTable, ico->tableSize );
+
+	free( newTable );
+	return success;
+}
+
+/**
+ * \brief Feeds a row of pixels into the classifier.
+ *
+ * When a row of tiles is finished, all of its tiles are classified right away
+ * and put in the grid.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \param row A pointer to a row of pixels.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_feed( ISC_out_classify *ico, uint8_t *row )
+{
+	if ( row )
+	{
+		ISC_out_histogram_feed( ico->histogram, row );
+		if ( ico->histogram->linesLeft == 0 )
+			ClassifyTileRow( ico );
+	}
+}
+
+/**
+ * \brief Gets the grid of tile classes.
+ *
+ * The grid has xSub classes for the top row of tiles, then xSub for the next
+ * row, and so on.  Tiles that haven't been reached yet are '?'.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \return The grid.  It belongs to the module, so don't free it.
+ */
+__attribute__((gnu_inline)) inline const uint8_t *ISC_out_classify_getgrid( ISC_out_classify *ico )
+{
+	return ico->grid;
+}
+
+/**
+ * \brief Sends the grid of tile classes to a file or the serial port.
+ *
+ * The whole grid goes out in a single fwrite, with no separators.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \param fp The file pointer to write the grid to.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_export( ISC_out_classify *ico, FILE *fp )
+{
+	fwrite( ico->grid, 1, ico->histogram->Xsubdivisions * ico->histogram->Ysubdivisions, fp );
+}
+
+/**
+ * \brief Sends the grid of tile classes one row of tiles per line.
+ *
+ * Each row of tiles goes out as xSub classes followed by lineEnd.  This is
+ * the format the ISC Pipeline demo has always sent over the serial port.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \param fp The file pointer to write the grid to.
+ * \param lineEnd What to end each line with, like "\r" or "\n".
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_exportlines( ISC_out_classify *ico, FILE *fp, const char *lineEnd )
+{
+	uint8_t tileRow;
+
+	for ( tileRow = 0; tileRow < ico->histogram->Ysubdivisions; tileRow++ )
+	{
+		fwrite( ico->grid + tileRow * ico->histogram->Xsubdivisions, 1, ico->histogram->Xsubdivisions, fp );
+		fputs( lineEnd, fp );
+	}
+}
+
+/**
+ * \brief Gets the classifier ready for the next frame.
+ *
+ * The table and memory are kept, so nothing is allocated or copied again.
+ * Call it once the grid of the last frame has been read or exported.
+ *
+ * \param ico The ISC_out_classify state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_reset( ISC_out_classify *ico )
+{
+	ISC_out_histogram_reset( ico->histogram );
+	ico->tileRow = 0;
+}
+
+/**
+ * \brief Cleans up and ends the ISC_out_classify module.
+ *
+ * \param ico The ISC_out_classify state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_end( ISC_out_classify *ico )
+{
+	ISC_out_histogram_end( ico->histogram );
+	free( ico->table );
+	free( ico->grid );
+	free( ico );
+}
+
+/**
+ * \brief Sends back whether the classifier is still running.
+ *
+ * \param ico The ISC_out_classify state structure.
+ * \return Whether or not the module is still running.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_classify_running( ISC_out_classify *ico )
+{
+	return ISC_out_histogram_running( ico->histogram );
+}
+
+/**
+ * \brief Fills in the grass/sand/white line table for RGB with 4 bins.
+ *
+ * This builds the 64-entry table for the crude IGVC rules the demo program
+ * has always used: 'G' for grass, 'S' for sand, 'W' for white lines and '?'
+ * for anything else.  It is a good starting point for a tuned table.
+ *
+ * \param table Where to put the table.  Needs room for 64 entries.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_classify_table_igvc( uint8_t *table )
+{
+	uint8_t r, g, b;
+
+	for ( r = 0; r < 4; r++ )
+		for ( g = 0; g < 4; g++ )
+			for ( b = 0; b < 4; b++ )
+			{
+				if ( r < 3 && b == 0 )
+					table[(r << 4) | (g << 2) | b] = 'G';
+				else if ( r == 2 && g == 2 && (b == 1 || b == 2) )
+					table[(r << 4) | (g << 2) | b] = 'S';
+				else if ( r >= 2 && g >= 2 && b >= 2 )
+					table[(r << 4) | (g << 2) | b] = 'W';
+				else
+					table[(r << 4) | (g << 2) | b] = '?';
+			}
+}
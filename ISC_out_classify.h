@@ -0,0 +1,63 @@
+/***************************************************************************//**
+ * \file ISC_out_classify.h
+ * \brief Out-Module for table-driven tile classification.
+ *
+ * ISC_out_classify.h describes a module that splits the image into tiles,
+ * finds the fullest color bin of each channel in each tile with
+ * ISC_out_histogram, and looks the result up in a table to get a class for
+ * the tile (like grass, sand or white line).  The classes for a whole frame
+ * are kept in one packed grid.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_CLASSIFY_H_
+#define _ISC_OUT_CLASSIFY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_out_histogram.h"
+
+/**
+ * ISC_CLASSIFY_MAXINDEXBITS is the largest number of bits a table index can
+ * have.  The index is made of log2(colorBins) bits per channel, so this caps
+ * the table at 4096 entries.
+ */
+#define ISC_CLASSIFY_MAXINDEXBITS 12
+
+/**
+ * \brief Out-Module for tile classification.
+ *
+ * ISC_out_classify turns each tile of an image into a one-byte class.  The
+ * class of a tile is table[index], where the index is the fullest bin of
+ * channel 0 in the top bits, then channel 1, and so on.  For RGB with 4 bins
+ * that's (R << 4) | (G << 2) | B, a 64-entry table.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	ISC_out_histogram *histogram; //!< The histogrammer finding the tile modes.
+	uint8_t *table; //!< The class of every combination of modes.
+	uint16_t tableSize; //!< The number of entries in table.
+	uint8_t binBits; //!< Bits of the table index used by each channel.
+	uint8_t *grid; //!< Classes of the tiles, one row of tiles after another.
+	uint8_t tileRow; //!< The row of tiles being worked on.
+} ISC_out_classify;
+
+ISC_out_classify *ISC_out_classify_start( ISC_util_imagecontext, uint8_t, uint8_t, uint8_t, const uint8_t * );
+void ISC_out_classify_trackmodes( ISC_out_classify *, bool );
+bool ISC_out_classify_loadtable( ISC_out_classify *, FILE * );
+void ISC_out_classify_feed( ISC_out_classify *, uint8_t * );
+const uint8_t *ISC_out_classify_getgrid( ISC_out_classify * );
+void ISC_out_classify_export( ISC_out_classify *, FILE * );
+void ISC_out_classify_exportlines( ISC_out_classify *, FILE *, const char * );
+void ISC_out_classify_reset( ISC_out_classify * );
+void ISC_out_classify_end( ISC_out_classify * );
+bool ISC_out_classify_running( ISC_out_classify * );
+
+void ISC_out_classify_table_igvc( uint8_t * );
+
+#endif
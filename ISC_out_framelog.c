@@ -0,0 +1,206 @@
+/***************************************************************************//**
+ * \file ISC_out_framelog.c
+ * \brief Out-Module for logging raw frames with their Image Context.
+ *
+ * ISC_out_framelog.c contains the functions for writing frame headers and rows
+ * to a frame log.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cc3.h>
+
+#include "ISC_out_framelog.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+
+// Put a 16-bit number in a buffer, least significant byte first.
+__attribute__((gnu_inline)) inline static void PutLE16( uint8_t *buffer, uint16_t value )
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = value >> 8;
+}
+
+// Put a 32-bit number in a buffer, least significant byte first.
+__attribute__((gnu_inline)) inline static void PutLE32( uint8_t *buffer, uint32_t value )
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = ( value >> 8 ) & 0xFF;
+	buffer[2] = ( value >> 16 ) & 0xFF;
+	buffer[3] = value >> 24;
+}
+
+// Write the header of the current frame.  The context is written field by
+// field, not as a struct, so the log reads the same on the PC as on the ARM.
+__attribute__((gnu_inline)) inline static void WriteHeader( ISC_out_framelog *iol )
+{
+	uint8_t header[ISC_OUT_FRAMELOG_HEADERBYTES];
+	cc3_frame_t *frame = &iol->theContext.frame;
+
+	memset( header, 0, ISC_OUT_FRAMELOG_HEADERBYTES );
+
+	memcpy( header, ISC_OUT_FRAMELOG_MAGIC, 4 );
+	header[4] = ISC_OUT_FRAMELOG_VERSION;
+	header[5] = ISC_OUT_FRAMELOG_HEADERBYTES;
+	header[6] = frame->channels;
+	header[7] = iol->theContext.colorspace;
+	PutLE16( header + 8, frame->width );
+	PutLE16( header + 10, frame->height );
+	PutLE32( header + 12, iol->frameId );
+	PutLE32( header + 16, cc3_timer_get_current_ms() );
+	PutLE32( header + 20, iol->rowBytes * frame->height );
+	header[24] = iol->theContext.resolution;
+	header[25] = frame->coi;
+	header[26] = frame->subsample_mode;
+	header[27] = frame->x_step;
+	header[28] = frame->y_step;
+	PutLE16( header + 30, frame->raw_width );
+	PutLE16( header + 32, frame->raw_height );
+	PutLE16( header + 34, frame->x0 );
+	PutLE16( header + 36, frame->y0 );
+	PutLE16( header + 38, frame->x1 );
+	PutLE16( header + 40, frame->y1 );
+
+	if ( fwrite( header, 1, ISC_OUT_FRAMELOG_HEADERBYTES, iol->filePointer ) != ISC_OUT_FRAMELOG_HEADERBYTES )
+		iol->writeFailed = true;
+	iol->frameStarted = true;
+}
+
+// Fill out a frame that was cut off with zero rows, so the rows still add up
+// to what its header says.
+__attribute__((gnu_inline)) inline static void PadFrame( ISC_out_framelog *iol )
+{
+	uint32_t left;
+
+	if ( !iol->frameStarted )
+		return;
+
+	left = (uint32_t)iol->rowBytes * iol->rowsLeft;
+	while ( left-- )
+		if ( fputc( 0, iol->filePointer ) == EOF )
+		{
+			iol->writeFailed = true;
+			break;
+		}
+	iol->rowsLeft = 0;
+}
+
+/**
+ * \brief Start ISC_out_framelog module.
+ *
+ * ISC_out_framelog_start sets up a module that appends frames to the file.
+ * Open the file with "ab" to add to an old log, or "wb" to start a new one.
+ * Frame numbers start at 0 for each module, so give each recording its own
+ * file if the numbers should be unique.
+ *
+ * \param context The Image Context of the frames that will be fed in.
+ * \param fp The log file.
+ * \return The State Structure for a ISC_out_framelog module.
+ */
+__attribute__((gnu_inline)) inline ISC_out_framelog *ISC_out_framelog_start( ISC_util_imagecontext context, FILE *fp )
+{
+	ISC_out_framelog *iol;
+
+	// MEMORY IS ALLOCATED HERE.
+	iol = malloc( sizeof( ISC_out_framelog ) );
+	if ( !iol )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_framelog!" );
+
+	iol->theContext = context;
+	iol->filePointer = fp;
+	iol->frameId = 0;
+	iol->rowBytes = (uint32_t)context.frame.width * context.frame.channels;
+	iol->rowsLeft = context.frame.height;
+	iol->frameStarted = false;
+	iol->writeFailed = false;
+	iol->finished = false;
+
+	return iol;
+}
+
+/**
+ * \brief ISC_out_framelog feed function.
+ *
+ * ISC_out_framelog_feed writes the row to the log as it is and frees it.  The
+ * first row of a frame writes the frame's header first.
+ *
+ * \param iol The State Structure of the module.
+ * \param row The incoming row to be fed.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_framelog_feed( ISC_out_framelog *iol, uint8_t *row )
+{
+	if ( !row )
+		return;
+
+	if ( iol->rowsLeft > 0 )
+	{
+		if ( !iol->frameStarted )
+			WriteHeader( iol );
+
+		if ( fwrite( row, 1, iol->rowBytes, iol->filePointer ) != iol->rowBytes )
+			iol->writeFailed = true;
+
+		iol->rowsLeft--;
+		if ( iol->rowsLeft == 0 )
+			iol->finished = true;
+	}
+
+	FreeRow( row );
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * ISC_out_framelog_reset goes on to the next frame number.  If the current
+ * frame wasn't finished, the rest of it is written as zeroes.  A frame that
+ * never got a row isn't written at all, and its number is used again.
+ *
+ * \param iol The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_framelog_reset( ISC_out_framelog *iol )
+{
+	PadFrame( iol );
+	if ( iol->frameStarted )
+		iol->frameId++;
+
+	iol->rowsLeft = iol->theContext.frame.height;
+	iol->frameStarted = false;
+	iol->finished = false;
+}
+
+/**
+ * \brief Free ISC_out_framelog module.
+ *
+ * ISC_out_framelog_end fills out a cut-off frame, flushes the file and frees
+ * the module.  The file is left open.
+ *
+ * \param iol The State Structure of the module.
+ * \return TRUE if every write to the file worked.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_framelog_end( ISC_out_framelog *iol )
+{
+	bool ok;
+
+	PadFrame( iol );
+	if ( fflush( iol->filePointer ) != 0 )
+		iol->writeFailed = true;
+
+	ok = !iol->writeFailed;
+	free( iol );
+	return ok;
+}
+
+/**
+ * \brief Tells whether the module is done with the frame.
+ *
+ * \param iol The State Structure of the module.
+ * \return TRUE if the module wants more rows, FALSE if the frame is finished.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_framelog_running( ISC_out_framelog *iol )
+{
+	return !iol->finished;
+}
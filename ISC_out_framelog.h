@@ -0,0 +1,79 @@
+/***************************************************************************//**
+ * \file ISC_out_framelog.h
+ * \brief Out-Module for logging raw frames with their Image Context.
+ *
+ * ISC_out_framelog.h describes a module that appends frames to a log file
+ * exactly as they came down the pipeline: a small header with the Image
+ * Context, a timestamp and a frame number, then the rows with nothing done to
+ * them.  It costs the camera no more than an fwrite per row, loses nothing,
+ * and ISC_in_framelog reads the log back on the PC so the frames can be run
+ * through a pipeline again.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_FRAMELOG_H_
+#define _ISC_OUT_FRAMELOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+
+/**
+ * A log is nothing but frames one after another.  Each frame is a header of
+ * ISC_OUT_FRAMELOG_HEADERBYTES bytes followed by height rows of
+ * width * channels bytes.  Numbers in the header are least significant byte
+ * first, at these offsets:
+ *
+ *  0  "ISCF"
+ *  4  version (ISC_OUT_FRAMELOG_VERSION)
+ *  5  header size
+ *  6  channels
+ *  7  colorspace
+ *  8  width (2 bytes)
+ * 10  height (2 bytes)
+ * 12  frame number (4 bytes)
+ * 16  timestamp from cc3_timer_get_current_ms (4 bytes)
+ * 20  size of the rows that follow (4 bytes)
+ * 24  resolution, coi, subsample mode, x step, y step (1 byte each)
+ * 30  raw width, raw height, x0, y0, x1, y1 (2 bytes each)
+ *
+ * The rest of the header is zero.  A frame's header size and row size say
+ * where the next frame starts.  Readers stop at a frame whose version they
+ * don't know.
+ */
+#define ISC_OUT_FRAMELOG_MAGIC "ISCF"
+#define ISC_OUT_FRAMELOG_VERSION 1
+#define ISC_OUT_FRAMELOG_HEADERBYTES 64
+
+/**
+ * \brief Out-Module for raw frame logs.
+ *
+ * ISC_out_framelog writes the header when the first row of a frame comes in,
+ * so the timestamp is close to when the frame was captured.  Call
+ * ISC_out_framelog_reset to go on to the next frame.  A frame that is cut off
+ * by a reset or by ending the module is filled out with zero rows, so the log
+ * can still be walked frame by frame.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context of the frames.
+	FILE *filePointer; //!< The log file.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	uint32_t frameId; //!< The number of the current frame.
+	uint32_t rowBytes; //!< The size of one row.
+	uint16_t rowsLeft; //!< The number of rows left in the current frame.
+	bool frameStarted; //!< Has the header of the current frame been written?
+	bool writeFailed; //!< Did any write to the file fail?
+	//-------------------------ISC_PIPELINE REQUIRED----------------------------
+	bool finished; //!< Is the current frame finished?
+} ISC_out_framelog;
+
+ISC_out_framelog *ISC_out_framelog_start( ISC_util_imagecontext, FILE * );
+void ISC_out_framelog_feed( ISC_out_framelog *, uint8_t * );
+void ISC_out_framelog_reset( ISC_out_framelog * );
+bool ISC_out_framelog_end( ISC_out_framelog * );
+bool ISC_out_framelog_running( ISC_out_framelog * );
+
+#endif
@@ -9,12 +9,14 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cc3.h>
 
 #include "ISC_out_histogram.h"
 #include "ISC_util_assert.h"
 #include "ISC_util_common.h"
 #include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
 
 // Allocate the memory for the Histograms in SubAreas.
 __attribute__((gnu_inline)) inline static void InitSubAreas( ISC_out_histogram *ihs )
@@ -23,47 +25,375 @@ __attribute__((gnu_inline)) inline static void InitSubAreas( ISC_out_histogram *
 
 	for ( areaCounter = 0; areaCounter < ihs->Xsubdivisions; areaCounter++ )
 	{
-		// SizeOf uint32_t * pixels in channel * amount of color bins
+		if ( ihs->jointCells )
+		{
+			// Joint mode only needs the cells.
+			ihs->subdivisions[areaCounter].histogram = NULL;
+			ihs->subdivisions[areaCounter].modes = NULL;
+			// -MEMORY IS ALLOCATED HERE-
+			ihs->subdivisions[areaCounter].joint.u8 = malloc( ihs->counterBytes * ihs->jointCells );
+			if ( !ihs->subdivisions[areaCounter].joint.u8 )
+				ISC_util_assert_message( "Fatal: Not enough memory for joint histogram cells!" );
+			continue;
+		}
+
+		// SizeOf uint32_t * channels * amount of color bins * partial
+		// copies
+		// -MEMORY IS ALLOCATED HERE-
+		ihs->subdivisions[areaCounter].histogram = malloc( sizeof(uint32_t) * ihs->channels * ihs->colorBins * ISC_OUT_HISTOGRAM_PARTIALS );
 		// -MEMORY IS ALLOCATED HERE-
-		ihs->subdivisions[areaCounter].histogram = malloc( sizeof(uint32_t) * 3 * ihs->colorBins );
+		ihs->subdivisions[areaCounter].modes = malloc( sizeof(uint8_t) * ihs->channels );
+		ihs->subdivisions[areaCounter].joint.u8 = NULL;
 	}
 }
 
 // Clear up the SubArea so it can be used for accurate counts.
 __attribute__((gnu_inline)) inline static void ClearSubAreas( ISC_out_histogram *ihs )
 {
-	uint8_t areaCounter, binCounter;
+	uint8_t areaCounter, channel;
+	uint16_t binCounter;
 
 	for ( areaCounter = 0; areaCounter < ihs->Xsubdivisions; areaCounter++ )
 	{
-		for ( binCounter = 0; binCounter < 3*ihs->colorBins; binCounter++ )
+		if ( ihs->jointCells )
+		{
+			memset( ihs->subdivisions[areaCounter].joint.u8, 0, ihs->counterBytes * ihs->jointCells );
+			continue;
+		}
+
+		for ( binCounter = 0; binCounter < ihs->channels*ihs->colorBins*ISC_OUT_HISTOGRAM_PARTIALS; binCounter++ )
 		{
 			ihs->subdivisions[areaCounter].histogram[binCounter] = 0;
 		}
+		// With every bin at 0, bin 0 is the fullest (ties go to the
+		// lowest bin).
+		for ( channel = 0; channel < ihs->channels; channel++ )
+			ihs->subdivisions[areaCounter].modes[channel] = 0;
 	}
 }
 
-/**
- * \brief Creates an ISC_out_histogram module.
- *
- * This function creates a new ISC_out_histogram module.  The purpose of
- * ISC_out_histogram is to find histograms of images, which is essentially
- * a count of how many times a certain color value is found.  This
- * implementation separates color values into equally-spaced color "bins"
- * of 255/number of bins in size.  So for instance, if there are 2 color bins,
- * you will get the number of pixels that were under 128 in value for each
- * color range, and you will get the number of pixels over or equal to 128.
- * You can also break the image into subdivisions for more or less precision.
- * If you're low on memory or processor speed (like you are on the CMUcam3),
- * you will probably want fewer subdivisions.
- *
- * \param context The intended context of the image to feed into the module.
- * \param xSub The number of X divisions to break the image into when doing the count.
- * \param ySub The number of Y divisions to break the image into when doing the count.
- * \param colorBins The number of bins to have pixel value counts in.  This needs to be a power of two because it uses rightward shifts to do division really fast.
- * \return ISC_out_histogram state structure.
- */
-__attribute__((gnu_inline)) inline ISC_out_histogram *ISC_out_histogram_start( ISC_util_imagecontext context, uint8_t xSub, uint8_t ySub, uint8_t colorBins )
+// Add the partial histograms into the first one so the counts are complete.
+__attribute__((gnu_inline)) inline static void MergeSubAreas( ISC_out_histogram *ihs )
+{
+#if ISC_OUT_HISTOGRAM_PARTIALS > 1
+	uint8_t areaCounter, partial;
+	uint16_t binCounter, binsPerCopy = ihs->channels*ihs->colorBins;
+	uint32_t *histogram;
+
+	// Joint mode doesn't use the partial copies.
+	if ( ihs->jointCells )
+		return;
+
+	for ( areaCounter = 0; areaCounter < ihs->Xsubdivisions; areaCounter++ )
+	{
+		histogram = ihs->subdivisions[areaCounter].histogram;
+		for ( partial = 1; partial < ISC_OUT_HISTOGRAM_PARTIALS; partial++ )
+		{
+			for ( binCounter = 0; binCounter < binsPerCopy; binCounter++ )
+			{
+				histogram[binCounter] += histogram[partial*binsPerCopy + binCounter];
+				histogram[partial*binsPerCopy + binCounter] = 0;
+			}
+		}
+	}
+#else
+	(void)ihs;
+#endif
+}
+
+// Count one subdivision's worth of a 3-channel row.  Returns where the next
+// subdivision starts.
+__attribute__((gnu_inline)) inline static uint8_t *FeedRGB( ISC_out_histogram *ihs, uint32_t *histogram, uint8_t *pixel )
+{
+	uint16_t counter;
+	uint8_t shift = ihs->binShiftFactor;
+	// Each channel has its own run of bins, so the three increments for a
+	// pixel never touch the same counter.
+	uint32_t *rBins = histogram;
+	uint32_t *gBins = rBins + ihs->colorBins;
+	uint32_t *bBins = gBins + ihs->colorBins;
+#if ISC_OUT_HISTOGRAM_PARTIALS > 1
+	// Every other pixel goes into the second copy.
+	uint32_t *rBins2 = rBins + 3*ihs->colorBins;
+	uint32_t *gBins2 = gBins + 3*ihs->colorBins;
+	uint32_t *bBins2 = bBins + 3*ihs->colorBins;
+
+	for ( counter = 1; counter < ihs->subSize; counter += 2 )
+	{
+		rBins[pixel[0] >> shift]++;
+		gBins[pixel[1] >> shift]++;
+		bBins[pixel[2] >> shift]++;
+		rBins2[pixel[3] >> shift]++;
+		gBins2[pixel[4] >> shift]++;
+		bBins2[pixel[5] >> shift]++;
+		pixel += 6;
+	}
+	if ( counter == ihs->subSize )
+#else
+	for ( counter = 0; counter < ihs->subSize; counter++ )
+#endif
+	{
+		rBins[pixel[0] >> shift]++;
+		gBins[pixel[1] >> shift]++;
+		bBins[pixel[2] >> shift]++;
+		pixel += 3;
+	}
+	return pixel;
+}
+
+// Count one subdivision's worth of a 1-channel row.
+__attribute__((gnu_inline)) inline static uint8_t *FeedMono( ISC_out_histogram *ihs, uint32_t *histogram, uint8_t *pixel )
+{
+	uint16_t counter;
+	uint8_t shift = ihs->binShiftFactor;
+#if ISC_OUT_HISTOGRAM_PARTIALS > 1
+	uint32_t *histogram2 = histogram + ihs->colorBins;
+
+	for ( counter = 1; counter < ihs->subSize; counter += 2 )
+	{
+		histogram[pixel[0] >> shift]++;
+		histogram2[pixel[1] >> shift]++;
+		pixel += 2;
+	}
+	if ( counter == ihs->subSize )
+#else
+	for ( counter = 0; counter < ihs->subSize; counter++ )
+#endif
+	{
+		histogram[*pixel >> shift]++;
+		pixel++;
+	}
+	return pixel;
+}
+
+// Count one subdivision's worth of a row with any other number of channels.
+// This one doesn't bother with the partial copies.
+__attribute__((gnu_inline)) inline static uint8_t *FeedAny( ISC_out_histogram *ihs, uint32_t *histogram, uint8_t *pixel )
+{
+	uint16_t counter;
+	uint8_t channel, shift = ihs->binShiftFactor;
+	uint32_t *bins;
+
+	for ( counter = 0; counter < ihs->subSize; counter++ )
+	{
+		bins = histogram;
+		for ( channel = 0; channel < ihs->channels; channel++ )
+		{
+			bins[*pixel >> shift]++;
+			bins += ihs->colorBins;
+			pixel++;
+		}
+	}
+	return pixel;
+}
+
+// Count one subdivision's worth of a row and keep the fullest bin of each
+// channel up to date as it goes.  Counts only ever go up by one, so a bin
+// becomes the new mode exactly when it passes the old one, or ties it and is
+// lower (which is the bin a full scan would have picked).  The partial copies
+// aren't used here since the modes need the real counts.
+__attribute__((gnu_inline)) inline static uint8_t *FeedTracked( ISC_out_histogram *ihs, ISC_out_histogram_subarea *area, uint8_t *pixel )
+{
+	uint16_t counter;
+	uint8_t channel, bin, mode, shift = ihs->binShiftFactor;
+	uint32_t *bins, count;
+
+	for ( counter = 0; counter < ihs->subSize; counter++ )
+	{
+		bins = area->histogram;
+		for ( channel = 0; channel < ihs->channels; channel++ )
+		{
+			bin = *pixel >> shift;
+			count = ++bins[bin];
+			mode = area->modes[channel];
+			if ( count > bins[mode] || ( count == bins[mode] && bin < mode ) )
+				area->modes[channel] = bin;
+			bins += ihs->colorBins;
+			pixel++;
+		}
+	}
+	return pixel;
+}
+
+// Build the table that turns pixel values into joint-mode cell indices.  Each
+// channel's bin goes in its own group of bits, channel 0 in the top ones, so
+// the cell index of a pixel is the sum of one entry per channel.
+__attribute__((gnu_inline)) inline static void BuildCellLookup( ISC_out_histogram *ihs )
+{
+	uint8_t channel, binBits = 8 - ihs->binShiftFactor;
+	uint16_t value;
+
+	if ( ihs->counterBytes != 1 && ihs->counterBytes != 2 && ihs->counterBytes != 4 )
+		ISC_util_assert_message( "Fatal: Joint histogram counters must be 1, 2 or 4 bytes!" );
+	if ( binBits * ihs->channels > ISC_OUT_HISTOGRAM_MAXCELLBITS )
+		ISC_util_assert_message( "Fatal: Too many bins or channels for a joint histogram!" );
+
+	ihs->jointCells = 1 << ( binBits * ihs->channels );
+
+	// -MEMORY IS ALLOCATED HERE-
+	ihs->cellLookup = malloc( sizeof(uint16_t) * 256 * ihs->channels );
+	if ( !ihs->cellLookup )
+		ISC_util_assert_message( "Fatal: Not enough memory for the joint histogram lookup!" );
+
+	for ( channel = 0; channel < ihs->channels; channel++ )
+		for ( value = 0; value < 256; value++ )
+			ihs->cellLookup[channel*256 + value] = ( value >> ihs->binShiftFactor ) << ( binBits * ( ihs->channels - 1 - channel ) );
+}
+
+// Add a pixel to a joint cell.  The smaller counters stop at their largest
+// value instead of wrapping around to 0.
+__attribute__((gnu_inline)) inline static void CountCell( ISC_out_histogram *ihs, ISC_out_histogram_subarea *area, uint16_t cell )
+{
+	if ( ihs->counterBytes == 1 )
+	{
+		if ( area->joint.u8[cell] != UINT8_MAX )
+			area->joint.u8[cell]++;
+	}
+	else if ( ihs->counterBytes == 2 )
+	{
+		if ( area->joint.u16[cell] != UINT16_MAX )
+			area->joint.u16[cell]++;
+	}
+	else
+		area->joint.u32[cell]++;
+}
+
+// Count one subdivision's worth of a row into the joint cells.
+__attribute__((gnu_inline)) inline static uint8_t *FeedJoint( ISC_out_histogram *ihs, ISC_out_histogram_subarea *area, uint8_t *pixel )
+{
+	uint16_t counter, cell;
+	uint8_t channel;
+	const uint16_t *lookup = ihs->cellLookup;
+
+	for ( counter = 0; counter < ihs->subSize; counter++ )
+	{
+		if ( ihs->channels == 3 )
+		{
+			cell = lookup[pixel[0]] + lookup[256 + pixel[1]] + lookup[512 + pixel[2]];
+			pixel += 3;
+		}
+		else
+		{
+			cell = 0;
+			for ( channel = 0; channel < ihs->channels; channel++ )
+				cell += lookup[channel*256 + *pixel++];
+		}
+
+		CountCell( ihs, area, cell );
+	}
+	return pixel;
+}
+
+// Step the random number generator used for jittered sampling.  It's a
+// 16-bit Galois LFSR, which is plenty random for picking sample positions
+// and costs a shift and an XOR.
+__attribute__((gnu_inline)) inline static uint16_t NextRandom( ISC_out_histogram *ihs )
+{
+	ihs->lfsr = ( ihs->lfsr >> 1 ) ^ ( -( ihs->lfsr & 1 ) & 0xB400 );
+	return ihs->lfsr;
+}
+
+// Count every xStride-th pixel of one subdivision, starting offset pixels in.
+// Plain RGB gets its own loop, and everything else shares one that handles
+// every mode.  Returns where the next subdivision starts.
+__attribute__((gnu_inline)) inline static uint8_t *FeedSampled( ISC_out_histogram *ihs, ISC_out_histogram_subarea *area, uint8_t *pixel, uint8_t offset )
+{
+	uint16_t counter, cell, step = ihs->xStride * ihs->channels;
+	uint8_t channel, bin, mode, shift = ihs->binShiftFactor;
+	uint32_t *bins, count;
+	uint8_t *sample = pixel + offset * ihs->channels;
+
+	if ( ihs->channels == 3 && !ihs->jointCells && !ihs->trackModes )
+	{
+		bins = area->histogram;
+		for ( counter = offset; counter < ihs->subSize; counter += ihs->xStride )
+		{
+			bins[sample[0] >> shift]++;
+			bins[ihs->colorBins + ( sample[1] >> shift )]++;
+			bins[2*ihs->colorBins + ( sample[2] >> shift )]++;
+			sample += step;
+		}
+		return pixel + ihs->subSize * 3;
+	}
+
+	for ( counter = offset; counter < ihs->subSize; counter += ihs->xStride, sample += step )
+	{
+		if ( ihs->jointCells )
+		{
+			cell = 0;
+			for ( channel = 0; channel < ihs->channels; channel++ )
+				cell += ihs->cellLookup[channel*256 + sample[channel]];
+			CountCell( ihs, area, cell );
+			continue;
+		}
+
+		bins = area->histogram;
+		for ( channel = 0; channel < ihs->channels; channel++ )
+		{
+			bin = sample[channel] >> shift;
+			count = ++bins[bin];
+			if ( ihs->trackModes )
+			{
+				mode = area->modes[channel];
+				if ( count > bins[mode] || ( count == bins[mode] && bin < mode ) )
+					area->modes[channel] = bin;
+			}
+			bins += ihs->colorBins;
+		}
+	}
+	return pixel + ihs->subSize * ihs->channels;
+}
+
+// Get ready for the next row.  At the start of a tile row the counts are
+// cleared, and at the start of a group of yStride rows the row that will be
+// counted is picked.  ISC_out_histogram_wantrow gets here before the row is
+// fed, so doing it twice has to be harmless.
+__attribute__((gnu_inline)) inline static void BeginRow( ISC_out_histogram *ihs )
+{
+	if ( ihs->rowBegun )
+		return;
+	ihs->rowBegun = true;
+
+	if ( ihs->linesLeft == 0 )
+	{
+		ClearSubAreas( ihs );
+		ihs->linesLeft = ihs->subLines;
+		ihs->subsLeft--;
+		ihs->rowInGroup = 0;
+	}
+
+	if ( ihs->rowInGroup == 0 )
+		ihs->sampleRow = ihs->jitter ? NextRandom( ihs ) % ihs->yStride : 0;
+}
+
+// Finish a row, whether it was counted or skipped.
+__attribute__((gnu_inline)) inline static void EndRow( ISC_out_histogram *ihs )
+{
+	ihs->rowBegun = false;
+	ihs->linesLeft--;
+	if ( ++ihs->rowInGroup == ihs->yStride )
+		ihs->rowInGroup = 0;
+
+	// The tile is done, so the copies have to be added up before
+	// anyone looks at the counts.
+	if ( ihs->linesLeft == 0 )
+		MergeSubAreas( ihs );
+}
+
+// Read one joint-mode cell count, whatever size the counters are.
+__attribute__((gnu_inline)) inline static uint32_t JointCount( ISC_out_histogram *ihs, ISC_out_histogram_subarea *area, uint16_t cell )
+{
+	if ( ihs->counterBytes == 1 )
+		return area->joint.u8[cell];
+	else if ( ihs->counterBytes == 2 )
+		return area->joint.u16[cell];
+	else
+		return area->joint.u32[cell];
+}
+
+// Set up a histogrammer.  counterBytes is 0 for one histogram per channel, or
+// the size of a cell counter for joint mode.
+__attribute__((gnu_inline)) inline static ISC_out_histogram *StartHistogram( ISC_util_imagecontext context, uint8_t xSub, uint8_t ySub, uint8_t colorBins, uint8_t counterBytes )
 {
 	// Check a couple things to maintain sanity.
 	if ( context.frame.height % ySub != 0 )
@@ -91,16 +421,25 @@ __attribute__((gnu_inline)) inline ISC_out_histogram *ISC_out_histogram_start( I
 	if ( ihs->binShiftFactor == 0 )
 		ISC_util_assert_message( "Fatal: Number of color bins must be a factor of 256!" );
 
-	// Until I fix the code, the Histogram system should not go on if the
-	// current ImageContext has a monochrome colorspace.
-	if ( context.colorspace == CC3_COLORSPACE_MONOCHROME )
-		ISC_util_assert_message( "Fatal: Histogrammer does not support monochrome yet!" );
+	// Monochrome images (like the ones from ISC_process_clamp_colorspace)
+	// only get one channel's worth of bins, so they take a third of the
+	// memory and work of RGB.
+	ihs->channels = context.frame.channels;
+	if ( ihs->channels == 0 )
+		ISC_util_assert_message( "Fatal: Histogrammer needs at least one channel!" );
 
 	// If it is, the shift factor is the number of bits of each colorspace
 	// value (8 in this case) minus binShiftFactor, since we only care
 	// about the most significant bits.
 	ihs->binShiftFactor = 8 - ihs->binShiftFactor;
 
+	// Joint mode needs its cell lookup before the SubAreas are made.
+	ihs->counterBytes = counterBytes;
+	ihs->jointCells = 0;
+	ihs->cellLookup = NULL;
+	if ( counterBytes )
+		BuildCellLookup( ihs );
+
 	// Make the array of SubAreas. 
 	// -MEMORY IS ALLOCATED HERE-
 	ihs->subdivisions = malloc( sizeof( ISC_out_histogram_subarea ) * ihs->Xsubdivisions );
@@ -111,12 +450,82 @@ __attribute__((gnu_inline)) inline ISC_out_histogram *ISC_out_histogram_start( I
 	// Clear the SubAreas.
 	ClearSubAreas( ihs );
 
-	ihs->linesLeft = ihs->height/ihs->Ysubdivisions;
+	// These used to be worked out on every row.  Pixels past
+	// Xsubdivisions*subSize (if the width doesn't divide evenly) aren't
+	// counted.
+	ihs->subSize = ihs->width/ihs->Xsubdivisions;
+	ihs->subLines = ihs->height/ihs->Ysubdivisions;
+
+	ihs->linesLeft = ihs->subLines;
 	ihs->subsLeft = ihs->Ysubdivisions;
+	ihs->trackModes = false;
+
+	// Every pixel is counted until ISC_out_histogram_sampling says
+	// otherwise.
+	ihs->xStride = 1;
+	ihs->yStride = 1;
+	ihs->jitter = false;
+	ihs->lfsr = 0xACE1;
+	ihs->rowInGroup = 0;
+	ihs->sampleRow = 0;
+	ihs->rowBegun = false;
 
 	return ihs;
 }
 
+/**
+ * \brief Creates an ISC_out_histogram module.
+ *
+ * This function creates a new ISC_out_histogram module.  The purpose of
+ * ISC_out_histogram is to find histograms of images, which is essentially
+ * a count of how many times a certain color value is found.  This
+ * implementation separates color values into equally-spaced color "bins"
+ * of 255/number of bins in size.  So for instance, if there are 2 color bins,
+ * you will get the number of pixels that were under 128 in value for each
+ * color range, and you will get the number of pixels over or equal to 128.
+ * You can also break the image into subdivisions for more or less precision.
+ * If you're low on memory or processor speed (like you are on the CMUcam3),
+ * you will probably want fewer subdivisions.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param xSub The number of X divisions to break the image into when doing the count.
+ * \param ySub The number of Y divisions to break the image into when doing the count.
+ * \param colorBins The number of bins to have pixel value counts in.  This needs to be a power of two because it uses rightward shifts to do division really fast.
+ * \return ISC_out_histogram state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_histogram *ISC_out_histogram_start( ISC_util_imagecontext context, uint8_t xSub, uint8_t ySub, uint8_t colorBins )
+{
+	return StartHistogram( context, xSub, ySub, colorBins, 0 );
+}
+
+/**
+ * \brief Creates an ISC_out_histogram module in joint mode.
+ *
+ * A normal histogrammer counts each channel on its own, so it can't tell a
+ * tile of bright green from a tile that is half bright red and half green.
+ * In joint mode, every pixel is put in one cell out of colorBins^channels by
+ * all of its channels at once, and each subdivision has one count per cell.
+ * The cell index has the bin of channel 0 in its top bits, then channel 1,
+ * and so on, which is the same order ISC_out_classify uses for its table.
+ * Counters can be made smaller to save RAM: with 16x16 subdivisions of a HIGH
+ * frame, a tile has 396 pixels, so 2-byte counters can't fill up.  1-byte
+ * counters stop at 255.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param xSub The number of X divisions to break the image into when doing the count.
+ * \param ySub The number of Y divisions to break the image into when doing the count.
+ * \param colorBins The number of bins per channel.  Must be a power of two, and colorBins^channels can't be more than 2^ISC_OUT_HISTOGRAM_MAXCELLBITS.
+ * \param counterBytes The size of each cell counter: 1, 2 or 4 bytes.
+ * \return ISC_out_histogram state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_histogram *ISC_out_histogram_start_joint( ISC_util_imagecontext context, uint8_t xSub, uint8_t ySub, uint8_t colorBins, uint8_t counterBytes )
+{
+	if ( counterBytes == 0 )
+		ISC_util_assert_message( "Fatal: Joint histogram counters must be 1, 2 or 4 bytes!" );
+
+	return StartHistogram( context, xSub, ySub, colorBins, counterBytes );
+}
+
 /**
  * \brief Feeds a row of pixels into the histogrammer.
  *
@@ -127,70 +536,275 @@ __attribute__((gnu_inline)) inline ISC_out_histogram *ISC_out_histogram_start( I
  */
 __attribute__((gnu_inline)) inline void ISC_out_histogram_feed( ISC_out_histogram *ihs, uint8_t *row )
 {
-	uint16_t counter, subCount, high=0, subSize = ihs->width/ihs->Xsubdivisions;
-	uint8_t tempR, tempG, tempB;
-
-	//printf( "feed.\n" );
+	uint8_t subCount;
+	uint8_t *pixel;
 
 	if ( row )
 	{
-		if ( ihs->linesLeft == 0 )
+		BeginRow( ihs );
+
+		// Rows that aren't sampled are just thrown away.
+		if ( ihs->rowInGroup != ihs->sampleRow )
 		{
-			//printf("subbing.\n");
-			ClearSubAreas( ihs );
-			ihs->linesLeft = ihs->height / ihs->Ysubdivisions;
-			ihs->subsLeft--;
-			//printf("subbed.\n");
+			EndRow( ihs );
+			FreeRow(row);
+			return;
 		}
 
+		// Checking the channel count once per subdivision beats checking it for
+		// every pixel, so each common case has its own loop.
+		pixel = row;
 		for ( subCount = 0; subCount < ihs->Xsubdivisions; subCount++ )
 		{
-			high += subSize;
-			for ( counter = high-subSize; counter < high; counter++ )
-			{
-				tempR = (*(row+(counter*3))>>ihs->binShiftFactor)*3;
-				tempG = (*(row+(counter*3)+1)>>ihs->binShiftFactor)*3+1;
-				tempB = (*(row+(counter*3)+2)>>ihs->binShiftFactor)*3+2;
-				//printf("go");
-				ihs->subdivisions[subCount].histogram[tempR]++;
-				ihs->subdivisions[subCount].histogram[tempG]++;
-				ihs->subdivisions[subCount].histogram[tempB]++;
-			}
+			if ( ihs->xStride > 1 )
+				pixel = FeedSampled( ihs, &ihs->subdivisions[subCount], pixel, ihs->jitter ? NextRandom( ihs ) % ihs->xStride : 0 );
+			else if ( ihs->jointCells )
+				pixel = FeedJoint( ihs, &ihs->subdivisions[subCount], pixel );
+			else if ( ihs->trackModes )
+				pixel = FeedTracked( ihs, &ihs->subdivisions[subCount], pixel );
+			else if ( ihs->channels == 3 )
+				pixel = FeedRGB( ihs, ihs->subdivisions[subCount].histogram, pixel );
+			else if ( ihs->channels == 1 )
+				pixel = FeedMono( ihs, ihs->subdivisions[subCount].histogram, pixel );
+			else
+				pixel = FeedAny( ihs, ihs->subdivisions[subCount].histogram, pixel );
 		}
-		//printf( "interesting.\n");
-		ihs->linesLeft--;
-		free(row);
+		EndRow( ihs );
+
+		FreeRow(row);
 	}
 }
 
+/**
+ * \brief Sets up sparse sampling.
+ *
+ * For finding the modes of a tile, counting every pixel is usually overkill.
+ * With sampling turned on, only one row out of every yStride rows of a tile
+ * is counted, and only one pixel out of every xStride pixels of that row.
+ * Without jitter, the first row and pixel of each group is used.  With
+ * jitter, a random one is picked for each group of rows and for each tile of
+ * a row, so the samples don't line up with stripes in the image.  The counts
+ * are of sampled pixels only.  Call this before the first row is fed.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ * \param xStride Count one pixel in this many.  1 counts them all.
+ * \param yStride Count one row in this many.  1 counts them all.
+ * \param jitter TRUE to pick the sampled rows and pixels at random.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_histogram_sampling( ISC_out_histogram *ihs, uint8_t xStride, uint8_t yStride, bool jitter )
+{
+	if ( xStride == 0 || yStride == 0 )
+		ISC_util_assert_message( "Fatal: Sampling strides must be at least 1!" );
+
+	ihs->xStride = xStride;
+	ihs->yStride = yStride;
+	ihs->jitter = jitter;
+}
+
+/**
+ * \brief Tells whether the next row will be counted.
+ *
+ * When sampling, most rows are thrown away without being looked at.  If this
+ * returns FALSE, the row doesn't have to be made at all: call
+ * ISC_out_histogram_skip instead of feeding it (and ISC_in_cmucam_skip instead
+ * of ISC_in_cmucam_process upstream).
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ * \return TRUE if the next row fed will be counted.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_histogram_wantrow( ISC_out_histogram *ihs )
+{
+	BeginRow( ihs );
+	return ihs->rowInGroup == ihs->sampleRow;
+}
+
+/**
+ * \brief Moves on to the next row without feeding one.
+ *
+ * This does the same bookkeeping as feeding a row that isn't sampled, so
+ * tiles still end in the right place.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_histogram_skip( ISC_out_histogram *ihs )
+{
+	BeginRow( ihs );
+	EndRow( ihs );
+}
+
+/**
+ * \brief Gets the histogrammer ready for the next frame.
+ *
+ * This clears the counts and goes back to the first row of tiles, keeping
+ * the memory and settings (joint mode, sampling, mode tracking), so the same
+ * histogrammer can be used for frame after frame.  Call it once the results
+ * of the last frame have been read.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_histogram_reset( ISC_out_histogram *ihs )
+{
+	ClearSubAreas( ihs );
+	ihs->linesLeft = ihs->subLines;
+	ihs->subsLeft = ihs->Ysubdivisions;
+	ihs->rowInGroup = 0;
+	ihs->sampleRow = 0;
+	ihs->rowBegun = false;
+}
+
 /**
  * \brief Exports the histogram results as text to a file or serial port.
  *
  * This function prints the results of the histogram to any file pointer
- * (including stdout) as human-readable text.
+ * (including stdout) as human-readable text.  In joint mode, only the cells
+ * that have pixels in them are printed.
  *
  * \param ihs The ISC_out_histogram state structure.
  * \param fp The file pointer to write the data to.
  */
 __attribute__((gnu_inline)) inline void ISC_out_histogram_export_text( ISC_out_histogram *ihs, FILE *fp )
 {
-	uint8_t xSubCount, bins;
+	uint8_t xSubCount, bins, channel;
+	uint16_t cell;
+	uint32_t count, *histogram;
 
 	fprintf( fp, "Y-SUBDIVISION %u:\n", ihs->Ysubdivisions-ihs->subsLeft );
 	for ( xSubCount = 0; xSubCount < ihs->Xsubdivisions; xSubCount++ )
 	{
 		fprintf( fp, "\tX-SUBDIVISION %u:\n", xSubCount );
+
+		// Most joint cells are empty, so only the ones with pixels in
+		// them are printed.
+		if ( ihs->jointCells )
+		{
+			for ( cell = 0; cell < ihs->jointCells; cell++ )
+			{
+				count = JointCount( ihs, &ihs->subdivisions[xSubCount], cell );
+				if ( count )
+					fprintf( fp, "\t\tCELL %u: %lu\n", cell, (unsigned long)count );
+			}
+			continue;
+		}
+
+		histogram = ihs->subdivisions[xSubCount].histogram;
 		for ( bins = 0; bins < ihs->colorBins; bins++ )
 		{
-			fprintf( fp, "\t\tRBIN %u: %lu, GBIN %u: %lu, BBIN %u: %lu\n", bins, ihs->subdivisions[xSubCount].histogram[bins*3], bins, ihs->subdivisions[xSubCount].histogram[bins*3+1], bins, ihs->subdivisions[xSubCount].histogram[bins*3+2] );
+			if ( ihs->channels == 3 )
+				fprintf( fp, "\t\tRBIN %u: %lu, GBIN %u: %lu, BBIN %u: %lu\n", bins, (unsigned long)histogram[bins], bins, (unsigned long)histogram[ihs->colorBins+bins], bins, (unsigned long)histogram[2*ihs->colorBins+bins] );
+			else
+			{
+				fprintf( fp, "\t\t" );
+				for ( channel = 0; channel < ihs->channels; channel++ )
+					fprintf( fp, "%sC%uBIN %u: %lu", channel ? ", " : "", channel, bins, (unsigned long)histogram[channel*ihs->colorBins+bins] );
+				fprintf( fp, "\n" );
+			}
 		}
 	}
 }
 
-/*void ISC_out_histogram_export_binary( ISC_out_histogram *ihs, FILE *fp )
+// Add one count to an export buffer, sending the buffer when it's close to
+// full.  Returns the new number of bytes in the buffer.  A failed write only
+// clears ok, so the rest of the export still goes out the same way.
+__attribute__((gnu_inline)) inline static uint8_t BufferCount( uint8_t *buffer, uint8_t used, uint8_t size, uint32_t count, bool varint, ISC_util_sink *sink, bool *ok )
 {
-	printf( "Not implemented yet!" );
-}*/
+	if ( varint )
+	{
+		while ( count > 0x7F )
+		{
+			buffer[used++] = ( count & 0x7F ) | 0x80;
+			count = count >> 7;
+		}
+		buffer[used++] = count;
+	}
+	else
+	{
+		buffer[used++] = count;
+		buffer[used++] = count >> 8;
+		buffer[used++] = count >> 16;
+		buffer[used++] = count >> 24;
+	}
+
+	if ( used > size - 5 )
+	{
+		if ( !ISC_util_sink_write( sink, buffer, used ) )
+			*ok = false;
+		used = 0;
+	}
+	return used;
+}
+
+/**
+ * \brief Exports the histogram results in a compact binary form.
+ *
+ * This function sends the current tile row of histograms in the binary
+ * format described in ISC_out_histogram.h.  It is much smaller than the text
+ * export, and it's sent with a handful of fwrite calls instead of one fprintf
+ * per bin, which matters a lot at 115200 baud.  Like export_text, call it when
+ * linesLeft is 0.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ * \param fp The file pointer to write the data to.
+ * \param varint TRUE to send counts as variable-length numbers.  A 16x16 tile of a HIGH frame fits every count in 2 bytes this way.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_histogram_export_binary( ISC_out_histogram *ihs, FILE *fp, bool varint )
+{
+	ISC_util_sink sink = ISC_util_sink_fromfile( fp );
+
+	ISC_out_histogram_export_binary_sink( ihs, &sink, varint );
+}
+
+/**
+ * \brief Exports the histogram results in binary form to a sink.
+ *
+ * This is ISC_out_histogram_export_binary for output that isn't a plain
+ * file.  Give it ISC_out_serial_sink( ios, ISC_OUT_SERIAL_TYPE_HISTOGRAM ) to
+ * send the tile row as framed serial records; the records add up to the same
+ * bytes export_binary writes.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ * \param sink Where to write the data.
+ * \param varint TRUE to send counts as variable-length numbers.
+ * \return FALSE if any write to the sink failed.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_histogram_export_binary_sink( ISC_out_histogram *ihs, ISC_util_sink *sink, bool varint )
+{
+	// Bytes are gathered here and written in chunks.  It has to hold the
+	// header or one count (5 bytes at most) past the flush point.
+	uint8_t buffer[64];
+	uint8_t used = 0;
+	uint8_t xSubCount, bins, channel;
+	uint16_t cell;
+	uint32_t *histogram;
+	bool ok = true;
+
+	buffer[used++] = ISC_OUT_HISTOGRAM_MAGIC0;
+	buffer[used++] = ISC_OUT_HISTOGRAM_MAGIC1;
+	buffer[used++] = ISC_OUT_HISTOGRAM_VERSION;
+	buffer[used++] = ( varint ? ISC_OUT_HISTOGRAM_FLAG_VARINT : 0 ) | ( ihs->jointCells ? ISC_OUT_HISTOGRAM_FLAG_JOINT : 0 );
+	buffer[used++] = ihs->Ysubdivisions-ihs->subsLeft;
+	buffer[used++] = ihs->Xsubdivisions;
+	buffer[used++] = ihs->channels;
+	buffer[used++] = ihs->colorBins;
+
+	for ( xSubCount = 0; xSubCount < ihs->Xsubdivisions; xSubCount++ )
+	{
+		if ( ihs->jointCells )
+		{
+			for ( cell = 0; cell < ihs->jointCells; cell++ )
+				used = BufferCount( buffer, used, sizeof(buffer), JointCount( ihs, &ihs->subdivisions[xSubCount], cell ), varint, sink, &ok );
+			continue;
+		}
+
+		histogram = ihs->subdivisions[xSubCount].histogram;
+		for ( channel = 0; channel < ihs->channels; channel++ )
+			for ( bins = 0; bins < ihs->colorBins; bins++ )
+				used = BufferCount( buffer, used, sizeof(buffer), *histogram++, varint, sink, &ok );
+	}
+
+	if ( used && !ISC_util_sink_write( sink, buffer, used ) )
+		ok = false;
+	return ok;
+}
 
 /**
  * \brief Cleans up and ends the ISC_out_histogram system.
@@ -209,8 +823,11 @@ __attribute__((gnu_inline)) inline void ISC_out_histogram_end( ISC_out_histogram
 		// SizeOf uint32_t * pixels in channel * amount of color bins
 		// -MEMORY IS FREED HERE-
 		free(ihs->subdivisions[areaCounter].histogram);
+		free(ihs->subdivisions[areaCounter].modes);
+		free(ihs->subdivisions[areaCounter].joint.u8);
 	}
 	free( ihs->subdivisions );
+	free( ihs->cellLookup );
 	free( ihs );
 	ihs = NULL;
 }
@@ -233,49 +850,137 @@ __attribute__((gnu_inline)) inline bool ISC_out_histogram_running( ISC_out_histo
 }
 
 /**
- * \brief Gets the maximum value from the given color bin in a histogrammed row.
+ * \brief Turns running mode tracking on or off.
+ *
+ * With mode tracking on, the histogrammer keeps track of the fullest bin of
+ * every channel while it counts, so ISC_out_histogram_getmodes doesn't have
+ * to look at every bin.  It costs a load, compare and branch per channel per
+ * pixel while feeding, and the fast RGB counting path can't be used, so it
+ * is a loss at small bin counts even when the modes of every tile are
+ * wanted; time it with BenchHistogramModes in benchmark.c before turning it
+ * on.  Turn it on or off before the first row of a tile row.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ * \param track TRUE to keep the modes up to date while feeding.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_histogram_trackmodes( ISC_out_histogram *ihs, bool track )
+{
+	ihs->trackModes = track;
+}
+
+/**
+ * \brief Gets the fullest color bin of each channel in an X-subdivision.
  *
  * This function will determine which color bin contains the most pixels from a
- * X-subdivision you specify.  You should check to see if linesLeft in the 
- * state structure is equal to 0 before calling or you will get incomplete 
- * results.
+ * X-subdivision you specify, for each channel.  If two bins are tied, the
+ * lower one wins.  You should check to see if linesLeft in the state
+ * structure is equal to 0 before calling or you will get incomplete results.
+ * Nothing is allocated, so this is safe to call for every tile.  In joint
+ * mode, these are the bins of the fullest cell instead.
  *
  * \param ihs The ISC_out_histogram state structure.
  * \param subX The X-subdivision to find the maximum for.
- * \return The color bin in the X-subdivision of your choice that contains the maximum amount of pixels.
+ * \param modes Where to put the results.  Needs room for one entry per channel.
  */
-__attribute__((gnu_inline)) inline uint8_t *ISC_out_histogram_getmaxes( ISC_out_histogram *ihs, uint8_t subX )
+__attribute__((gnu_inline)) inline void ISC_out_histogram_getmodes( ISC_out_histogram *ihs, uint8_t subX, uint8_t *modes )
 {
-	//! \todo Getmax must support more colorspaces.
-	uint8_t *maxes;
-	uint8_t binCount;
-        uint16_t rMax, gMax, bMax;
+	uint8_t binCount, channel, binBits;
+	uint16_t cell;
+	uint32_t max, *bins;
 
-	maxes = malloc( sizeof(uint8_t)*3 );
+	// In joint mode, the modes are the bins of the fullest cell.
+	if ( ihs->jointCells )
+	{
+		cell = ISC_out_histogram_getjointmode( ihs, subX );
+		binBits = 8 - ihs->binShiftFactor;
+		for ( channel = 0; channel < ihs->channels; channel++ )
+			modes[channel] = ( cell >> ( binBits * ( ihs->channels - 1 - channel ) ) ) & ( ihs->colorBins - 1 );
+		return;
+	}
 
-	maxes[0] = 0; maxes[1] = 0; maxes[2] = 0;
-	rMax = ihs->subdivisions[subX].histogram[0];
-	gMax = ihs->subdivisions[subX].histogram[1];
-	bMax = ihs->subdivisions[subX].histogram[2];
-	// Data order is R0,G0,B0,R1,G1,B1,etc...
-	for ( binCount = 1; binCount < ihs->colorBins; binCount++ )
+	// If the modes were kept up to date, this is just a copy.
+	if ( ihs->trackModes )
 	{
-		if ( ihs->subdivisions[subX].histogram[binCount*3] > rMax )
-		{
-			rMax = ihs->subdivisions[subX].histogram[binCount*3];
-			maxes[0] = binCount;
-		}
-		if ( ihs->subdivisions[subX].histogram[binCount*3+1] > gMax )
-		{
-			gMax = ihs->subdivisions[subX].histogram[binCount*3+1];
-			maxes[1] = binCount;
-		}
-		if ( ihs->subdivisions[subX].histogram[binCount*3+2] > bMax )
+		for ( channel = 0; channel < ihs->channels; channel++ )
+			modes[channel] = ihs->subdivisions[subX].modes[channel];
+		return;
+	}
+
+	bins = ihs->subdivisions[subX].histogram;
+	for ( channel = 0; channel < ihs->channels; channel++ )
+	{
+		modes[channel] = 0;
+		max = bins[0];
+		for ( binCount = 1; binCount < ihs->colorBins; binCount++ )
 		{
-			bMax = ihs->subdivisions[subX].histogram[binCount*3+2];
-			maxes[2] = binCount;
+			if ( bins[binCount] > max )
+			{
+				max = bins[binCount];
+				modes[channel] = binCount;
+			}
 		}
+		bins += ihs->colorBins;
 	}
+}
+
+/**
+ * \brief Gets the maximum value from the given color bin in a histogrammed row.
+ *
+ * This is the old, allocating version of ISC_out_histogram_getmodes.  It is
+ * kept for existing programs, but new code should use getmodes instead.
+ *
+ * \param ihs The ISC_out_histogram state structure.
+ * \param subX The X-subdivision to find the maximum for.
+ * \return An array with one entry per channel holding the color bin with the most pixels.  The caller has to free it.
+ */
+__attribute__((gnu_inline)) inline uint8_t *ISC_out_histogram_getmaxes( ISC_out_histogram *ihs, uint8_t subX )
+{
+	uint8_t *maxes;
+
+	maxes = malloc( sizeof(uint8_t)*ihs->channels );
+	ISC_out_histogram_getmodes( ihs, subX, maxes );
 	
 	return maxes;
 }
+
+/**
+ * \brief Gets the count of one cell of a joint-mode histogram.
+ *
+ * Like the other queries, check that linesLeft is 0 first.
+ *
+ * \param ihs The ISC_out_histogram state structure.  It has to be in joint mode.
+ * \param subX The X-subdivision to look in.
+ * \param cell The cell index, with the bin of channel 0 in the top bits.
+ * \return The number of pixels in the cell.
+ */
+__attribute__((gnu_inline)) inline uint32_t ISC_out_histogram_getcell( ISC_out_histogram *ihs, uint8_t subX, uint16_t cell )
+{
+	return JointCount( ihs, &ihs->subdivisions[subX], cell );
+}
+
+/**
+ * \brief Gets the fullest cell of a joint-mode histogram.
+ *
+ * If two cells are tied, the lower one wins.  The cell index can be used
+ * directly as an index into an ISC_out_classify table.
+ *
+ * \param ihs The ISC_out_histogram state structure.  It has to be in joint mode.
+ * \param subX The X-subdivision to look in.
+ * \return The index of the cell with the most pixels.
+ */
+__attribute__((gnu_inline)) inline uint16_t ISC_out_histogram_getjointmode( ISC_out_histogram *ihs, uint8_t subX )
+{
+	uint16_t cell, mode = 0;
+	uint32_t count, max = JointCount( ihs, &ihs->subdivisions[subX], 0 );
+
+	for ( cell = 1; cell < ihs->jointCells; cell++ )
+	{
+		count = JointCount( ihs, &ihs->subdivisions[subX], cell );
+		if ( count > max )
+		{
+			max = count;
+			mode = cell;
+		}
+	}
+	return mode;
+}
@@ -13,10 +13,72 @@
 #include <stdio.h>
 
 #include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+/**
+ * ISC_OUT_HISTOGRAM_PARTIALS is the number of copies of each histogram that
+ * are counted into at the same time.  Neighbouring pixels usually land in the
+ * same bin, and on a pipelined desktop CPU incrementing the same counter over
+ * and over stalls waiting on the previous store.  Alternating pixels between
+ * copies and adding the copies together at the end of the tile avoids that.
+ * The ARM7 in the CMUcam3 doesn't have this problem and is short on RAM, so
+ * it only gets one copy.
+ */
+#ifdef VIRTUAL_CAM
+#define ISC_OUT_HISTOGRAM_PARTIALS 2
+#else
+#define ISC_OUT_HISTOGRAM_PARTIALS 1
+#endif
+
+/**
+ * The binary export format starts every tile row with an 8-byte header: the
+ * two magic bytes, the format version, a flags byte, the Y-subdivision
+ * number, the number of X-subdivisions, the number of channels and the
+ * number of color bins.  The counts follow, ordered by X-subdivision, then
+ * channel, then bin.  Counts are 4-byte little-endian numbers, unless the
+ * ISC_OUT_HISTOGRAM_FLAG_VARINT flag is set.  In that case each count is
+ * sent 7 bits at a time, low bits first, with the top bit of a byte set if
+ * more bytes follow.  host/ISC_host_histdecode.c turns it back into text.
+ */
+#define ISC_OUT_HISTOGRAM_MAGIC0 'I'
+#define ISC_OUT_HISTOGRAM_MAGIC1 'H'
+#define ISC_OUT_HISTOGRAM_VERSION 1
+#define ISC_OUT_HISTOGRAM_FLAG_VARINT 0x01
+
+/**
+ * ISC_OUT_HISTOGRAM_FLAG_JOINT marks a binary record from a joint-mode
+ * histogrammer.  Instead of channels*colorBins counts, each X-subdivision has
+ * colorBins^channels counts, one per cell in cell index order.
+ */
+#define ISC_OUT_HISTOGRAM_FLAG_JOINT 0x02
+
+/**
+ * ISC_OUT_HISTOGRAM_MAXCELLBITS is the largest number of bits a joint-mode
+ * cell index can have.  The index is made of log2(colorBins) bits per channel,
+ * so RGB can have at most 32 bins per channel in joint mode.
+ */
+#define ISC_OUT_HISTOGRAM_MAXCELLBITS 15
+
+/*
+ * About mode tracking (ISC_out_histogram_trackmodes): it trades a scan of
+ * colorBins counters per channel per tile for a load, compare and branch per
+ * channel per pixel, and it can't use the fast RGB counting path.  A tile has
+ * far more pixels than bins, so at small bin counts it is a loss.  On the PC,
+ * with 16x16 RGB tiles and getmodes called for every tile, benchmark.c found
+ * tracking 3.5 to 7 times slower at 4, 16 and 64 bins.  Leave it off unless
+ * benchmark.c says otherwise for the bin count and camera at hand.
+ */
 
 typedef struct
 {
-	uint32_t *histogram; //!< The histogram.
+	uint32_t *histogram; //!< The histogram.  All bins of channel 0, then all bins of channel 1, etc.
+	uint8_t *modes; //!< The fullest bin of each channel, if trackModes is on.
+	union
+	{
+		uint8_t *u8;
+		uint16_t *u16;
+		uint32_t *u32;
+	} joint; //!< The joint-mode cell counts, counterBytes wide.  NULL if not in joint mode.
 } ISC_out_histogram_subarea;
 
 typedef struct
@@ -26,6 +88,9 @@ typedef struct
 	uint16_t width; //!< Width of the image.
 	uint16_t height; //!< Height of the image.
 
+	uint16_t subSize; //!< Width of one X subdivision in pixels.
+	uint16_t subLines; //!< Height of one Y subdivision in rows.
+
 	uint8_t Xsubdivisions; //!< Number of X subdivisions.
 	uint8_t XsubdivShiftFactor; //!< Used for divide-optimization.  0 if no optimization is going (not a power of two.)
 	uint8_t Ysubdivisions; //!< Number of Y subdivisions.
@@ -34,15 +99,37 @@ typedef struct
 	uint8_t linesLeft; //!< Lines left in the subdivision.
 	uint8_t binShiftFactor; //!< Used for divide-optimization.  0 if no optimization is used (not a power of two.)
 	uint8_t colorBins; //!< The number of color bins.
+	uint8_t channels; //!< The number of channels in each pixel.
+	bool trackModes; //!< Keep the fullest bins up to date while feeding?  Slower at every bin count benchmark.c tries; see ISC_out_histogram_trackmodes.
+	uint16_t jointCells; //!< Number of cells per subdivision in joint mode, or 0 for one histogram per channel.
+	uint8_t counterBytes; //!< Size of a joint-mode cell counter: 1, 2 or 4 bytes.
+	uint16_t *cellLookup; //!< Joint mode: each channel's part of the cell index for every value, 256 entries per channel.
+	uint8_t xStride; //!< Count one pixel out of this many in a row.
+	uint8_t yStride; //!< Count one row out of this many in a subdivision.
+	bool jitter; //!< Pick the sampled rows and pixels at random?
+	uint16_t lfsr; //!< State of the random number generator used for jitter.
+	uint8_t rowInGroup; //!< Position of the next row in its group of yStride rows.
+	uint8_t sampleRow; //!< The row of the current group that gets counted.
+	bool rowBegun; //!< Has the bookkeeping for the next row been done already?
 } ISC_out_histogram;
 
 ISC_out_histogram *ISC_out_histogram_start( ISC_util_imagecontext, uint8_t, uint8_t, uint8_t ); 
+ISC_out_histogram *ISC_out_histogram_start_joint( ISC_util_imagecontext, uint8_t, uint8_t, uint8_t, uint8_t );
 void ISC_out_histogram_feed( ISC_out_histogram *, uint8_t * );
+void ISC_out_histogram_sampling( ISC_out_histogram *, uint8_t, uint8_t, bool );
+bool ISC_out_histogram_wantrow( ISC_out_histogram * );
+void ISC_out_histogram_skip( ISC_out_histogram * );
+void ISC_out_histogram_reset( ISC_out_histogram * );
 void ISC_out_histogram_export_text( ISC_out_histogram *, FILE * );
-//void ISC_out_histogram_export_binary( ISC_out_histogram *, FILE * );
+void ISC_out_histogram_export_binary( ISC_out_histogram *, FILE *, bool );
+bool ISC_out_histogram_export_binary_sink( ISC_out_histogram *, ISC_util_sink *, bool );
 void ISC_out_histogram_end( ISC_out_histogram * );
 bool ISC_out_histogram_running( ISC_out_histogram * );
+void ISC_out_histogram_trackmodes( ISC_out_histogram *, bool );
+void ISC_out_histogram_getmodes( ISC_out_histogram *, uint8_t, uint8_t * );
 uint8_t *ISC_out_histogram_getmaxes( ISC_out_histogram *ihs, uint8_t subX );
+uint32_t ISC_out_histogram_getcell( ISC_out_histogram *, uint8_t, uint16_t );
+uint16_t ISC_out_histogram_getjointmode( ISC_out_histogram *, uint8_t );
 
 #endif
 
@@ -8,11 +8,82 @@
 
 #include "ISC_out_jpeg.h"
 #include "ISC_util_assert.h"
+#include "ISC_util_common.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <jpeglib.h>
+#include <jerror.h>
 
 #include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+/**
+ * \brief Profile for quick looks at the image, like over the serial port.
+ *
+ * Low quality, the fast DCT and 4:2:0 chroma.
+ */
+const ISC_out_jpeg_profile ISC_out_jpeg_profile_fastpreview = { 50, JDCT_IFAST, ISC_OUT_JPEG_CHROMA_420, 0, false };
+
+/**
+ * \brief Profile for images worth keeping, like ones saved to the SD card.
+ *
+ * High quality, the accurate DCT, full chroma and optimized Huffman tables.
+ */
+const ISC_out_jpeg_profile ISC_out_jpeg_profile_archive = { 92, JDCT_ISLOW, ISC_OUT_JPEG_CHROMA_444, 0, true };
+
+// The profile used when none is given, which is how ISC_out_jpeg always
+// worked before it took profiles.
+static const ISC_out_jpeg_profile defaultProfile = { 85, JDCT_ISLOW, ISC_OUT_JPEG_CHROMA_420, 0, false };
+
+// Put the settings of a profile into libjpeg.  This has to come after
+// jpeg_set_defaults, which would undo it.
+__attribute__((gnu_inline)) inline static void ApplyProfile( struct jpeg_compress_struct *cinfo, const ISC_out_jpeg_profile *profile )
+{
+	jpeg_set_quality( cinfo, profile->quality, TRUE );
+	cinfo->dct_method = profile->dctMethod;
+	cinfo->optimize_coding = profile->optimizeHuffman;
+	cinfo->restart_in_rows = profile->restartRows;
+
+	// The sampling factors are for the luma channel; the chroma channels
+	// stay at 1, so 2 means the chroma has half the resolution.
+	cinfo->comp_info[0].h_samp_factor = profile->chroma == ISC_OUT_JPEG_CHROMA_444 ? 1 : 2;
+	cinfo->comp_info[0].v_samp_factor = profile->chroma == ISC_OUT_JPEG_CHROMA_420 ? 2 : 1;
+}
+
+// libjpeg calls this before it writes anything.
+__attribute__((gnu_inline)) inline static void InitDestination( j_compress_ptr cinfo )
+{
+	ISC_out_jpeg *ijc = cinfo->client_data;
+
+	ijc->destination.next_output_byte = ijc->chunk;
+	ijc->destination.free_in_buffer = ijc->chunkSize;
+}
+
+// libjpeg calls this when the chunk is full.  It always means the whole
+// chunk, whatever free_in_buffer says.
+__attribute__((gnu_inline)) inline static boolean EmptyOutputBuffer( j_compress_ptr cinfo )
+{
+	ISC_out_jpeg *ijc = cinfo->client_data;
+
+	if ( !ISC_util_sink_write( &ijc->sink, ijc->chunk, ijc->chunkSize ) )
+		ERREXIT( cinfo, JERR_FILE_WRITE );
+
+	ijc->destination.next_output_byte = ijc->chunk;
+	ijc->destination.free_in_buffer = ijc->chunkSize;
+	return TRUE;
+}
+
+// libjpeg calls this when the image is done, to send the partial chunk.  A
+// file is flushed too, so the end of the image doesn't sit in stdout's buffer.
+__attribute__((gnu_inline)) inline static void TermDestination( j_compress_ptr cinfo )
+{
+	ISC_out_jpeg *ijc = cinfo->client_data;
+
+	if ( !ISC_util_sink_write( &ijc->sink, ijc->chunk, ijc->chunkSize - ijc->destination.free_in_buffer ) )
+		ERREXIT( cinfo, JERR_FILE_WRITE );
+	if ( !ISC_util_sink_flush( &ijc->sink ) )
+		ERREXIT( cinfo, JERR_FILE_WRITE );
+}
 
 /**
  * \brief Creates an ISC_out_jpeg module.
@@ -23,36 +94,78 @@
  *
  * \param context The intended context of the image to feed into the module.
  * \param fp The file pointer.  Make this stdout to send it over the serial port.
+ * \param profile The encoding settings, like &ISC_out_jpeg_profile_fastpreview.  NULL for the defaults.
  * \return ISC_out_jpeg state structure.
  */
-__attribute__((gnu_inline)) inline ISC_out_jpeg *ISC_out_jpeg_start( ISC_util_imagecontext context, FILE *fp )
+__attribute__((gnu_inline)) inline ISC_out_jpeg *ISC_out_jpeg_start( ISC_util_imagecontext context, FILE *fp, const ISC_out_jpeg_profile *profile )
 {
-    ISC_out_jpeg *temp = (ISC_out_jpeg *)malloc( sizeof( ISC_out_jpeg ) );
-    if ( !temp )
-        ISC_util_assert_message( "Ran out of memory creating the JPEG compression schema." );
+	ISC_out_jpeg *temp = ISC_out_jpeg_start_sink( context, ISC_util_sink_fromfile( fp ), profile, ISC_OUT_JPEG_CHUNKSIZE );
 
-	temp->theContext = context;
 	temp->filePointer = fp;
+	return temp;
+}
 
-    temp->compressInfo.err = jpeg_std_error( &temp->jpegError );
-    jpeg_create_compress( &temp->compressInfo );
-    
-    temp->compressInfo.image_width = temp->theContext.frame.width;
-    temp->compressInfo.image_height = temp->theContext.frame.height;
-    temp->compressInfo.input_components = 3;
-    temp->compressInfo.in_color_space = JCS_RGB;
-    
-    jpeg_set_defaults( &temp->compressInfo );
-    jpeg_set_quality( &temp->compressInfo, 85, 1 /*true*/ );
-    
-    jpeg_stdio_dest(&temp->compressInfo, temp->filePointer);
+/**
+ * \brief Creates an ISC_out_jpeg module that writes to a sink.
+ *
+ * This works like ISC_out_jpeg_start, but the encoded bytes can go anywhere:
+ * a block of memory, or a function that sends them out however it likes.
+ * Every time chunkSize bytes have been encoded they are handed to the sink,
+ * so sending overlaps with encoding and the whole JPEG never has to be in
+ * memory at once.  If the sink refuses any bytes, libjpeg treats it like a
+ * failed file write.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param sink Where the encoded bytes go.
+ * \param profile The encoding settings, like &ISC_out_jpeg_profile_fastpreview.  NULL for the defaults.
+ * \param chunkSize The number of bytes to gather before writing to the sink.
+ * \return ISC_out_jpeg state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_jpeg *ISC_out_jpeg_start_sink( ISC_util_imagecontext context, ISC_util_sink sink, const ISC_out_jpeg_profile *profile, uint16_t chunkSize )
+{
+	ISC_out_jpeg *temp;
+
+	if ( chunkSize == 0 )
+		ISC_util_assert_message( "FATAL: The JPEG chunk size can't be 0!" );
+
+	// -MEMORY IS ALLOCATED HERE-
+	temp = (ISC_out_jpeg *)malloc( sizeof( ISC_out_jpeg ) );
+	if ( !temp )
+		ISC_util_assert_message( "Ran out of memory creating the JPEG compression schema." );
+
+	temp->theContext = context;
+	temp->filePointer = NULL;
+	temp->sink = sink;
+	temp->chunkSize = chunkSize;
+
+	// -MEMORY IS ALLOCATED HERE-
+	temp->chunk = malloc( chunkSize );
+	if ( !temp->chunk )
+		ISC_util_assert_message( "Ran out of memory creating the JPEG chunk buffer." );
 
-    jpeg_start_compress(&temp->compressInfo, TRUE);
+	temp->compressInfo.err = jpeg_std_error( &temp->jpegError );
+	jpeg_create_compress( &temp->compressInfo );
+	temp->compressInfo.client_data = temp;
+
+	temp->compressInfo.image_width = temp->theContext.frame.width;
+	temp->compressInfo.image_height = temp->theContext.frame.height;
+	temp->compressInfo.input_components = 3;
+	temp->compressInfo.in_color_space = JCS_RGB;
+
+	jpeg_set_defaults( &temp->compressInfo );
+	ApplyProfile( &temp->compressInfo, profile ? profile : &defaultProfile );
+
+	temp->destination.init_destination = InitDestination;
+	temp->destination.empty_output_buffer = EmptyOutputBuffer;
+	temp->destination.term_destination = TermDestination;
+	temp->compressInfo.dest = &temp->destination;
+
+	jpeg_start_compress(&temp->compressInfo, TRUE);
 
 	temp->rowsLeft = temp->theContext.frame.height;
 	temp->finished = false;
 
-    return temp;
+	return temp;
 }
 
 /**
@@ -73,26 +186,55 @@ __attribute__((gnu_inline)) inline void ISC_out_jpeg_feed( ISC_out_jpeg *ijc, ui
 	{
     	jpegRow[0] = row;
     	jpeg_write_scanlines(&ijc->compressInfo, jpegRow, 1);
-		free(row);
+		FreeRow(row);
 		ijc->rowsLeft--;
 
+		// Finish the image right away, so it is all out by the time the
+		// module says it's done.
 		if ( ijc->rowsLeft == 0 )
+		{
+			jpeg_finish_compress(&ijc->compressInfo);
 			ijc->finished = true;
+		}
 	}
 }
 
+/**
+ * \brief Gets the module ready for the next image.
+ *
+ * The same compressor is used again, with the same settings, tables and
+ * sink, instead of being destroyed and made again.  Each image still gets
+ * all its headers and tables, so it can be decoded on its own.  If the last
+ * image wasn't finished, it is abandoned.
+ *
+ * \param ijc The module's state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_jpeg_reset( ISC_out_jpeg *ijc )
+{
+	if ( !ijc->finished )
+		jpeg_abort_compress(&ijc->compressInfo);
+
+	jpeg_start_compress(&ijc->compressInfo, TRUE);
+
+	ijc->rowsLeft = ijc->theContext.frame.height;
+	ijc->finished = false;
+}
+
 /**
  * \brief End an ISC_out_jpeg module.
  *
  * This function clears up the state structure for an ISC_out_jpeg module.
+ * An image that hasn't had all its rows fed is abandoned.
  *
  * \param ijc The module's state structure.
  * \return Nothing.
  */
 __attribute__((gnu_inline)) inline void ISC_out_jpeg_end( ISC_out_jpeg *ijc )
 {
-    jpeg_finish_compress(&ijc->compressInfo);
+    if ( !ijc->finished )
+        jpeg_abort_compress(&ijc->compressInfo);
     jpeg_destroy_compress(&ijc->compressInfo);
+    free(ijc->chunk);
     free(ijc);
 }
 
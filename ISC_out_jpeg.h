@@ -14,13 +14,57 @@
 #include <jpeglib.h>
 
 #include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+/**
+ * ISC_OUT_JPEG_CHUNKSIZE is the size of the buffer the encoder fills before
+ * handing bytes to the sink, when ISC_out_jpeg_start is used.  The bytes go
+ * out while the rest of the image is still being encoded, so the buffer
+ * doesn't have to be anywhere near the size of a JPEG.
+ */
+#define ISC_OUT_JPEG_CHUNKSIZE 512
+
+/**
+ * \brief How much the color (chroma) channels are shrunk before encoding.
+ *
+ * The eye is much less picky about color than brightness, so throwing away
+ * chroma resolution makes the file smaller and the encode faster with little
+ * visible difference.
+ */
+typedef enum
+{
+	ISC_OUT_JPEG_CHROMA_444, //!< Full color resolution.
+	ISC_OUT_JPEG_CHROMA_422, //!< Half the color resolution across.
+	ISC_OUT_JPEG_CHROMA_420 //!< Half the color resolution across and down (the libjpeg default).
+} ISC_out_jpeg_chroma;
+
+/**
+ * \brief Settings for encoding a JPEG.
+ *
+ * Pass one of these to ISC_out_jpeg_start to trade quality for speed, or
+ * NULL for the defaults ISC_out_jpeg has always used (quality 85, slow
+ * integer DCT, 4:2:0, no restart markers, no Huffman optimization).
+ */
+typedef struct
+{
+	uint8_t quality; //!< libjpeg quality, 1 to 100.
+	J_DCT_METHOD dctMethod; //!< JDCT_ISLOW, JDCT_IFAST or JDCT_FLOAT.  JDCT_IFAST is quickest but a little less accurate.
+	ISC_out_jpeg_chroma chroma; //!< Chroma subsampling.
+	uint16_t restartRows; //!< Put a restart marker every this many rows of blocks, so a corrupted byte only ruins part of the image.  0 for none.
+	bool optimizeHuffman; //!< Build Huffman tables for this image.  Smaller files, but it takes a second pass over the data.
+} ISC_out_jpeg_profile;
+
+extern const ISC_out_jpeg_profile ISC_out_jpeg_profile_fastpreview;
+extern const ISC_out_jpeg_profile ISC_out_jpeg_profile_archive;
 
 /**
  * \brief Out-Module for JPEG output.
  *
  * ISC_out_jpeg is a module for exporting JPEG images from the CMUcam3.  Direct
  * the file pointer to stdout if you want to send stuff over the serial port,
- * or use a file pointer obtained from the SD card's filesystem.
+ * or use a file pointer obtained from the SD card's filesystem.  For anything
+ * else, use ISC_out_jpeg_start_sink.  Encoded bytes are gathered in a small
+ * chunk buffer and handed to the sink every time it fills up.
  */
 typedef struct
 {
@@ -30,13 +74,19 @@ typedef struct
     //----------------------------SYSTEM-HANDLED--------------------------------
     struct jpeg_compress_struct compressInfo; /*!< An internal data structure of libjpeg. */
     struct jpeg_error_mgr jpegError; /*!< A structure used by libjpeg for error handling. */
+    struct jpeg_destination_mgr destination; /*!< Tells libjpeg to put its bytes in chunk. */
+    ISC_util_sink sink; /*!< Where full chunks go. */
+    uint8_t *chunk; /*!< The buffer libjpeg writes into. */
+    uint16_t chunkSize; /*!< The size of chunk. */
 	uint16_t rowsLeft; /*!< Amount of rows left to process. */
 	//-------------------------ISC_PIPELINE REQUIRED----------------------------
     bool finished; /*!< Is the module finished? */
 } ISC_out_jpeg;
 
-ISC_out_jpeg *ISC_out_jpeg_start( ISC_util_imagecontext context, FILE *fp );
+ISC_out_jpeg *ISC_out_jpeg_start( ISC_util_imagecontext context, FILE *fp, const ISC_out_jpeg_profile *profile );
+ISC_out_jpeg *ISC_out_jpeg_start_sink( ISC_util_imagecontext context, ISC_util_sink sink, const ISC_out_jpeg_profile *profile, uint16_t chunkSize );
 void ISC_out_jpeg_feed( ISC_out_jpeg *ijc, uint8_t *row );
+void ISC_out_jpeg_reset( ISC_out_jpeg *ijc );
 void ISC_out_jpeg_end( ISC_out_jpeg *ijc );
 bool ISC_out_jpeg_running( ISC_out_jpeg *ijc );
 
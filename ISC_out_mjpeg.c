@@ -0,0 +1,393 @@
+/***************************************************************************//**
+ * \file ISC_out_mjpeg.c
+ * \brief Out-Module for Motion-JPEG video.
+ *
+ * ISC_out_mjpeg.c contains the functions for encoding frames with one reused
+ * ISC_out_jpeg, wrapping them in AVI chunks, and writing the AVI headers and
+ * index at the end.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ISC_out_mjpeg.h"
+#include "ISC_out_jpeg.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+// Where things are in the AVI headers, counted from the start of the file.
+// The headers are always the same size, so the numbers that aren't known
+// until the end can be filled in there.
+#define AVI_RIFFSIZE 4
+#define AVI_MAXBYTESPERSEC 36
+#define AVI_TOTALFRAMES 48
+#define AVI_SUGGESTEDBUFFER 60
+#define AVI_STREAMLENGTH 140
+#define AVI_STREAMBUFFER 144
+#define AVI_MOVISIZE 216
+#define AVI_MOVI 220
+#define AVI_HEADERBYTES 224
+
+// AVIF_HASINDEX in the main header, AVIIF_KEYFRAME in the index.
+#define AVI_HASINDEX 0x10
+#define AVI_KEYFRAME 0x10
+
+// How many index entries are put together before they are written.
+#define INDEXBATCH 16
+
+// Put a 32-bit number in a buffer, least significant byte first.
+__attribute__((gnu_inline)) inline static void PutLE32( uint8_t *buffer, uint32_t value )
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = ( value >> 8 ) & 0xFF;
+	buffer[2] = ( value >> 16 ) & 0xFF;
+	buffer[3] = value >> 24;
+}
+
+// Write a 32-bit number at a place in the file, then go back to where the
+// file was.
+__attribute__((gnu_inline)) inline static void PatchLE32( ISC_out_mjpeg *imj, long offset, uint32_t value )
+{
+	uint8_t bytes[4];
+	long position = ftell( imj->filePointer );
+
+	PutLE32( bytes, value );
+	if ( fseek( imj->filePointer, offset, SEEK_SET ) != 0 || fwrite( bytes, 1, 4, imj->filePointer ) != 4 || fseek( imj->filePointer, position, SEEK_SET ) != 0 )
+		imj->writeFailed = true;
+}
+
+// Write the AVI headers, with zeroes for the numbers that come at the end.
+__attribute__((gnu_inline)) inline static void WriteAVIHeaders( ISC_out_mjpeg *imj )
+{
+	uint8_t header[AVI_HEADERBYTES];
+	uint16_t width = imj->theContext.frame.width;
+	uint16_t height = imj->theContext.frame.height;
+
+	memset( header, 0, AVI_HEADERBYTES );
+
+	memcpy( header, "RIFF", 4 );
+	memcpy( header + 8, "AVI LIST", 8 );
+	PutLE32( header + 16, 192 );
+	memcpy( header + 20, "hdrlavih", 8 );
+	PutLE32( header + 28, 56 );
+
+	// The main header.
+	PutLE32( header + 32, 1000000 / imj->framesPerSecond );
+	PutLE32( header + 44, AVI_HASINDEX );
+	PutLE32( header + 56, 1 );
+	PutLE32( header + 64, width );
+	PutLE32( header + 68, height );
+
+	memcpy( header + 88, "LIST", 4 );
+	PutLE32( header + 92, 116 );
+	memcpy( header + 96, "strlstrh", 8 );
+	PutLE32( header + 104, 56 );
+
+	// The stream header.
+	memcpy( header + 108, "vidsMJPG", 8 );
+	PutLE32( header + 128, 1 );
+	PutLE32( header + 132, imj->framesPerSecond );
+	PutLE32( header + 148, 0xFFFFFFFF );
+	header[160] = width & 0xFF;
+	header[161] = width >> 8;
+	header[162] = height & 0xFF;
+	header[163] = height >> 8;
+
+	// The stream format, a BITMAPINFOHEADER.
+	memcpy( header + 164, "strf", 4 );
+	PutLE32( header + 168, 40 );
+	PutLE32( header + 172, 40 );
+	PutLE32( header + 176, width );
+	PutLE32( header + 180, height );
+	header[184] = 1;
+	header[186] = 24;
+	memcpy( header + 188, "MJPG", 4 );
+	PutLE32( header + 192, (uint32_t)width * height * 3 );
+
+	memcpy( header + 212, "LIST", 4 );
+	memcpy( header + 220, "movi", 4 );
+
+	if ( fwrite( header, 1, AVI_HEADERBYTES, imj->filePointer ) != AVI_HEADERBYTES )
+		imj->writeFailed = true;
+}
+
+// The encoder's sink.  The AVI chunk header goes in front of a frame's first
+// bytes, with the size filled in when the frame is done.
+__attribute__((gnu_inline)) inline static bool WriteFrameData( void *target, const uint8_t *data, uint32_t length )
+{
+	ISC_out_mjpeg *imj = target;
+	uint8_t chunkHeader[8];
+
+	if ( imj->container == ISC_OUT_MJPEG_AVI && !imj->chunkOpen )
+	{
+		imj->chunkStart = ftell( imj->filePointer );
+		memcpy( chunkHeader, "00dc", 4 );
+		PutLE32( chunkHeader + 4, 0 );
+		if ( fwrite( chunkHeader, 1, 8, imj->filePointer ) != 8 )
+			imj->writeFailed = true;
+		imj->chunkOpen = true;
+	}
+
+	// A failed write is only remembered, not passed back, since libjpeg
+	// would stop the whole program over it.
+	imj->frameBytes += length;
+	if ( fwrite( data, 1, length, imj->filePointer ) != length )
+		imj->writeFailed = true;
+	return true;
+}
+
+// Close the AVI chunk of the current frame.  AVI chunks have to start on
+// even bytes, so odd ones get a byte of padding.
+__attribute__((gnu_inline)) inline static void CloseChunk( ISC_out_mjpeg *imj )
+{
+	if ( imj->frameBytes & 1 )
+		if ( fputc( 0, imj->filePointer ) == EOF )
+			imj->writeFailed = true;
+	PatchLE32( imj, imj->chunkStart + 4, imj->frameBytes );
+	imj->chunkOpen = false;
+}
+
+// Write the idx1 index by walking the frame chunks, a batch of entries at a
+// time.  If a chunk can't be read back, the index stops at the frames before
+// it.  Returns where the index ends.
+__attribute__((gnu_inline)) inline static long WriteIndex( ISC_out_mjpeg *imj )
+{
+	uint8_t entries[INDEXBATCH * 16], chunkHeader[8];
+	long readPosition = imj->riffStart + AVI_HEADERBYTES;
+	long indexStart = ftell( imj->filePointer );
+	long writePosition = indexStart + 8;
+	uint32_t frame, size, written = 0;
+	uint8_t batched = 0;
+	bool readOk = true;
+
+	memcpy( chunkHeader, "idx1", 4 );
+	PutLE32( chunkHeader + 4, imj->frames * 16 );
+	if ( fwrite( chunkHeader, 1, 8, imj->filePointer ) != 8 )
+		imj->writeFailed = true;
+
+	for ( frame = 0; frame < imj->frames && readOk; frame++ )
+	{
+		readOk = fseek( imj->filePointer, readPosition, SEEK_SET ) == 0 && fread( chunkHeader, 1, 8, imj->filePointer ) == 8;
+		if ( readOk )
+		{
+			size = chunkHeader[4] | chunkHeader[5] << 8 | chunkHeader[6] << 16 | (uint32_t)chunkHeader[7] << 24;
+
+			memcpy( entries + batched * 16, "00dc", 4 );
+			PutLE32( entries + batched * 16 + 4, AVI_KEYFRAME );
+			PutLE32( entries + batched * 16 + 8, readPosition - imj->riffStart - AVI_MOVI );
+			PutLE32( entries + batched * 16 + 12, size );
+			batched++;
+			readPosition += 8 + size + ( size & 1 );
+		}
+		else
+			imj->writeFailed = true;
+
+		if ( batched == INDEXBATCH || ( batched > 0 && ( !readOk || frame + 1 == imj->frames ) ) )
+		{
+			if ( fseek( imj->filePointer, writePosition, SEEK_SET ) != 0 || fwrite( entries, 16, batched, imj->filePointer ) != batched )
+				imj->writeFailed = true;
+			writePosition += batched * 16;
+			written += batched;
+			batched = 0;
+		}
+	}
+
+	fseek( imj->filePointer, writePosition, SEEK_SET );
+	if ( written != imj->frames )
+		PatchLE32( imj, indexStart + 4, written * 16 );
+	return writePosition;
+}
+
+// Check that what was written can be read back, which the index needs.  The
+// file is left at its end.
+__attribute__((gnu_inline)) inline static bool ReadsBack( ISC_out_mjpeg *imj )
+{
+	uint8_t magic[4];
+	bool ok;
+
+	ok = fseek( imj->filePointer, imj->riffStart, SEEK_SET ) == 0 && fread( magic, 1, 4, imj->filePointer ) == 4 && memcmp( magic, "RIFF", 4 ) == 0;
+	fseek( imj->filePointer, 0, SEEK_END );
+	return ok;
+}
+
+/**
+ * \brief Creates an ISC_out_mjpeg module.
+ *
+ * The first frame can be fed right away.  For an AVI, the headers are
+ * written now and filled in by ISC_out_mjpeg_end, so the video isn't
+ * playable until the module is ended.  ISC_out_mjpeg_end also reads the
+ * frame chunks back to build the index, so an AVI has to go to a file opened
+ * for update, with fopen( name, "w+b" ).  A file opened with "wb" is caught
+ * here.
+ *
+ * \param context The Image Context of the frames.
+ * \param fp The file to write the video to.  For ISC_OUT_MJPEG_AVI it has to be opened with "w+b".
+ * \param container ISC_OUT_MJPEG_RAW or ISC_OUT_MJPEG_AVI.
+ * \param framesPerSecond The frame rate to put in the AVI headers.
+ * \param profile The JPEG settings, like &ISC_out_jpeg_profile_fastpreview.  NULL for the defaults.
+ * \return ISC_out_mjpeg state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_mjpeg *ISC_out_mjpeg_start( ISC_util_imagecontext context, FILE *fp, ISC_out_mjpeg_container container, uint8_t framesPerSecond, const ISC_out_jpeg_profile *profile )
+{
+	ISC_out_mjpeg *imj;
+
+	if ( framesPerSecond == 0 )
+		ISC_util_assert_message( "FATAL: Motion-JPEG needs at least 1 frame per second!" );
+
+	// -MEMORY IS ALLOCATED HERE-
+	imj = malloc( sizeof( ISC_out_mjpeg ) );
+	if ( !imj )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_mjpeg!" );
+
+	imj->theContext = context;
+	imj->filePointer = fp;
+	imj->container = container;
+	imj->framesPerSecond = framesPerSecond;
+	imj->chunkOpen = false;
+	imj->frameBytes = 0;
+	imj->maxFrameBytes = 0;
+	imj->frames = 0;
+	imj->writeFailed = false;
+	imj->finished = false;
+	imj->riffStart = 0;
+
+	if ( container == ISC_OUT_MJPEG_AVI )
+	{
+		imj->riffStart = ftell( fp );
+		if ( imj->riffStart < 0 )
+			ISC_util_assert_message( "FATAL: AVI output needs a file that can seek!" );
+		WriteAVIHeaders( imj );
+
+		// Read the start of the headers back now, rather than finding out
+		// at the end that the index can't be built.
+		if ( !ReadsBack( imj ) )
+			ISC_util_assert_message( "FATAL: AVI output needs a file opened with \"w+b\"!" );
+	}
+
+	// -MEMORY IS ALLOCATED HERE-
+	imj->encoder = ISC_out_jpeg_start_sink( context, ISC_util_sink_fromfunction( WriteFrameData, imj ), profile, ISC_OUT_JPEG_CHUNKSIZE );
+	imj->encoderReady = true;
+
+	return imj;
+}
+
+/**
+ * \brief Feeds a row of the current frame into the module.
+ *
+ * After the last row, the frame is finished and the module stops running
+ * until ISC_out_mjpeg_reset is called.
+ *
+ * \param imj The module's state structure.
+ * \param row The row.  It is freed.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_mjpeg_feed( ISC_out_mjpeg *imj, uint8_t *row )
+{
+	if ( !row )
+		return;
+	if ( imj->finished )
+	{
+		FreeRow( row );
+		return;
+	}
+
+	// The encoder is only restarted once the next frame has something in
+	// it, so ending between frames doesn't leave an empty one behind.
+	if ( !imj->encoderReady )
+	{
+		ISC_out_jpeg_reset( imj->encoder );
+		imj->encoderReady = true;
+	}
+
+	ISC_out_jpeg_feed( imj->encoder, row );
+
+	if ( !ISC_out_jpeg_running( imj->encoder ) )
+	{
+		if ( imj->container == ISC_OUT_MJPEG_AVI )
+			CloseChunk( imj );
+		if ( imj->frameBytes > imj->maxFrameBytes )
+			imj->maxFrameBytes = imj->frameBytes;
+		imj->frameBytes = 0;
+		imj->frames++;
+		imj->encoderReady = false;
+		imj->finished = true;
+	}
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * \param imj The module's state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_mjpeg_reset( ISC_out_mjpeg *imj )
+{
+	if ( !imj->finished )
+		ISC_util_assert_message( "FATAL: An ISC_out_mjpeg frame can't be reset before it is finished!" );
+
+	imj->finished = false;
+}
+
+/**
+ * \brief Ends an ISC_out_mjpeg module.
+ *
+ * For an AVI, this writes the index and fills in the headers.  A frame that
+ * was started but not finished is left out of the video.  The file isn't
+ * closed.
+ *
+ * \param imj The module's state structure.
+ * \return FALSE if any write to the file failed.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_mjpeg_end( ISC_out_mjpeg *imj )
+{
+	long moviEnd, fileEnd;
+	bool ok;
+
+	ISC_out_jpeg_end( imj->encoder );
+
+	if ( imj->container == ISC_OUT_MJPEG_AVI )
+	{
+		// Part of a frame made it to the file, so it becomes a JUNK
+		// chunk that players skip.
+		if ( imj->chunkOpen )
+		{
+			CloseChunk( imj );
+			fseek( imj->filePointer, imj->chunkStart, SEEK_SET );
+			if ( fwrite( "JUNK", 1, 4, imj->filePointer ) != 4 )
+				imj->writeFailed = true;
+			fseek( imj->filePointer, 0, SEEK_END );
+		}
+
+		moviEnd = ftell( imj->filePointer );
+		fileEnd = WriteIndex( imj );
+
+		PatchLE32( imj, imj->riffStart + AVI_RIFFSIZE, fileEnd - imj->riffStart - 8 );
+		PatchLE32( imj, imj->riffStart + AVI_MAXBYTESPERSEC, imj->maxFrameBytes * imj->framesPerSecond );
+		PatchLE32( imj, imj->riffStart + AVI_TOTALFRAMES, imj->frames );
+		PatchLE32( imj, imj->riffStart + AVI_SUGGESTEDBUFFER, imj->maxFrameBytes + 8 );
+		PatchLE32( imj, imj->riffStart + AVI_STREAMLENGTH, imj->frames );
+		PatchLE32( imj, imj->riffStart + AVI_STREAMBUFFER, imj->maxFrameBytes + 8 );
+		PatchLE32( imj, imj->riffStart + AVI_MOVISIZE, moviEnd - imj->riffStart - AVI_MOVI );
+	}
+
+	if ( fflush( imj->filePointer ) != 0 )
+		imj->writeFailed = true;
+
+	ok = !imj->writeFailed;
+	free( imj );
+	return ok;
+}
+
+/**
+ * \brief Returns whether the current frame still needs rows.
+ *
+ * \param imj The module's state structure.
+ * \return TRUE if running, FALSE once the frame is finished.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_mjpeg_running( ISC_out_mjpeg *imj )
+{
+	return !imj->finished;
+}
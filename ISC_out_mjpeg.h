@@ -0,0 +1,67 @@
+/***************************************************************************//**
+ * \file ISC_out_mjpeg.h
+ * \brief Out-Module for Motion-JPEG video.
+ *
+ * ISC_out_mjpeg.h describes a module that saves frame after frame as one
+ * Motion-JPEG video, either as a plain stream of JPEGs or in an AVI file with
+ * an index, so a field log can be played back like any other video.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_MJPEG_H_
+#define _ISC_OUT_MJPEG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_out_jpeg.h"
+
+/**
+ * \brief How the frames are stored.
+ */
+typedef enum
+{
+	ISC_OUT_MJPEG_RAW, //!< JPEGs one after another.  Works on stdout, and players that know "mjpeg" can read it.
+	ISC_OUT_MJPEG_AVI //!< An AVI file with an index.  The index is built by reading the file back, so it has to be opened with fopen( name, "w+b" ), on the SD card say.
+} ISC_out_mjpeg_container;
+
+/**
+ * \brief Out-Module for Motion-JPEG output.
+ *
+ * ISC_out_mjpeg keeps one ISC_out_jpeg (and so one libjpeg compressor) for
+ * the whole video.  Feed it a frame's rows, and when it stops running, call
+ * ISC_out_mjpeg_reset to go on to the next frame.  Besides the encode
+ * itself, a frame costs an 8-byte chunk header and two seeks to fill in the
+ * size of the chunk in an AVI.  The AVI index isn't kept in memory: the
+ * chunks are walked to build it when the module is ended, so a long video
+ * takes no more RAM than a short one.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context of the frames.
+	FILE *filePointer; //!< The file the video goes to.
+	ISC_out_mjpeg_container container; //!< How the frames are stored.
+	uint8_t framesPerSecond; //!< The frame rate written in the AVI headers.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	ISC_out_jpeg *encoder; //!< The JPEG encoder used for every frame.
+	long riffStart; //!< Where the AVI starts in the file.
+	bool encoderReady; //!< Has the encoder been started on the current frame?
+	bool chunkOpen; //!< Has the AVI chunk of the current frame been started?
+	long chunkStart; //!< Where the AVI chunk of the current frame starts.
+	uint32_t frameBytes; //!< The size of the current frame so far.
+	uint32_t maxFrameBytes; //!< The size of the biggest frame.
+	uint32_t frames; //!< The number of finished frames.
+	bool writeFailed; //!< Did any write to the file fail?
+	//-------------------------ISC_PIPELINE REQUIRED----------------------------
+	bool finished; //!< Is the current frame finished?
+} ISC_out_mjpeg;
+
+ISC_out_mjpeg *ISC_out_mjpeg_start( ISC_util_imagecontext, FILE *, ISC_out_mjpeg_container, uint8_t, const ISC_out_jpeg_profile * );
+void ISC_out_mjpeg_feed( ISC_out_mjpeg *, uint8_t * );
+void ISC_out_mjpeg_reset( ISC_out_mjpeg * );
+bool ISC_out_mjpeg_end( ISC_out_mjpeg * );
+bool ISC_out_mjpeg_running( ISC_out_mjpeg * );
+
+#endif
@@ -10,7 +10,48 @@
 
 #include <stdlib.h>
 #include <png.h>
+#include <zlib.h>
 #include "ISC_out_png.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_sink.h"
+
+/**
+ * \brief Profile for saving on the camera with little memory to spare.
+ *
+ * zlib only needs about 6 kilobytes with these settings, and a fixed SUB
+ * filter does well on camera images without trying every filter on every row.
+ */
+const ISC_out_png_profile ISC_out_png_profile_lowmemory = { 6, Z_DEFAULT_STRATEGY, PNG_FILTER_SUB, 9, 3 };
+
+/**
+ * \brief Profile for encoding as fast as possible, like streaming on the host.
+ *
+ * The files come out bigger, but each row is only filtered once and zlib
+ * barely searches for matches.
+ */
+const ISC_out_png_profile ISC_out_png_profile_fast = { 1, Z_RLE, PNG_FILTER_SUB, 15, 8 };
+
+// What ISC_out_png did before there were profiles.
+static const ISC_out_png_profile defaultProfile = { Z_DEFAULT_COMPRESSION, Z_FILTERED, 0, 11, 5 };
+
+// libpng calls this with encoded bytes.
+__attribute__((gnu_inline)) inline static void WriteData( png_structp png_ptr, png_bytep data, png_size_t length )
+{
+	ISC_out_png *ipw = png_get_io_ptr( png_ptr );
+
+	if ( !ISC_util_sink_write( &ipw->sink, data, length ) )
+		png_error( png_ptr, "Write Error" );
+}
+
+// libpng calls this to push out what has been written.
+__attribute__((gnu_inline)) inline static void FlushData( png_structp png_ptr )
+{
+	ISC_out_png *ipw = png_get_io_ptr( png_ptr );
+
+	if ( !ISC_util_sink_flush( &ipw->sink ) )
+		png_error( png_ptr, "Flush Error" );
+}
 
 /**
  * \brief Creates an ISC_out_png module.
@@ -21,13 +62,53 @@
  *
  * \param context The intended context of the image to feed into the module.
  * \param fp The file pointer.  Make this stdout to send it over the serial port.
- * \return ISC_out_png state structure.
+ * \param profile The encoding settings, like &ISC_out_png_profile_lowmemory.  NULL for the defaults.
+ * \return ISC_out_png state structure, or NULL if the image has neither 1 nor 3 channels.
+ */
+__attribute__((gnu_inline)) inline ISC_out_png *ISC_out_png_start( ISC_util_imagecontext context, FILE *fp, const ISC_out_png_profile *profile )
+{
+	ISC_out_png *ipw = ISC_out_png_start_sink( context, ISC_util_sink_fromfile( fp ), profile );
+
+	if ( ipw )
+		ipw->filePointer = fp;
+	return ipw;
+}
+
+/**
+ * \brief Creates an ISC_out_png module that writes to a sink.
+ *
+ * This works like ISC_out_png_start, but the encoded bytes can go to a block
+ * of memory or a function instead of a file.  If the sink refuses any bytes,
+ * libpng treats it like a failed file write.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param sink Where the encoded bytes go.
+ * \param profile The encoding settings, like &ISC_out_png_profile_fast.  NULL for the defaults.
+ * \return ISC_out_png state structure, or NULL if the image has neither 1 nor 3 channels.
  */
-__attribute__((gnu_inline)) inline ISC_out_png *ISC_out_png_start( ISC_util_imagecontext context, FILE *fp )
+__attribute__((gnu_inline)) inline ISC_out_png *ISC_out_png_start_sink( ISC_util_imagecontext context, ISC_util_sink sink, const ISC_out_png_profile *profile )
 {
-	ISC_out_png *ipw = malloc( sizeof ( ISC_out_png ) );
+	ISC_out_png *ipw;
+	int colorType = PNG_COLOR_TYPE_RGB;
+
+	if ( context.frame.channels == 1 )
+		colorType = PNG_COLOR_TYPE_GRAY;
+	else if ( context.frame.channels != 3 )
+	{
+		ISC_util_assert_message( "FATAL: ISC_out_png can only save 1 or 3 channel images!" );
+		return NULL;
+	}
+
+	if ( !profile )
+		profile = &defaultProfile;
+
+	// -MEMORY IS ALLOCATED HERE-
+	ipw = malloc( sizeof ( ISC_out_png ) );
+	if ( !ipw )
+		ISC_util_assert_message( "FATAL: Ran out of memory creating the PNG module!" );
 
-	ipw->filePointer = fp;
+	ipw->filePointer = NULL;
+	ipw->sink = sink;
 	ipw->theContext = context;
 
 	// Create the png_out_ptr.
@@ -36,17 +117,21 @@ __attribute__((gnu_inline)) inline ISC_out_png *ISC_out_png_start( ISC_util_imag
 	ipw->png_out_info_ptr = png_create_info_struct( ipw->png_out_ptr );
 
 	// memory usage (in bytes) = 2^(memlevel+9) + 2^(windowbits+2).
-	// This configuration uses 24576 bytes of memory.
-	png_set_compression_mem_level( ipw->png_out_ptr, 5 );
-	png_set_compression_window_bits( ipw->png_out_ptr, 11 );
+	// The default configuration uses 24576 bytes of memory.
+	png_set_compression_level( ipw->png_out_ptr, profile->level );
+	png_set_compression_strategy( ipw->png_out_ptr, profile->strategy );
+	png_set_compression_mem_level( ipw->png_out_ptr, profile->memLevel );
+	png_set_compression_window_bits( ipw->png_out_ptr, profile->windowBits );
+	if ( profile->filters )
+		png_set_filter( ipw->png_out_ptr, PNG_FILTER_TYPE_BASE, profile->filters );
 
-	png_init_io( ipw->png_out_ptr, ipw->filePointer );
+	png_set_write_fn( ipw->png_out_ptr, ipw, WriteData, FlushData );
 	png_set_IHDR( ipw->png_out_ptr,
 			ipw->png_out_info_ptr,
 			ipw->theContext.frame.width,
 			ipw->theContext.frame.height,
 			8,
-			PNG_COLOR_TYPE_RGB,
+			colorType,
 			PNG_INTERLACE_NONE,
 			PNG_COMPRESSION_TYPE_DEFAULT,
 			PNG_FILTER_TYPE_DEFAULT );
@@ -72,7 +157,7 @@ __attribute__((gnu_inline)) inline void ISC_out_png_feed( ISC_out_png *ipw, uint
 	if ( ipw->rowsLeft > 0 )
 	{
 		png_write_row( ipw->png_out_ptr, row );
-		free(row);
+		FreeRow(row);
 		ipw->rowsLeft = ipw->rowsLeft - 1;
 
 		if ( ipw->rowsLeft == 0 )
@@ -12,15 +12,39 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <png.h>
+#include <zlib.h>
 
 #include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+/**
+ * \brief Settings for encoding a PNG.
+ *
+ * Pass one of these to ISC_out_png_start to pick between memory, speed and
+ * file size, or NULL for the settings ISC_out_png has always used (default
+ * level, Z_FILTERED, libpng's filter choice, window bits 11, memory level 5).
+ * zlib needs about 2^(memLevel+9) + 2^(windowBits+2) bytes while encoding.
+ */
+typedef struct
+{
+	int8_t level; //!< zlib compression level, 0 (none) to 9 (smallest), or Z_DEFAULT_COMPRESSION.
+	uint8_t strategy; //!< Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY or Z_RLE.
+	uint8_t filters; //!< The PNG_FILTER_ flags libpng may pick from for each row.  Just one (like PNG_FILTER_SUB) skips trying them all.  0 for libpng's choice.
+	uint8_t windowBits; //!< zlib window bits, 8 to 15.  Smaller uses less memory but finds fewer matches.
+	uint8_t memLevel; //!< zlib memory level, 1 to 9.  Smaller uses less memory but is slower.
+} ISC_out_png_profile;
+
+extern const ISC_out_png_profile ISC_out_png_profile_lowmemory;
+extern const ISC_out_png_profile ISC_out_png_profile_fast;
 
 /**
  * \brief Out-Module for PNG output.
  *
  * ISC_out_png is a module for exporting PNG images from the CMUcam3.  Direct
  * the file pointer to stdout if you want to send stuff over the serial port,
- * or use a file pointer obtained from the SD card's filesystem.
+ * or use a file pointer obtained from the SD card's filesystem.  For anything
+ * else, use ISC_out_png_start_sink.  Images with one channel are saved as
+ * grayscale.
  */
 typedef struct
 {
@@ -30,12 +54,14 @@ typedef struct
     //----------------------------SYSTEM-HANDLED--------------------------------
     png_structp png_out_ptr; /*!< An internal libpng data structure. */
     png_infop png_out_info_ptr; /*!< An internal libpng data structure. */
+    ISC_util_sink sink; /*!< Where libpng's bytes go. */
     uint16_t rowsLeft; /*!< The number of rows left to process. */
     //-------------------------ISC_PIPELINE REQUIRED----------------------------
     bool finished; /*!< Is the module finished? */
 } ISC_out_png;
 
-ISC_out_png *ISC_out_png_start( ISC_util_imagecontext context, FILE *fp );
+ISC_out_png *ISC_out_png_start( ISC_util_imagecontext context, FILE *fp, const ISC_out_png_profile *profile );
+ISC_out_png *ISC_out_png_start_sink( ISC_util_imagecontext context, ISC_util_sink sink, const ISC_out_png_profile *profile );
 void ISC_out_png_feed( ISC_out_png *, uint8_t * );
 void ISC_out_png_end( ISC_out_png * );
 bool ISC_out_png_running( ISC_out_png *ipw );
@@ -11,8 +11,21 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ISC_out_ppm.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+
+// Write out whatever is in the buffer.
+__attribute__((gnu_inline)) inline static void FlushBuffer( ISC_out_ppm *ipw )
+{
+	if ( ipw->bufferedRows )
+	{
+		fwrite( ipw->buffer, ipw->rowBytes, ipw->bufferedRows, ipw->filePointer );
+		ipw->bufferedRows = 0;
+	}
+}
 
 /**
  * \brief Creates an ISC_out_ppm module.
@@ -21,14 +34,27 @@
  * context of the image expected to come in, and give it the file pointer to
  * dump the file to.  It will return an ISC_out_ppm state structure.
  *
- * \param context The intended context of the image to feed into the module.
+ * Every write has a fixed cost on top of the bytes it moves (a lot of it on
+ * the SD card), so gathering a few rows into one write helps.  The buffer
+ * takes bufferRows rows of RAM, though, so on the CMUcam3 a handful of rows is
+ * about the limit.
+ *
+ * \param context The intended context of the image to feed into the module.  It needs 1 or 3 channels.
  * \param fp The file pointer.  Make this stdout to send it over the serial port.
+ * \param bufferRows The number of rows to gather before writing.  0 or 1 writes each row straight from the row that was fed in, without copying it.
  * \return ISC_out_ppm state structure.
  */
-__attribute__((gnu_inline)) inline ISC_out_ppm *ISC_out_ppm_start( ISC_util_imagecontext context, FILE *fp )
+__attribute__((gnu_inline)) inline ISC_out_ppm *ISC_out_ppm_start( ISC_util_imagecontext context, FILE *fp, uint8_t bufferRows )
 {
+	uint8_t channels = context.frame.channels;
+
+	if ( channels != 1 && channels != 3 )
+		ISC_util_assert_message( "FATAL: PPM output needs 1 or 3 channels!" );
+
 	// Make the new module state structure.
 	ISC_out_ppm *ipw = malloc( sizeof( ISC_out_ppm ) );
+	if ( !ipw )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_ppm!" );
 	
 	// Load it up with its initial values.
 	ipw->filePointer = fp;
@@ -38,10 +64,23 @@ __attribute__((gnu_inline)) inline ISC_out_ppm *ISC_out_ppm_start( ISC_util_imag
 	ipw->width = ipw->theContext.frame.width;
 	ipw->height = ipw->theContext.frame.height;
 	ipw->rowsLeft = ipw->height;
+	ipw->rowBytes = ipw->width * channels;
+
+	// A buffer of one row would just be an extra copy.
+	ipw->bufferRows = bufferRows > 1 ? bufferRows : 0;
+	ipw->bufferedRows = 0;
+	ipw->buffer = NULL;
+	if ( ipw->bufferRows )
+	{
+		// -MEMORY IS ALLOCATED HERE-
+		ipw->buffer = malloc( ipw->rowBytes * ipw->bufferRows );
+		if ( !ipw->buffer )
+			ISC_util_assert_message( "FATAL: Not enough memory for the ISC_out_ppm buffer!" );
+	}
 
 	//Write the header of the PPM file, since enough stuff is now known
-	//to do this.
-	fprintf( ipw->filePointer, "P6\n%d %d\n255\n", ipw->width, ipw->height );
+	//to do this.  One channel makes it a graymap (P5).
+	fprintf( ipw->filePointer, "%s\n%d %d\n255\n", channels == 1 ? "P5" : "P6", ipw->width, ipw->height );
 
 	return ipw;
 }
@@ -57,15 +96,19 @@ __attribute__((gnu_inline)) inline ISC_out_ppm *ISC_out_ppm_start( ISC_util_imag
  */
 __attribute__((gnu_inline)) inline void ISC_out_ppm_feed( ISC_out_ppm *ipw, uint8_t *row )
 {
-	uint16_t x;
-
 	if ( row && ipw->finished == 0 )
 	{
-		// Write out the row of pixels to the PPM file.
-		for ( x = 0; x < ipw->width*3; x++ )
+		// Write out the row of pixels to the PPM file, or save it up
+		// until the buffer is full.
+		if ( ipw->buffer )
 		{
-			fputc( *(row+x), ipw->filePointer );
+			memcpy( ipw->buffer + ipw->bufferedRows * ipw->rowBytes, row, ipw->rowBytes );
+			ipw->bufferedRows++;
+			if ( ipw->bufferedRows == ipw->bufferRows || ipw->rowsLeft == 1 )
+				FlushBuffer( ipw );
 		}
+		else
+			fwrite( row, 1, ipw->rowBytes, ipw->filePointer );
 
 		// One more row down, rowsLeft rows to go.  Unless rowsLeft is
 		// 0, then we're done.
@@ -73,8 +116,8 @@ __attribute__((gnu_inline)) inline void ISC_out_ppm_feed( ISC_out_ppm *ipw, uint
 		if ( ipw->rowsLeft == 0 )
 			ipw->finished = 1;
 
-		// Feed functions are expected to free row pointers.
-		free(row);
+		// Feed functions are expected to FreeRow the rows they get.
+		FreeRow(row);
 	}
 }
 
@@ -84,13 +127,20 @@ __attribute__((gnu_inline)) inline void ISC_out_ppm_feed( ISC_out_ppm *ipw, uint
  * This function dellocates the memory used by ISC_out_ppm.  The user is still
  * expected to close the file pointer used, though.  This is because if the
  * module did this automatically, bad things could happen if it tried to close
- * stdout.
+ * stdout.  If the module is ended before the whole image has been fed, the
+ * rows in the buffer are still written.
  *
  * \param ipw The state structure of the ISC_out_ppm module.
  * \return Nothing but the minty feeling of deallocated memory.
  */
 __attribute__((gnu_inline)) inline void ISC_out_ppm_end( ISC_out_ppm *ipw )
 {
+	if ( ipw->buffer )
+	{
+		FlushBuffer( ipw );
+		free( ipw->buffer );
+	}
+
 	// Mmm...nothing like peace of mind.
 	free(ipw);
 }
@@ -23,7 +23,10 @@
  *
  * ISC_out_ppm is a module for exporting PPM images from the CMUcam3.  Direct
  * the file pointer to stdout if you want to send stuff over the serial port,
- * or use a file pointer obtained from the SD card's filesystem.
+ * or use a file pointer obtained from the SD card's filesystem.  RGB images
+ * are written as P6 and 1-channel images as P5 (graymap).  Rows are written
+ * with one fwrite each, or gathered bufferRows at a time and written
+ * together.
  */
 typedef struct
 {
@@ -34,11 +37,15 @@ typedef struct
     uint16_t width; /*!< Width of the image. */
     uint16_t height; /*!< Height of the image. */
     uint16_t rowsLeft; /*!< The number of rows left to process. */
+    uint16_t rowBytes; /*!< The number of bytes in one row. */
+    uint8_t *buffer; /*!< Rows waiting to be written, or NULL to write each row as it comes. */
+    uint8_t bufferRows; /*!< The number of rows the buffer holds. */
+    uint8_t bufferedRows; /*!< The number of rows in the buffer now. */
     //-------------------------ISC_PIPELINE REQUIRED----------------------------
     bool finished; /*!< Is the module finished? */
 } ISC_out_ppm;
 
-ISC_out_ppm *ISC_out_ppm_start( ISC_util_imagecontext context, FILE *fp );
+ISC_out_ppm *ISC_out_ppm_start( ISC_util_imagecontext context, FILE *fp, uint8_t bufferRows );
 void ISC_out_ppm_feed( ISC_out_ppm *, uint8_t * );
 void ISC_out_ppm_end( ISC_out_ppm * );
 bool ISC_out_ppm_running( ISC_out_ppm * );
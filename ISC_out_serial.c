@@ -0,0 +1,344 @@
+/***************************************************************************//**
+ * \file ISC_out_serial.c
+ * \brief Out-Module for sending framed binary records over the serial port.
+ *
+ * ISC_out_serial.c contains the functions for packing records into frames,
+ * keeping the two transmit buffers, and handing full buffers to the sink.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ISC_out_serial.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+// CRC-16-CCITT, one entry per byte value, so each byte costs one lookup
+// instead of eight shifts.
+static const uint16_t crcTable[256] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+// Add bytes to a running CRC.
+__attribute__((gnu_inline)) inline static uint16_t UpdateCRC( uint16_t crc, const uint8_t *data, uint16_t length )
+{
+	while ( length-- )
+		crc = ( crc << 8 ) ^ crcTable[( crc >> 8 ) ^ *data++];
+	return crc;
+}
+
+// Wait for the transmitter to let go of a buffer.
+__attribute__((gnu_inline)) inline static void WaitForBuffer( ISC_out_serial *ios, uint8_t which )
+{
+	while ( ios->busy[which] )
+		;
+}
+
+// Send a record made of prefix followed by data, splitting it over as many
+// frames as it takes.
+__attribute__((gnu_inline)) inline static bool SendRecord( ISC_out_serial *ios, uint8_t type, const uint8_t *prefix, uint8_t prefixLength, const uint8_t *data, uint32_t length )
+{
+	uint32_t left = prefixLength + length;
+	uint16_t room, piece, fromPrefix, crc;
+	uint8_t *frame;
+	bool ok = true;
+
+	do
+	{
+		// Start a new buffer if this one can't fit a header and a byte.
+		if ( ios->bufferSize - ios->used <= ISC_OUT_SERIAL_FRAMEBYTES )
+			ok = ISC_out_serial_flush( ios ) && ok;
+
+		room = ios->bufferSize - ios->used - ISC_OUT_SERIAL_FRAMEBYTES;
+		piece = left < room ? left : room;
+		frame = ios->buffers[ios->filling] + ios->used;
+
+		frame[0] = ISC_OUT_SERIAL_SYNC0;
+		frame[1] = ISC_OUT_SERIAL_SYNC1;
+		frame[2] = ios->frameId++;
+		frame[3] = piece < left ? type | ISC_OUT_SERIAL_MORE : type;
+		frame[4] = piece & 0xFF;
+		frame[5] = piece >> 8;
+
+		fromPrefix = prefixLength < piece ? prefixLength : piece;
+		if ( fromPrefix )
+		{
+			memcpy( frame + 6, prefix, fromPrefix );
+			prefix += fromPrefix;
+			prefixLength -= fromPrefix;
+		}
+		if ( piece > fromPrefix )
+		{
+			memcpy( frame + 6 + fromPrefix, data, piece - fromPrefix );
+			data += piece - fromPrefix;
+		}
+
+		crc = UpdateCRC( 0xFFFF, frame + 2, piece + 4 );
+		frame[6 + piece] = crc & 0xFF;
+		frame[7 + piece] = crc >> 8;
+
+		ios->used += piece + ISC_OUT_SERIAL_FRAMEBYTES;
+		left -= piece;
+	} while ( left > 0 );
+
+	return ok;
+}
+
+// Lets ISC_out_serial_sink pass writes on as records.
+__attribute__((gnu_inline)) inline static bool SinkWrite( void *target, const uint8_t *data, uint32_t length )
+{
+	ISC_out_serial *ios = target;
+
+	return SendRecord( ios, ios->sinkType, NULL, 0, data, length );
+}
+
+/**
+ * \brief Start ISC_out_serial module.
+ *
+ * ISC_out_serial_start sets up the two transmit buffers.  Each holds
+ * bufferSize bytes, and no frame is bigger than a buffer, so bigger buffers
+ * mean less framing overhead and fewer writes but more RAM.  A few hundred
+ * bytes is plenty for the serial port.
+ *
+ * \param context The Image Context of the rows that will be fed in.
+ * \param sink Where to write the buffers.  ISC_util_sink_fromfile( stdout ) is the serial port.
+ * \param bufferSize The size of each transmit buffer.  At least 16.
+ * \param asyncDrain TRUE if the transmitter will call ISC_out_serial_drained, FALSE if the sink is done when it returns.
+ * \return The State Structure for a ISC_out_serial module.
+ */
+__attribute__((gnu_inline)) inline ISC_out_serial *ISC_out_serial_start( ISC_util_imagecontext context, ISC_util_sink sink, uint16_t bufferSize, bool asyncDrain )
+{
+	ISC_out_serial *ios;
+
+	if ( bufferSize < 16 )
+		ISC_util_assert_message( "FATAL: ISC_out_serial buffers need at least 16 bytes!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	ios = malloc( sizeof( ISC_out_serial ) );
+	if ( !ios )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_serial!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	ios->buffers[0] = malloc( bufferSize );
+	ios->buffers[1] = malloc( bufferSize );
+	if ( !ios->buffers[0] || !ios->buffers[1] )
+		ISC_util_assert_message( "FATAL: Not enough memory for the ISC_out_serial buffers!" );
+
+	ios->theContext = context;
+	ios->sink = sink;
+	ios->bufferSize = bufferSize;
+	ios->asyncDrain = asyncDrain;
+	ios->used = 0;
+	ios->filling = 0;
+	ios->busy[0] = false;
+	ios->busy[1] = false;
+	ios->sending = 1;
+	ios->frameId = 0;
+	ios->sinkType = ISC_OUT_SERIAL_TYPE_TEXT;
+	ios->failedWrites = 0;
+	ios->rowsLeft = context.frame.height;
+	ios->finished = false;
+
+	return ios;
+}
+
+/**
+ * \brief ISC_out_serial feed function.
+ *
+ * ISC_out_serial_feed sends the row as an ISC_OUT_SERIAL_TYPE_ROW record and
+ * frees it.  After the last row of the frame, the buffer is flushed so the
+ * end of the image doesn't wait for more data.
+ *
+ * \param ios The State Structure of the module.
+ * \param row The incoming row to be fed.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_serial_feed( ISC_out_serial *ios, uint8_t *row )
+{
+	uint16_t rowNumber;
+	uint8_t prefix[3];
+
+	if ( !row )
+		return;
+
+	if ( ios->rowsLeft > 0 )
+	{
+		rowNumber = ios->theContext.frame.height - ios->rowsLeft;
+		prefix[0] = rowNumber & 0xFF;
+		prefix[1] = rowNumber >> 8;
+		prefix[2] = ios->theContext.frame.channels;
+		SendRecord( ios, ISC_OUT_SERIAL_TYPE_ROW, prefix, 3, row, (uint32_t)ios->theContext.frame.width * ios->theContext.frame.channels );
+
+		ios->rowsLeft--;
+		if ( ios->rowsLeft == 0 )
+		{
+			ISC_out_serial_flush( ios );
+			ios->finished = true;
+		}
+	}
+
+	FreeRow( row );
+}
+
+/**
+ * \brief Sends a record.
+ *
+ * The record is copied into the transmit buffer, so the payload can be
+ * reused as soon as this returns.  It won't go out until the buffer fills up
+ * or is flushed.
+ *
+ * \param ios The State Structure of the module.
+ * \param type The kind of record, 1 to 127.  See ISC_out_serial_type.
+ * \param payload The bytes of the record.
+ * \param length How many bytes there are.
+ * \return FALSE if the sink refused a buffer along the way.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_serial_send( ISC_out_serial *ios, uint8_t type, const uint8_t *payload, uint32_t length )
+{
+	return SendRecord( ios, type & ~ISC_OUT_SERIAL_MORE, NULL, 0, payload, length );
+}
+
+/**
+ * \brief Gets a sink that sends what is written to it as records.
+ *
+ * Every write to the sink becomes one record of the given type.  Only one
+ * type can be used at a time, so calling this again changes the type for
+ * sinks already handed out too.
+ *
+ * \param ios The State Structure of the module.
+ * \param type The kind of record to send, like ISC_OUT_SERIAL_TYPE_JPEG.
+ * \return The sink.
+ */
+__attribute__((gnu_inline)) inline ISC_util_sink ISC_out_serial_sink( ISC_out_serial *ios, uint8_t type )
+{
+	ios->sinkType = type & ~ISC_OUT_SERIAL_MORE;
+	return ISC_util_sink_fromfunction( SinkWrite, ios );
+}
+
+/**
+ * \brief Sends whatever is in the transmit buffer now.
+ *
+ * The other buffer becomes the one being filled, so this first waits for it
+ * to finish draining if it hasn't yet.
+ *
+ * \param ios The State Structure of the module.
+ * \return FALSE if the sink refused the buffer.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_serial_flush( ISC_out_serial *ios )
+{
+	uint8_t full = ios->filling;
+	uint16_t used = ios->used;
+	bool ok = true;
+
+	if ( used == 0 )
+		return true;
+
+	WaitForBuffer( ios, 1 - full );
+
+	ios->busy[full] = true;
+	ios->sending = full;
+	ios->filling = 1 - full;
+	ios->used = 0;
+
+	if ( !ISC_util_sink_write( &ios->sink, ios->buffers[full], used ) )
+	{
+		ios->failedWrites++;
+		ok = false;
+		ios->busy[full] = false;
+	}
+	else if ( !ios->asyncDrain )
+		ios->busy[full] = false;
+
+	return ok;
+}
+
+/**
+ * \brief Tells the module the buffer being sent is gone.
+ *
+ * Only needed with asyncDrain.  Call it from the transmitter (like a UART
+ * interrupt handler) when it has finished with the buffer it was given.
+ *
+ * \param ios The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_serial_drained( ISC_out_serial *ios )
+{
+	ios->busy[ios->sending] = false;
+}
+
+/**
+ * \brief Gets the module ready for the rows of the next frame.
+ *
+ * The buffers and frame numbers carry on, so the receiver sees one unbroken
+ * stream.
+ *
+ * \param ios The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_serial_reset( ISC_out_serial *ios )
+{
+	ios->rowsLeft = ios->theContext.frame.height;
+	ios->finished = false;
+}
+
+/**
+ * \brief ISC_out_serial end function.
+ *
+ * Sends anything still in the buffer, waits for it to drain, and frees the
+ * module.
+ *
+ * \param ios The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_serial_end( ISC_out_serial *ios )
+{
+	ISC_out_serial_flush( ios );
+	WaitForBuffer( ios, ios->sending );
+
+	free( ios->buffers[0] );
+	free( ios->buffers[1] );
+	free( ios );
+}
+
+/**
+ * \brief ISC_out_serial running function.
+ *
+ * \param ios The State Structure of the module.
+ * \return TRUE if running, FALSE if every row of the frame has been fed.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_serial_running( ISC_out_serial *ios )
+{
+	return !ios->finished;
+}
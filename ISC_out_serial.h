@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * \file ISC_out_serial.h
+ * \brief Out-Module for sending framed binary records over the serial port.
+ *
+ * ISC_out_serial.h describes a module that wraps anything the camera wants to
+ * send (image rows, JPEG chunks, histogram or blob records) in small frames
+ * with a sync word, a frame number, a payload type, a length and a CRC, so the
+ * PC can find where each one starts, tell what it is, and notice when bytes
+ * were lost.  ISC_host_serialdecode.c in host/ is the receiving end.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_SERIAL_H_
+#define _ISC_OUT_SERIAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+/**
+ * A frame is ISC_OUT_SERIAL_SYNC0, ISC_OUT_SERIAL_SYNC1, the frame number
+ * (counts up and wraps at 255), the payload type, the payload length (2 bytes,
+ * least significant first), the payload, and the CRC (2 bytes, least
+ * significant first).  The CRC is CRC-16-CCITT (polynomial 0x1021, starting
+ * at 0xFFFF) over everything from the frame number to the end of the payload.
+ *
+ * A record too big for one frame is split over several.  Every frame but the
+ * last has ISC_OUT_SERIAL_MORE set in its type.
+ */
+#define ISC_OUT_SERIAL_SYNC0 0xA5
+#define ISC_OUT_SERIAL_SYNC1 0x5A
+#define ISC_OUT_SERIAL_MORE 0x80
+
+/**
+ * ISC_OUT_SERIAL_FRAMEBYTES is how many bytes a frame takes besides its
+ * payload.
+ */
+#define ISC_OUT_SERIAL_FRAMEBYTES 8
+
+/**
+ * \brief The kinds of payload a frame can carry.
+ *
+ * Anything from 1 to 127 can be used.  These are the ones the modules and
+ * the host decoder know about.
+ */
+typedef enum
+{
+	ISC_OUT_SERIAL_TYPE_ROW = 1, //!< An image row: the row number (2 bytes, least significant first), the number of channels, then the pixels.
+	ISC_OUT_SERIAL_TYPE_JPEG = 2, //!< A chunk of a JPEG.  The chunks of one image add up to the whole file.
+	ISC_OUT_SERIAL_TYPE_HISTOGRAM = 3, //!< A chunk of an ISC_out_histogram binary export, from ISC_out_histogram_export_binary_sink.  The chunks add up to what ISC_out_histogram_export_binary writes.
+	ISC_OUT_SERIAL_TYPE_BLOB = 4, //!< A chunk of an ISC_out_blob binary export, from ISC_out_blob_export_binary_sink.  The layout is in ISC_out_blob.h.
+	ISC_OUT_SERIAL_TYPE_TEXT = 5 //!< Plain text, for messages that used to be printf'ed.
+} ISC_out_serial_type;
+
+/**
+ * \brief Out-Module for framed serial output.
+ *
+ * ISC_out_serial builds frames in one of two transmit buffers.  When a buffer
+ * fills up (or ISC_out_serial_flush is called) it is handed to the sink in
+ * one write, and frames go into the other buffer while it drains.
+ *
+ * With a sink that writes before returning, like the serial port through
+ * stdout, the buffer is free again as soon as the write comes back.  If the
+ * sink only starts the transfer (an interrupt-driven UART or DMA), start the
+ * module with asyncDrain and have the transmitter call
+ * ISC_out_serial_drained when the buffer is gone.  The module only waits when
+ * it needs a buffer that hasn't drained yet.
+ *
+ * As a pipeline out-module, feed it rows and it sends each one as an
+ * ISC_OUT_SERIAL_TYPE_ROW record.  ISC_out_serial_send sends any other
+ * record, and ISC_out_serial_sink gives an ISC_util_sink that sends
+ * everything written to it as records of one type, which is how
+ * ISC_out_jpeg's output goes out as ISC_OUT_SERIAL_TYPE_JPEG chunks and the
+ * histogram and blob binary exports go out as ISC_OUT_SERIAL_TYPE_HISTOGRAM
+ * and ISC_OUT_SERIAL_TYPE_BLOB.  Don't write to stdout directly while the
+ * module is using it; the decoder would take those bytes for noise.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context of the rows fed in.
+	ISC_util_sink sink; //!< Where full buffers are written.
+	uint16_t bufferSize; //!< The size of each transmit buffer.
+	bool asyncDrain; //!< Does the transmitter call ISC_out_serial_drained?
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	uint8_t *buffers[2]; //!< The two transmit buffers.
+	uint16_t used; //!< Bytes used in the buffer being filled.
+	uint8_t filling; //!< Which buffer frames are going into.
+	volatile bool busy[2]; //!< Is the buffer still being sent?
+	uint8_t sending; //!< Which buffer was handed to the sink last.
+	uint8_t frameId; //!< The number of the next frame.
+	uint8_t sinkType; //!< The record type for ISC_out_serial_sink.
+	uint32_t failedWrites; //!< How many times the sink refused a buffer.
+	uint16_t rowsLeft; //!< The number of rows left to feed.
+	//-------------------------ISC_PIPELINE REQUIRED----------------------------
+	bool finished; //!< Is the module finished?
+} ISC_out_serial;
+
+ISC_out_serial *ISC_out_serial_start( ISC_util_imagecontext, ISC_util_sink, uint16_t, bool );
+void ISC_out_serial_feed( ISC_out_serial *, uint8_t * );
+bool ISC_out_serial_send( ISC_out_serial *, uint8_t, const uint8_t *, uint32_t );
+ISC_util_sink ISC_out_serial_sink( ISC_out_serial *, uint8_t );
+bool ISC_out_serial_flush( ISC_out_serial * );
+void ISC_out_serial_drained( ISC_out_serial * );
+void ISC_out_serial_reset( ISC_out_serial * );
+void ISC_out_serial_end( ISC_out_serial * );
+bool ISC_out_serial_running( ISC_out_serial * );
+
+#endif
@@ -0,0 +1,290 @@
+/***************************************************************************//**
+ * \file ISC_out_tilestats.c
+ * \brief Out-Module for per-tile mean, variance, minimum and maximum.
+ *
+ * ISC_out_tilestats.c contains the functions for keeping running totals of
+ * each tile as rows stream by, and for turning them into fixed-point means and
+ * variances once a row of tiles is done.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ISC_out_tilestats.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+
+// Start every tile of the row over.
+__attribute__((gnu_inline)) inline static void ClearAccums( ISC_out_tilestats *its )
+{
+	uint16_t count;
+
+	for ( count = 0; count < its->Xsubdivisions * its->channels; count++ )
+	{
+		its->accums[count].sum = 0;
+		its->accums[count].sumSquares = 0;
+		its->accums[count].min = 0xFF;
+		its->accums[count].max = 0;
+	}
+}
+
+// Add up one channel of one tile's part of a row.  The totals are kept in
+// locals while the row is walked and stored once at the end; writing them
+// through the pointer every pixel would make the compiler reload them after
+// every store, since a uint8_t pointer could point anywhere.
+__attribute__((gnu_inline)) inline static void AddSegment( ISC_out_tilestats_accum *accum, uint8_t *pixel, uint16_t count, uint8_t step )
+{
+	uint32_t sum = 0, sumSquares = 0;
+	uint8_t min = accum->min, max = accum->max, value;
+
+	while ( count-- )
+	{
+		value = *pixel;
+		sum += value;
+		sumSquares += (uint32_t)value * value;
+		min = value < min ? value : min;
+		max = value > max ? value : max;
+		pixel += step;
+	}
+
+	accum->sum += sum;
+	accum->sumSquares += sumSquares;
+	accum->min = min;
+	accum->max = max;
+}
+
+// The same for all three channels of an RGB tile at once.  Working on the
+// channels side by side instead of one after another gives the CPU three
+// independent sets of totals to work on.
+__attribute__((gnu_inline)) inline static void AddSegmentRGB( ISC_out_tilestats_accum *accum, uint8_t *pixel, uint16_t count )
+{
+	uint32_t rSum = 0, gSum = 0, bSum = 0;
+	uint32_t rSquares = 0, gSquares = 0, bSquares = 0;
+	uint8_t rMin = accum[0].min, gMin = accum[1].min, bMin = accum[2].min;
+	uint8_t rMax = accum[0].max, gMax = accum[1].max, bMax = accum[2].max;
+	uint8_t r, g, b;
+
+	while ( count-- )
+	{
+		r = pixel[0];
+		g = pixel[1];
+		b = pixel[2];
+		rSum += r;
+		gSum += g;
+		bSum += b;
+		rSquares += (uint32_t)r * r;
+		gSquares += (uint32_t)g * g;
+		bSquares += (uint32_t)b * b;
+		rMin = r < rMin ? r : rMin;
+		gMin = g < gMin ? g : gMin;
+		bMin = b < bMin ? b : bMin;
+		rMax = r > rMax ? r : rMax;
+		gMax = g > gMax ? g : gMax;
+		bMax = b > bMax ? b : bMax;
+		pixel += 3;
+	}
+
+	accum[0].sum += rSum;
+	accum[1].sum += gSum;
+	accum[2].sum += bSum;
+	accum[0].sumSquares += rSquares;
+	accum[1].sumSquares += gSquares;
+	accum[2].sumSquares += bSquares;
+	accum[0].min = rMin;
+	accum[1].min = gMin;
+	accum[2].min = bMin;
+	accum[0].max = rMax;
+	accum[1].max = gMax;
+	accum[2].max = bMax;
+}
+
+/**
+ * \brief Creates an ISC_out_tilestats module.
+ *
+ * This function creates a new ISC_out_tilestats module.  The image is broken
+ * into xSub by ySub tiles the same way ISC_out_histogram does it, so pixels
+ * past Xsubdivisions*subSize (if the width doesn't divide evenly) aren't
+ * counted.
+ *
+ * \param context The intended context of the image to feed into the module.
+ * \param xSub The number of X divisions to break the image into.
+ * \param ySub The number of Y divisions to break the image into.  Has to divide the height evenly, and the tiles can't have more than ISC_TILESTATS_MAXPIXELS pixels.
+ * \return ISC_out_tilestats state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_out_tilestats *ISC_out_tilestats_start( ISC_util_imagecontext context, uint8_t xSub, uint8_t ySub )
+{
+	ISC_out_tilestats *its;
+
+	if ( xSub == 0 || ySub == 0 || context.frame.height % ySub != 0 )
+		ISC_util_assert_message( "FATAL: Tile statistics subdivisions are not equal segments!" );
+	if ( context.frame.channels == 0 )
+		ISC_util_assert_message( "FATAL: Tile statistics need at least one channel!" );
+	if ( (uint32_t)( context.frame.width / xSub ) * ( context.frame.height / ySub ) > ISC_TILESTATS_MAXPIXELS )
+		ISC_util_assert_message( "FATAL: Tile statistics tiles can't have more than ISC_TILESTATS_MAXPIXELS pixels!" );
+
+	// -MEMORY IS ALLOCATED HERE-
+	its = malloc( sizeof( ISC_out_tilestats ) );
+	if ( !its )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_tilestats!" );
+
+	its->theContext = context;
+	its->Xsubdivisions = xSub;
+	its->Ysubdivisions = ySub;
+	its->channels = context.frame.channels;
+	its->subSize = context.frame.width / xSub;
+	its->subLines = context.frame.height / ySub;
+
+	// -MEMORY IS ALLOCATED HERE-
+	its->accums = malloc( sizeof( ISC_out_tilestats_accum ) * xSub * its->channels );
+	if ( !its->accums )
+		ISC_util_assert_message( "FATAL: Not enough memory for ISC_out_tilestats totals!" );
+	ClearAccums( its );
+
+	its->linesLeft = its->subLines;
+	its->subsLeft = ySub;
+
+	return its;
+}
+
+/**
+ * \brief Feeds a row of pixels into the tile statistics.
+ *
+ * \param its The ISC_out_tilestats state structure.
+ * \param row A pointer to a row of pixels.  It is freed.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_tilestats_feed( ISC_out_tilestats *its, uint8_t *row )
+{
+	uint8_t subCount, channel;
+	uint8_t *pixel = row;
+	ISC_out_tilestats_accum *accum;
+
+	if ( !row )
+		return;
+
+	// The previous row of tiles has been looked at, so start the next one.
+	if ( its->linesLeft == 0 )
+	{
+		ClearAccums( its );
+		its->linesLeft = its->subLines;
+		its->subsLeft--;
+	}
+
+	for ( subCount = 0; subCount < its->Xsubdivisions; subCount++ )
+	{
+		accum = &its->accums[subCount * its->channels];
+		if ( its->channels == 3 )
+			AddSegmentRGB( accum, pixel, its->subSize );
+		else
+		{
+			for ( channel = 0; channel < its->channels; channel++ )
+				AddSegment( &accum[channel], pixel + channel, its->subSize, its->channels );
+		}
+		pixel += its->subSize * its->channels;
+	}
+	its->linesLeft--;
+
+	FreeRow( row );
+}
+
+/**
+ * \brief Gets the statistics of one tile.
+ *
+ * The mean and variance come back in fixed point with ISC_TILESTATS_FRACBITS
+ * fraction bits.  This is the only place anything is divided, so it only
+ * costs a few divides per tile.  Check that linesLeft is 0 before calling or
+ * you will get the statistics of a partial tile.
+ *
+ * \param its The ISC_out_tilestats state structure.
+ * \param subX The X-subdivision to get the statistics of.
+ * \param stats Where to put the results.  Needs room for one entry per channel.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_tilestats_getstats( ISC_out_tilestats *its, uint8_t subX, ISC_out_tilestats_stat *stats )
+{
+	uint8_t channel;
+	uint32_t pixels = ( its->subLines - its->linesLeft ) * its->subSize;
+	uint64_t sum;
+	ISC_out_tilestats_accum *accum = &its->accums[subX * its->channels];
+
+	for ( channel = 0; channel < its->channels; channel++ )
+	{
+		stats[channel].min = accum[channel].min;
+		stats[channel].max = accum[channel].max;
+		if ( pixels == 0 )
+		{
+			stats[channel].mean = 0;
+			stats[channel].variance = 0;
+			continue;
+		}
+
+		// variance = (n*sumSquares - sum^2) / n^2, which never goes
+		// negative the way sumSquares/n - mean^2 can after rounding.
+		sum = accum[channel].sum;
+		stats[channel].mean = ( sum << ISC_TILESTATS_FRACBITS ) / pixels;
+		stats[channel].variance = ( ( pixels * (uint64_t)accum[channel].sumSquares - sum * sum ) << ISC_TILESTATS_FRACBITS ) / ( (uint64_t)pixels * pixels );
+	}
+}
+
+/**
+ * \brief Exports the tile statistics as text to a file or serial port.
+ *
+ * Like ISC_out_histogram_export_text, this prints the current row of tiles.
+ * Means and variances are printed with two decimal places.
+ *
+ * \param its The ISC_out_tilestats state structure.
+ * \param fp The file pointer to write the data to.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_tilestats_export_text( ISC_out_tilestats *its, FILE *fp )
+{
+	uint8_t subX, channel;
+	ISC_out_tilestats_stat stats[its->channels];
+
+	fprintf( fp, "Y-SUBDIVISION %u:\n", its->Ysubdivisions - its->subsLeft );
+	for ( subX = 0; subX < its->Xsubdivisions; subX++ )
+	{
+		ISC_out_tilestats_getstats( its, subX, stats );
+		fprintf( fp, "\tX-SUBDIVISION %u:\n", subX );
+		for ( channel = 0; channel < its->channels; channel++ )
+			fprintf( fp, "\t\tC%u: mean %lu.%02lu var %lu.%02lu min %u max %u\n", channel,
+				(unsigned long)( stats[channel].mean >> ISC_TILESTATS_FRACBITS ),
+				(unsigned long)( ( stats[channel].mean & ( ( 1 << ISC_TILESTATS_FRACBITS ) - 1 ) ) * 100 >> ISC_TILESTATS_FRACBITS ),
+				(unsigned long)( stats[channel].variance >> ISC_TILESTATS_FRACBITS ),
+				(unsigned long)( ( stats[channel].variance & ( ( 1 << ISC_TILESTATS_FRACBITS ) - 1 ) ) * 100 >> ISC_TILESTATS_FRACBITS ),
+				stats[channel].min, stats[channel].max );
+	}
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * \param its The ISC_out_tilestats state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_tilestats_reset( ISC_out_tilestats *its )
+{
+	ClearAccums( its );
+	its->linesLeft = its->subLines;
+	its->subsLeft = its->Ysubdivisions;
+}
+
+/**
+ * \brief Cleans up and ends the ISC_out_tilestats module.
+ *
+ * \param its The ISC_out_tilestats state structure.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_tilestats_end( ISC_out_tilestats *its )
+{
+	free( its->accums );
+	free( its );
+}
+
+/**
+ * \brief Sends back whether the tile statistics module is still running.
+ *
+ * \param its The ISC_out_tilestats state structure.
+ * \return Whether or not the module is still running.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_tilestats_running( ISC_out_tilestats *its )
+{
+	return !( its->subsLeft == 1 && its->linesLeft == 0 );
+}
@@ -0,0 +1,96 @@
+/***************************************************************************//**
+ * \file ISC_out_tilestats.h
+ * \brief Out-Module for per-tile mean, variance, minimum and maximum.
+ *
+ * ISC_out_tilestats.h describes a module that splits the image into tiles
+ * like ISC_out_histogram does, but only keeps the sum, sum of squares,
+ * minimum and maximum of each channel in each tile.  That's all it takes to
+ * get the mean and variance, in 12 bytes per channel per tile where a
+ * histogram takes 4 per bin.
+ *
+ * It saves memory, not time.  Every pixel needs a square, a minimum and a
+ * maximum, so on the PC 16x16 tiles of a HIGH frame take about 1.4 times as
+ * long as a 4-bin ISC_out_histogram (see BenchTileStats in benchmark.c).  Use
+ * it when the mean and variance are what's wanted or the bins don't fit.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_TILESTATS_H_
+#define _ISC_OUT_TILESTATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+
+/**
+ * ISC_TILESTATS_FRACBITS is the number of fraction bits in the fixed-point
+ * mean and variance.  With 8, a mean of 100.5 comes back as 25728.
+ */
+#define ISC_TILESTATS_FRACBITS 8
+
+/**
+ * ISC_TILESTATS_MAXPIXELS is the most pixels a tile can have.  Past it, a
+ * tile of white pixels would overflow the 32-bit sum of squares.
+ */
+#define ISC_TILESTATS_MAXPIXELS 66051
+
+/**
+ * \brief The statistics of one channel of one tile.
+ *
+ * This is what the user gets back from ISC_out_tilestats_getstats.
+ */
+typedef struct
+{
+	uint16_t mean; //!< The mean, with ISC_TILESTATS_FRACBITS fraction bits.
+	uint32_t variance; //!< The variance, with ISC_TILESTATS_FRACBITS fraction bits.
+	uint8_t min; //!< The smallest value.
+	uint8_t max; //!< The largest value.
+} ISC_out_tilestats_stat;
+
+/**
+ * \brief The running totals for one channel of one tile.
+ *
+ * Users of ISC_out_tilestats will most likely never encounter or use this
+ * structure.  Tiles are kept to ISC_TILESTATS_MAXPIXELS pixels so the sum of
+ * squares fits in 32 bits, which keeps the ARM7 off 64-bit adds.
+ */
+typedef struct
+{
+	uint32_t sumSquares; //!< Sum of the squares of the values.
+	uint32_t sum; //!< Sum of the values.
+	uint8_t min; //!< The smallest value so far.
+	uint8_t max; //!< The largest value so far.
+} ISC_out_tilestats_accum;
+
+/**
+ * \brief Out-Module for tile statistics.
+ *
+ * ISC_out_tilestats works on one row of tiles at a time.  When linesLeft is 0,
+ * the row of tiles is done and its statistics can be read with
+ * ISC_out_tilestats_getstats, just like with ISC_out_histogram.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context.
+	uint8_t Xsubdivisions; //!< Number of X subdivisions.
+	uint8_t Ysubdivisions; //!< Number of Y subdivisions.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	ISC_out_tilestats_accum *accums; //!< Running totals, all channels of tile 0, then tile 1, etc.
+	uint8_t channels; //!< The number of channels in each pixel.
+	uint16_t subSize; //!< Width of one X subdivision in pixels.
+	uint16_t subLines; //!< Height of one Y subdivision in rows.
+	uint8_t subsLeft; //!< YSubdivisions left.
+	uint16_t linesLeft; //!< Lines left in the subdivision.
+} ISC_out_tilestats;
+
+ISC_out_tilestats *ISC_out_tilestats_start( ISC_util_imagecontext, uint8_t, uint8_t );
+void ISC_out_tilestats_feed( ISC_out_tilestats *, uint8_t * );
+void ISC_out_tilestats_getstats( ISC_out_tilestats *, uint8_t, ISC_out_tilestats_stat * );
+void ISC_out_tilestats_export_text( ISC_out_tilestats *, FILE * );
+void ISC_out_tilestats_reset( ISC_out_tilestats * );
+void ISC_out_tilestats_end( ISC_out_tilestats * );
+bool ISC_out_tilestats_running( ISC_out_tilestats * );
+
+#endif
@@ -0,0 +1,276 @@
+/***************************************************************************//**
+ * \file ISC_out_y4m.c
+ * \brief Out-Module for YUV4MPEG2 (Y4M) video streams.
+ *
+ * ISC_out_y4m.c contains the functions for writing the Y4M headers, turning
+ * RGB rows into Y rows and 4:2:0 chroma planes, and writing the frames.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ISC_out_y4m.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+// Write to the sink, remembering if it refused.
+__attribute__((gnu_inline)) inline static void Write( ISC_out_y4m *iy4, const uint8_t *data, uint32_t length )
+{
+	if ( !ISC_util_sink_write( &iy4->sink, data, length ) )
+		iy4->writeFailed = true;
+}
+
+// Keep a chroma value in a byte.  Pure blue or red would come out at 256.
+__attribute__((gnu_inline)) inline static uint8_t ClampChroma( int32_t value )
+{
+	return value > 255 ? 255 : value;
+}
+
+// Start the frame, and the stream if this is the first frame.
+__attribute__((gnu_inline)) inline static void StartFrame( ISC_out_y4m *iy4 )
+{
+	char header[80];
+
+	if ( !iy4->headerWritten )
+	{
+		sprintf( header, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 %s XCOLORRANGE=FULL\n",
+			iy4->theContext.frame.width, iy4->theContext.frame.height, iy4->framesPerSecond,
+			iy4->chroma == ISC_OUT_Y4M_MONO ? "Cmono" : "C420jpeg" );
+		Write( iy4, (const uint8_t *)header, strlen( header ) );
+		iy4->headerWritten = true;
+	}
+
+	Write( iy4, (const uint8_t *)"FRAME\n", 6 );
+	iy4->frameStarted = true;
+}
+
+// Add an RGB row to the chroma planes.  Each chroma sample is the average of
+// a 2x2 block; the last column or row is used twice when the width or height
+// is odd.
+__attribute__((gnu_inline)) inline static void AddChroma( ISC_out_y4m *iy4, const uint8_t *row, uint16_t y )
+{
+	uint16_t i, left, right, *sums = iy4->pairSums;
+	uint16_t lastColumn = iy4->theContext.frame.width - 1;
+	uint8_t *u = iy4->chromaPlanes + ( y / 2 ) * iy4->chromaWidth;
+	uint8_t *v = u + iy4->chromaWidth * iy4->chromaHeight;
+	int32_t r, g, b;
+
+	for ( i = 0; i < iy4->chromaWidth; i++, sums += 3 )
+	{
+		left = 6 * i;
+		right = 2 * i + 1 > lastColumn ? left : left + 3;
+
+		r = row[left] + row[right];
+		g = row[left+1] + row[right+1];
+		b = row[left+2] + row[right+2];
+
+		// Even rows wait for the row below them, unless there isn't one.
+		if ( !( y & 1 ) && y + 1 < iy4->theContext.frame.height )
+		{
+			sums[0] = r;
+			sums[1] = g;
+			sums[2] = b;
+			continue;
+		}
+		if ( y & 1 )
+		{
+			r += sums[0];
+			g += sums[1];
+			b += sums[2];
+		}
+		else
+		{
+			r *= 2;
+			g *= 2;
+			b *= 2;
+		}
+
+		// The sums are of four pixels, so the coefficients are in 1/1024ths.
+		u[i] = ClampChroma( ( -43 * r - 85 * g + 128 * b + 131584 ) >> 10 );
+		v[i] = ClampChroma( ( 128 * r - 107 * g - 21 * b + 131584 ) >> 10 );
+	}
+}
+
+// Write one row of the current frame.
+__attribute__((gnu_inline)) inline static void WriteRow( ISC_out_y4m *iy4, const uint8_t *row )
+{
+	uint16_t x, width = iy4->theContext.frame.width;
+	uint16_t y = iy4->theContext.frame.height - iy4->rowsLeft;
+	const uint8_t *pixel;
+
+	if ( !iy4->frameStarted )
+		StartFrame( iy4 );
+
+	if ( !iy4->lumaRow )
+		Write( iy4, row, width );
+	else
+	{
+		for ( x = 0, pixel = row; x < width; x++, pixel += 3 )
+			iy4->lumaRow[x] = ( 77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2] + 128 ) >> 8;
+		Write( iy4, iy4->lumaRow, width );
+	}
+
+	if ( iy4->chromaPlanes )
+		AddChroma( iy4, row, y );
+
+	iy4->rowsLeft--;
+	if ( iy4->rowsLeft == 0 )
+	{
+		if ( iy4->chromaPlanes )
+			Write( iy4, iy4->chromaPlanes, 2 * iy4->chromaWidth * iy4->chromaHeight );
+		iy4->finished = true;
+	}
+}
+
+// Fill out a frame that was cut off with black rows.
+__attribute__((gnu_inline)) inline static void PadFrame( ISC_out_y4m *iy4 )
+{
+	uint8_t *black;
+
+	if ( !iy4->frameStarted || iy4->rowsLeft == 0 )
+		return;
+
+	// MEMORY IS ALLOCATED HERE.
+	black = calloc( iy4->theContext.frame.width, iy4->theContext.frame.channels );
+	if ( !black )
+		ISC_util_assert_message( "FATAL: Not enough memory to finish an ISC_out_y4m frame!" );
+	while ( iy4->rowsLeft > 0 )
+		WriteRow( iy4, black );
+	free( black );
+}
+
+/**
+ * \brief Start ISC_out_y4m module.
+ *
+ * ISC_out_y4m_start sets up the module.  Nothing is written until the first
+ * row comes in.
+ *
+ * \param context The Image Context of the frames.  RGB, or one channel.
+ * \param sink Where the stream goes.  ISC_util_sink_fromfile( stdout ) pipes it to another program.
+ * \param chroma ISC_OUT_Y4M_420 or ISC_OUT_Y4M_MONO.  One-channel images have to be ISC_OUT_Y4M_MONO.
+ * \param framesPerSecond The frame rate to put in the stream header.
+ * \return The State Structure for a ISC_out_y4m module.
+ */
+__attribute__((gnu_inline)) inline ISC_out_y4m *ISC_out_y4m_start( ISC_util_imagecontext context, ISC_util_sink sink, ISC_out_y4m_chroma chroma, uint8_t framesPerSecond )
+{
+	ISC_out_y4m *iy4;
+
+	if ( context.frame.channels == 3 && context.colorspace != CC3_COLORSPACE_RGB )
+		ISC_util_assert_message( "FATAL: ISC_out_y4m only converts RGB images!" );
+	if ( context.frame.channels != 3 && ( context.frame.channels != 1 || chroma != ISC_OUT_Y4M_MONO ) )
+		ISC_util_assert_message( "FATAL: ISC_out_y4m needs RGB, or one channel written as ISC_OUT_Y4M_MONO!" );
+	if ( framesPerSecond == 0 )
+		ISC_util_assert_message( "FATAL: Y4M needs at least 1 frame per second!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	iy4 = malloc( sizeof( ISC_out_y4m ) );
+	if ( !iy4 )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_out_y4m!" );
+
+	iy4->theContext = context;
+	iy4->sink = sink;
+	iy4->chroma = chroma;
+	iy4->framesPerSecond = framesPerSecond;
+	iy4->lumaRow = NULL;
+	iy4->pairSums = NULL;
+	iy4->chromaPlanes = NULL;
+	iy4->chromaWidth = ( context.frame.width + 1 ) / 2;
+	iy4->chromaHeight = ( context.frame.height + 1 ) / 2;
+	iy4->rowsLeft = context.frame.height;
+	iy4->headerWritten = false;
+	iy4->frameStarted = false;
+	iy4->writeFailed = false;
+	iy4->finished = false;
+
+	if ( context.frame.channels == 3 )
+	{
+		// MEMORY IS ALLOCATED HERE.
+		iy4->lumaRow = malloc( context.frame.width );
+		if ( !iy4->lumaRow )
+			ISC_util_assert_message( "FATAL: Not enough memory for the ISC_out_y4m luma row!" );
+	}
+
+	if ( chroma == ISC_OUT_Y4M_420 )
+	{
+		// MEMORY IS ALLOCATED HERE.
+		iy4->pairSums = malloc( 3 * iy4->chromaWidth * sizeof( uint16_t ) );
+		iy4->chromaPlanes = malloc( 2 * iy4->chromaWidth * iy4->chromaHeight );
+		if ( !iy4->pairSums || !iy4->chromaPlanes )
+			ISC_util_assert_message( "FATAL: Not enough memory for the ISC_out_y4m chroma planes!" );
+	}
+
+	return iy4;
+}
+
+/**
+ * \brief ISC_out_y4m feed function.
+ *
+ * ISC_out_y4m_feed writes the row's Y and frees the row.  After the last row
+ * of a 4:2:0 frame, the chroma planes are written too.
+ *
+ * \param iy4 The State Structure of the module.
+ * \param row The incoming row to be fed.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_y4m_feed( ISC_out_y4m *iy4, uint8_t *row )
+{
+	if ( !row )
+		return;
+
+	if ( iy4->rowsLeft > 0 )
+		WriteRow( iy4, row );
+
+	FreeRow( row );
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * \param iy4 The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_out_y4m_reset( ISC_out_y4m *iy4 )
+{
+	PadFrame( iy4 );
+
+	iy4->rowsLeft = iy4->theContext.frame.height;
+	iy4->frameStarted = false;
+	iy4->finished = false;
+}
+
+/**
+ * \brief Free ISC_out_y4m module.
+ *
+ * ISC_out_y4m_end fills out a cut-off frame and frees the module.  Whatever
+ * the sink writes to is left open.
+ *
+ * \param iy4 The State Structure of the module.
+ * \return TRUE if the sink took every write.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_y4m_end( ISC_out_y4m *iy4 )
+{
+	bool ok;
+
+	PadFrame( iy4 );
+
+	ok = !iy4->writeFailed;
+	free( iy4->lumaRow );
+	free( iy4->pairSums );
+	free( iy4->chromaPlanes );
+	free( iy4 );
+	return ok;
+}
+
+/**
+ * \brief Tells whether the module is done with the frame.
+ *
+ * \param iy4 The State Structure of the module.
+ * \return TRUE if the module wants more rows, FALSE if the frame is finished.
+ */
+__attribute__((gnu_inline)) inline bool ISC_out_y4m_running( ISC_out_y4m *iy4 )
+{
+	return !iy4->finished;
+}
@@ -0,0 +1,77 @@
+/***************************************************************************//**
+ * \file ISC_out_y4m.h
+ * \brief Out-Module for YUV4MPEG2 (Y4M) video streams.
+ *
+ * ISC_out_y4m.h describes a module that writes frames as one Y4M stream, the
+ * uncompressed format that ffmpeg, x264, mpv and most other video tools read
+ * from a pipe.  Frames go out as they are fed, so on the PC the output of a
+ * virtual-cam pipeline can be piped straight into an encoder or a viewer.
+*******************************************************************************/
+
+#ifndef _ISC_OUT_Y4M_H_
+#define _ISC_OUT_Y4M_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_sink.h"
+
+/**
+ * \brief What the frames are written as.
+ */
+typedef enum
+{
+	ISC_OUT_Y4M_420, //!< Full color, 4:2:0 ("C420jpeg"): one chroma sample for each 2x2 block of pixels.
+	ISC_OUT_Y4M_MONO //!< Luma only ("Cmono").  Nothing is held back, and one-channel images have to use it.
+} ISC_out_y4m_chroma;
+
+/**
+ * \brief Out-Module for Y4M output.
+ *
+ * ISC_out_y4m takes RGB rows, or one-channel rows which are written as they
+ * are.  Colors are converted with the full-range BT.601 (JPEG) equations and
+ * the stream says so with XCOLORRANGE=FULL, so gray levels are the same as
+ * in the module's one-channel output and in ISC_out_jpeg's.
+ *
+ * Y4M frames are planar: all of Y, then all of U, then all of V.  So each Y
+ * row goes out as soon as it is fed, but with ISC_OUT_Y4M_420 the two chroma
+ * planes can only go out after the frame's last row, and they are held until
+ * then.  At a quarter of the image size each, that is width * height / 2
+ * bytes (12.7 KB at low resolution, 50.7 KB at high), which is fine on the PC
+ * but too much for the CMUcam3 at high resolution; use ISC_OUT_Y4M_MONO
+ * there.
+ *
+ * Feed a frame's rows, and when the module stops running, call
+ * ISC_out_y4m_reset to go on to the next frame.  A frame that is cut off by a
+ * reset or by ending the module is filled out with black rows, since a Y4M
+ * frame can't be short.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context of the frames.
+	ISC_util_sink sink; //!< Where the stream goes.
+	ISC_out_y4m_chroma chroma; //!< What the frames are written as.
+	uint8_t framesPerSecond; //!< The frame rate written in the stream header.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	uint8_t *lumaRow; //!< The Y of the row being written.  NULL for one-channel input.
+	uint16_t *pairSums; //!< R, G and B summed over each pair of pixels of the last even row.
+	uint8_t *chromaPlanes; //!< The U plane, then the V plane, of the current frame.
+	uint16_t chromaWidth; //!< The width of the chroma planes.
+	uint16_t chromaHeight; //!< The height of the chroma planes.
+	uint16_t rowsLeft; //!< The number of rows left in the current frame.
+	bool headerWritten; //!< Has the stream header been written?
+	bool frameStarted; //!< Has the FRAME marker of the current frame been written?
+	bool writeFailed; //!< Did the sink refuse any write?
+	//-------------------------ISC_PIPELINE REQUIRED----------------------------
+	bool finished; //!< Is the current frame finished?
+} ISC_out_y4m;
+
+ISC_out_y4m *ISC_out_y4m_start( ISC_util_imagecontext, ISC_util_sink, ISC_out_y4m_chroma, uint8_t );
+void ISC_out_y4m_feed( ISC_out_y4m *, uint8_t * );
+void ISC_out_y4m_reset( ISC_out_y4m * );
+bool ISC_out_y4m_end( ISC_out_y4m * );
+bool ISC_out_y4m_running( ISC_out_y4m * );
+
+#endif
@@ -121,7 +121,7 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_clamp_colorspace_process
 	ipcc->remainingClampCount--;
 	
 	// The row has been clamped, so its usefulness is now zero.
-	free( tempRow );
+	FreeRow( tempRow );
 
 	return newRow;
 }
@@ -238,7 +238,7 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_convolution_process( ISC
 	}
 
 	free(rows);
-	free(ISC_util_rowqueue_process( conv->rqueue ));
+	FreeRow(ISC_util_rowqueue_process( conv->rqueue ));
 
 	conv->remainingConvolveCount--;
 	return tempRow;
@@ -247,6 +247,30 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_convolution_process( ISC
 	return NULL;
 }
 
+/**
+ *  \brief Gets the ISC_process_convolution module ready for the next frame.
+ *
+ *  Throws away any rows still in the queue and puts back the zero rows the
+ *  module starts with, so one module can convolve frame after frame.
+ *
+ *  \param conv A pointer to the state structure of the module to reset.
+ *
+ *  \return Nothing.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_convolution_reset( ISC_process_convolution *conv )
+{
+    uint16_t y;
+
+    while ( conv->rqueue->currentSize > 0 )
+	FreeRow(ISC_util_rowqueue_process(conv->rqueue));
+
+    for ( y = 0; y < conv->kernel.centerY-1; y++ )
+	ISC_util_rowqueue_feed( conv->rqueue, MallocZeroRow( &conv->theContext ) );
+
+    conv->remainingConvolveCount = conv->height;
+    conv->remainingLoadCount = conv->height;
+}
+
 /**
  *  \brief Ends the ISC_process_convolution module.
  *
@@ -260,15 +284,13 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_convolution_process( ISC
  */
 __attribute__((gnu_inline)) inline void ISC_process_convolution_end( ISC_process_convolution *conv )
 {
-    uint8_t y;
-    
     // First order of business: Check to see if we're actually done.
     if ( conv->remainingConvolveCount > 0 )
         ISC_util_assert_message( "FATAL: cleanup before convolution done!" );
     
     // Do away with all remaining rows in the queue.
-    for ( y = 0; y < conv->rqueue->currentSize; y++ )
-	free(ISC_util_rowqueue_process(conv->rqueue));
+    while ( conv->rqueue->currentSize > 0 )
+	FreeRow(ISC_util_rowqueue_process(conv->rqueue));
 
     // End the rowqueue.
     ISC_util_rowqueue_end(conv->rqueue);
@@ -294,3 +316,14 @@ __attribute__((gnu_inline)) inline ISC_util_imagecontext ISC_process_convolution
     return out;
 }
 
+/**
+ * \brief Returns whether the module has rows left to put out.
+ *
+ * \param conv The state structure.
+ *
+ * \return TRUE if running, FALSE once every row of the frame is convolved.
+ */
+__attribute__((gnu_inline)) inline bool ISC_process_convolution_running( ISC_process_convolution *conv )
+{
+    return conv->remainingConvolveCount > 0;
+}
@@ -6,6 +6,7 @@
 #ifndef _ISC_PROCESS_CONVOLUTION_H_
 #define _ISC_PROCESS_CONVOLUTION_H_
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 
@@ -66,9 +67,10 @@ typedef struct
 ISC_process_convolution *ISC_process_convolution_start( ISC_util_imagecontext, ISC_process_convolution_kernel );
 void ISC_process_convolution_feed( ISC_process_convolution *conv, uint8_t * );
 uint8_t *ISC_process_convolution_process( ISC_process_convolution *conv );
+void ISC_process_convolution_reset( ISC_process_convolution *conv );
 void ISC_process_convolution_end( ISC_process_convolution *conv );
 
-//bool ISC_process_convolution_running( ISC_process_convolution *conv );
+bool ISC_process_convolution_running( ISC_process_convolution *conv );
 ISC_util_imagecontext ISC_process_convolution_context( ISC_process_convolution *conv );
 
 #endif
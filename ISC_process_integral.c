@@ -0,0 +1,256 @@
+/***************************************************************************//**
+ * \file ISC_process_integral.c
+ * \brief Summed-area (integral image) module.
+ *
+ * ISC_process_integral.c contains the functions for building integral image
+ * rows as image rows stream in, keeping a ring of the newest ones, and
+ * answering box sum queries from them.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ISC_process_integral.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+
+// Find integral row r in the ring, making sure it's still there.
+__attribute__((gnu_inline)) inline static uint32_t *IntegralRow( ISC_process_integral *ipi, uint16_t r )
+{
+	if ( r > ipi->rowsDone || r + ipi->bandRows <= ipi->rowsDone )
+		ISC_util_assert_message( "FATAL: Integral row is outside the kept band!" );
+
+	return ipi->ring + ( r % ipi->bandRows ) * ipi->rowLength;
+}
+
+/**
+ * \brief Start ISC_process_integral module.
+ *
+ * ISC_process_integral_start starts the integral image module.  Each kept
+ * row takes 4*(width+1)*channels bytes, so keep the band as small as the
+ * consumer allows: ISC_PROCESS_INTEGRAL_BAND(h) rows are enough for boxes up
+ * to h rows tall.  A band as tall as the frame plus one keeps everything.
+ *
+ * \param context The image context.
+ * \param bandRows The number of integral rows to keep.  At least 2.
+ * \return The State Structure for a ISC_process_integral module.
+ */
+__attribute__((gnu_inline)) inline ISC_process_integral *ISC_process_integral_start( ISC_util_imagecontext context, uint16_t bandRows )
+{
+	ISC_process_integral *ipi;
+
+	if ( bandRows < 2 )
+		ISC_util_assert_message( "FATAL: An integral band needs at least 2 rows!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	ipi = malloc( sizeof( ISC_process_integral ) );
+	if ( !ipi )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_process_integral!" );
+
+	ipi->theContext = context;
+	ipi->bandRows = bandRows;
+	ipi->rowLength = ( context.frame.width + 1 ) * context.frame.channels;
+
+	// MEMORY IS ALLOCATED HERE.
+	ipi->ring = malloc( sizeof(uint32_t) * ipi->rowLength * bandRows );
+	if ( !ipi->ring )
+		ISC_util_assert_message( "FATAL: Not enough memory for the integral band!" );
+
+	// Integral row 0 is above the image, so it's all zeroes.
+	memset( ipi->ring, 0, sizeof(uint32_t) * ipi->rowLength );
+	ipi->rowsDone = 0;
+	ipi->fresh = false;
+	ipi->finished = false;
+
+	return ipi;
+}
+
+/**
+ * \brief ISC_process_integral feed function.
+ *
+ * ISC_process_integral_feed adds the next image row to the integral image.
+ * The new integral row is the one above it plus the running sum along the
+ * row, so each pixel costs two adds per channel.  The image row is freed.
+ *
+ * \param ipi The State Structure of the module.
+ * \param row The incoming row to be fed.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_integral_feed( ISC_process_integral *ipi, uint8_t *row )
+{
+	uint32_t *above, *below;
+	uint32_t sum, sumR, sumG, sumB;
+	uint16_t x, width = ipi->theContext.frame.width;
+	uint8_t channel, channels = ipi->theContext.frame.channels;
+	uint8_t *pixel;
+
+	if ( !row )
+		return;
+
+	above = IntegralRow( ipi, ipi->rowsDone );
+	below = ipi->ring + ( ( ipi->rowsDone + 1 ) % ipi->bandRows ) * ipi->rowLength;
+
+	// The first column of every integral row is zero.
+	for ( channel = 0; channel < channels; channel++ )
+		below[channel] = 0;
+	above += channels;
+	below += channels;
+
+	if ( channels == 1 )
+	{
+		sum = 0;
+		for ( x = 0; x < width; x++ )
+		{
+			sum += row[x];
+			below[x] = above[x] + sum;
+		}
+	}
+	else if ( channels == 3 )
+	{
+		sumR = 0; sumG = 0; sumB = 0;
+		pixel = row;
+		for ( x = 0; x < width; x++ )
+		{
+			sumR += pixel[0];
+			sumG += pixel[1];
+			sumB += pixel[2];
+			below[0] = above[0] + sumR;
+			below[1] = above[1] + sumG;
+			below[2] = above[2] + sumB;
+			pixel += 3;
+			above += 3;
+			below += 3;
+		}
+	}
+	else
+	{
+		// Any other number of channels goes one channel at a time.
+		for ( channel = 0; channel < channels; channel++ )
+		{
+			sum = 0;
+			for ( x = 0; x < width; x++ )
+			{
+				sum += row[x*channels + channel];
+				below[x*channels + channel] = above[x*channels + channel] + sum;
+			}
+		}
+	}
+
+	ipi->rowsDone++;
+	ipi->fresh = true;
+	if ( ipi->rowsDone == ipi->theContext.frame.height )
+		ipi->finished = true;
+
+	FreeRow( row );
+}
+
+/**
+ * \brief ISC_process_integral process function.
+ *
+ * ISC_process_integral_process sends back the integral row that was made by
+ * the last feed, which is integral row rowsDone.  The row belongs to the
+ * module: don't free it, and don't use it after the band has moved past it.
+ *
+ * \param ipi The State Structure of the module.
+ * \return The newest integral row, or NULL if there isn't a new one.
+ */
+__attribute__((gnu_inline)) inline const uint32_t *ISC_process_integral_process( ISC_process_integral *ipi )
+{
+	if ( !ipi->fresh )
+		return NULL;
+
+	ipi->fresh = false;
+	return IntegralRow( ipi, ipi->rowsDone );
+}
+
+/**
+ * \brief Gets any integral row still in the band.
+ *
+ * \param ipi The State Structure of the module.
+ * \param r The integral row number.  It holds the sums of image rows 0 to r-1.
+ * \return The integral row.  It belongs to the module.
+ */
+__attribute__((gnu_inline)) inline const uint32_t *ISC_process_integral_getrow( ISC_process_integral *ipi, uint16_t r )
+{
+	return IntegralRow( ipi, r );
+}
+
+/**
+ * \brief Sums the pixels of one channel in a box.
+ *
+ * This takes four lookups however big the box is.  The box is given in image
+ * coordinates, inclusive on all sides, and has to be inside the band: y0 can't
+ * be more than bandRows-1 rows above the newest image row.
+ *
+ * \param ipi The State Structure of the module.
+ * \param x0 The left column of the box.
+ * \param y0 The top row of the box.
+ * \param x1 The right column of the box.
+ * \param y1 The bottom row of the box.  It has to have been fed already.
+ * \param channel The channel to add up.
+ * \return The sum of the channel over the box.
+ */
+__attribute__((gnu_inline)) inline uint32_t ISC_process_integral_boxsum( ISC_process_integral *ipi, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t channel )
+{
+	uint8_t channels = ipi->theContext.frame.channels;
+	const uint32_t *top = IntegralRow( ipi, y0 );
+	const uint32_t *bottom = IntegralRow( ipi, y1 + 1 );
+	uint16_t left = x0 * channels + channel;
+	uint16_t right = ( x1 + 1 ) * channels + channel;
+
+	return bottom[right] - bottom[left] - top[right] + top[left];
+}
+
+/**
+ * \brief ISC_process_integral context function.
+ *
+ * The integral rows line up with the image, so the Image Context doesn't
+ * change, but keep in mind the rows are 32-bit sums with a leading column of
+ * zeroes rather than pixels.
+ *
+ * \param ipi The State Structure of the module.
+ * \return The output Image Context of the module.
+ */
+__attribute__((gnu_inline)) inline ISC_util_imagecontext ISC_process_integral_context( ISC_process_integral *ipi )
+{
+	return ipi->theContext;
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * The band is kept, so only integral row 0 has to be cleared again.
+ *
+ * \param ipi The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_integral_reset( ISC_process_integral *ipi )
+{
+	memset( ipi->ring, 0, sizeof(uint32_t) * ipi->rowLength );
+	ipi->rowsDone = 0;
+	ipi->fresh = false;
+	ipi->finished = false;
+}
+
+/**
+ * \brief ISC_process_integral end function.
+ *
+ * \param ipi The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_integral_end( ISC_process_integral *ipi )
+{
+	free( ipi->ring );
+	free( ipi );
+}
+
+/**
+ * \brief ISC_process_integral running function.
+ *
+ * \param ipi The State Structure of the module.
+ * \return TRUE if running, FALSE if every row of the frame has been fed.
+ */
+__attribute__((gnu_inline)) inline bool ISC_process_integral_running( ISC_process_integral *ipi )
+{
+	return !ipi->finished;
+}
@@ -0,0 +1,63 @@
+/***************************************************************************//**
+ * \file ISC_process_integral.h
+ * \brief Summed-area (integral image) module.
+ *
+ * ISC_process_integral.h describes a module that turns rows of pixels into
+ * rows of an integral image, where each entry is the sum of every pixel above
+ * and to the left of it.  The CMUcam3 can't hold a whole integral image, so
+ * only a band of the newest rows is kept, but that is enough to get the sum
+ * of any box inside the band with four lookups.
+*******************************************************************************/
+
+#ifndef _ISC_PROCESS_INTEGRAL_H_
+#define _ISC_PROCESS_INTEGRAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ISC_util_imagecontext.h"
+
+/**
+ * ISC_PROCESS_INTEGRAL_BAND gives the number of integral rows to keep for
+ * boxes up to windowHeight rows tall.  A box needs the integral row above its
+ * top as well as its bottom row, so it's one more than the height.
+ */
+#define ISC_PROCESS_INTEGRAL_BAND(windowHeight) ((windowHeight) + 1)
+
+/**
+ * \brief Process-Module for integral images.
+ *
+ * Integral row r holds, for every column c and channel, the sum of the pixels
+ * in rows 0 to r-1 and columns 0 to c-1.  So every integral row starts with a
+ * column of zeroes and has width+1 entries per channel, channels interleaved
+ * like the pixels, and integral row 0 is all zeroes.  After n image rows have
+ * been fed, integral rows n-bandRows+1 to n are kept.  The counters are 32-bit
+ * and a whole HIGH frame adds up to less than 2^25 per channel, so they never
+ * overflow.
+ */
+typedef struct
+{
+	//---------------------------USER-DEFINED-------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context.
+	uint16_t bandRows; //!< The number of integral rows kept.
+	//---------------------------SYSTEM-HANDLED-----------------------------
+	uint32_t *ring; //!< The kept integral rows.  Integral row r is in slot r % bandRows.
+	uint16_t rowLength; //!< Entries in one integral row, (width+1)*channels.
+	uint16_t rowsDone; //!< The number of image rows integrated so far.
+	bool fresh; //!< Is there a new integral row process hasn't sent yet?
+	//----------------------ISC_PIPELINE REQUIREMENT------------------------
+	bool finished; //!< Is the module finished?
+} ISC_process_integral;
+
+ISC_process_integral *ISC_process_integral_start( ISC_util_imagecontext, uint16_t );
+void ISC_process_integral_feed( ISC_process_integral *, uint8_t * );
+const uint32_t *ISC_process_integral_process( ISC_process_integral * );
+const uint32_t *ISC_process_integral_getrow( ISC_process_integral *, uint16_t );
+uint32_t ISC_process_integral_boxsum( ISC_process_integral *, uint16_t, uint16_t, uint16_t, uint16_t, uint8_t );
+ISC_util_imagecontext ISC_process_integral_context( ISC_process_integral * );
+void ISC_process_integral_reset( ISC_process_integral * );
+void ISC_process_integral_end( ISC_process_integral * );
+bool ISC_process_integral_running( ISC_process_integral * );
+
+#endif
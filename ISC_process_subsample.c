@@ -26,7 +26,7 @@
  *
  * \param context The image context.
  * \param skipFactorX The factor to downscale the image in the horizontal axis.
- * \param skipFactorY The factor to downscale the image in the vertical axis.
+ * \param skipFactorY The factor to downscale the image in the vertical axis.  Rows past the last whole group of skipFactorY rows are left out.
  * \param subType The type of subsampling to perform.
  * \return The State Structure for a ISC_process_subsample module.
  */
@@ -47,8 +47,6 @@ __attribute__((gnu_inline)) inline ISC_process_subsample *ISC_process_subsample_
 	// A few sanity checks:
 	if ( ips->theContext.frame.width % ips->skipFactorX != 0 )
 		ISC_util_assert_message( "Subsample skipX factors must be a factor of the width!" );
-	if ( ips->theContext.frame.height % ips->skipFactorY != 0 )
-		ISC_util_assert_message( "Subsample skipY factors must be a factor of the height!" );
 
 	// Set the System-Handleds and the ISC_pipeline requirements.	
 	ips->skipShiftFactorX = PowerOfTwoDetect( ips->skipFactorX );
@@ -56,6 +54,7 @@ __attribute__((gnu_inline)) inline ISC_process_subsample *ISC_process_subsample_
 	ips->endWidth = ips->theContext.frame.width / ips->skipFactorX;
 	ips->endHeight = ips->theContext.frame.height / ips->skipFactorY;
 	ips->linesLeft = ips->theContext.frame.height;
+	ips->finished = ips->linesLeft < ips->skipFactorY;
 
 	// Set up the rowqueue.
 	ips->rq = ISC_util_rowqueue_start( ips->skipFactorY );
@@ -100,7 +99,7 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_subsample_process( ISC_p
 
 	if ( ips->rq->currentSize == ips->skipFactorY )
 	{
-		finishedRow = malloc( sizeof(uint8_t)*3*ips->endWidth );
+		finishedRow = MallocRowBytes( sizeof(uint8_t)*3*ips->endWidth );
 
 		// MEMORY IS ALLOCATED HERE.
 		rowArray = malloc( sizeof(uint8_t*) * ips->skipFactorY );
@@ -183,9 +182,16 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_subsample_process( ISC_p
 		// of them.
 		for ( countX = 0; countX < ips->skipFactorY; countX++ )
 		{
-			free(ISC_util_rowqueue_process( ips->rq ));
+			FreeRow(ISC_util_rowqueue_process( ips->rq ));
 		}
 
+		// Once there isn't a whole group of rows left, the frame is done;
+		// rows past the last group (143-row frames subsampled by 2, say)
+		// don't make an output row.
+		ips->linesLeft -= ips->skipFactorY;
+		if ( ips->linesLeft < ips->skipFactorY )
+			ips->finished = true;
+
 		// This memory is going to be handled by the next module
 		// in the pipeline.  We don't have to worry about it.
 		return finishedRow;
@@ -216,6 +222,22 @@ __attribute__((gnu_inline)) inline ISC_util_imagecontext ISC_process_subsample_c
 	return out;
 }
 
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * Rows left over from a frame that was cut off are thrown away.
+ *
+ * \param ips The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_subsample_reset( ISC_process_subsample *ips )
+{
+	while ( ips->rq->currentSize > 0 )
+		FreeRow(ISC_util_rowqueue_process( ips->rq ));
+
+	ips->linesLeft = ips->theContext.frame.height;
+	ips->finished = ips->linesLeft < ips->skipFactorY;
+}
+
 /**
  * \brief ISC_process_subsample end function.
  *
@@ -47,6 +47,7 @@ ISC_process_subsample *ISC_process_subsample_start( ISC_util_imagecontext, uint8
 void ISC_process_subsample_feed( ISC_process_subsample *, uint8_t * );
 uint8_t *ISC_process_subsample_process( ISC_process_subsample * );
 ISC_util_imagecontext ISC_process_subsample_context( ISC_process_subsample * );
+void ISC_process_subsample_reset( ISC_process_subsample * );
 void ISC_process_subsample_end( ISC_process_subsample * );
 bool ISC_process_subsample_running( ISC_process_subsample * );
 
@@ -0,0 +1,164 @@
+/***************************************************************************//**
+ * \file ISC_process_tee.c
+ * \brief Module for feeding one row stream to several modules.
+ *
+ * ISC_process_tee.c contains the functions for sharing each incoming row
+ * among the branches and handing it out to each of them once.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ISC_process_tee.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+
+// Let go of the current row for every branch that never took it.
+__attribute__((gnu_inline)) inline static void DropWaiting( ISC_process_tee *ipt )
+{
+	while ( ipt->waiting )
+	{
+		FreeRow( ipt->row );
+		// Clear the lowest waiting branch.
+		ipt->waiting &= ipt->waiting - 1;
+	}
+	ipt->row = NULL;
+}
+
+/**
+ * \brief Start ISC_process_tee module.
+ *
+ * ISC_process_tee_start starts a tee with the given number of branches.
+ *
+ * \param context The Image Context of the rows.  It is the same on every branch.
+ * \param branches How many branches to feed, from 1 to ISC_PROCESS_TEE_MAXBRANCHES.
+ * \return The State Structure for a ISC_process_tee module.
+ */
+__attribute__((gnu_inline)) inline ISC_process_tee *ISC_process_tee_start( ISC_util_imagecontext context, uint8_t branches )
+{
+	ISC_process_tee *ipt;
+
+	if ( branches < 1 || branches > ISC_PROCESS_TEE_MAXBRANCHES )
+		ISC_util_assert_message( "FATAL: An ISC_process_tee needs 1 to ISC_PROCESS_TEE_MAXBRANCHES branches!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	ipt = malloc( sizeof( ISC_process_tee ) );
+	if ( !ipt )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_process_tee!" );
+
+	ipt->theContext = context;
+	ipt->branches = branches;
+	ipt->row = NULL;
+	ipt->waiting = 0;
+	ipt->rowsLeft = context.frame.height;
+	ipt->finished = false;
+
+	return ipt;
+}
+
+/**
+ * \brief ISC_process_tee feed function.
+ *
+ * ISC_process_tee_feed takes a row and shares it among the branches.  The
+ * row is not copied.
+ *
+ * \param ipt The State Structure of the module.
+ * \param row The incoming row to be fed.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_tee_feed( ISC_process_tee *ipt, uint8_t *row )
+{
+	if ( !row )
+		return;
+
+	if ( ipt->rowsLeft == 0 )
+	{
+		FreeRow( row );
+		return;
+	}
+
+	DropWaiting( ipt );
+
+	ipt->row = ShareRow( row, ipt->branches - 1 );
+	ipt->waiting = ( 1 << ipt->branches ) - 1;
+	ipt->rowsLeft--;
+	if ( ipt->rowsLeft == 0 )
+		ipt->finished = true;
+}
+
+/**
+ * \brief ISC_process_tee process function.
+ *
+ * ISC_process_tee_process gives a branch the current row, if it hasn't had
+ * it yet.  Call it for every branch after each feed; the row each call
+ * returns is the branch's to free.
+ *
+ * \param ipt The State Structure of the module.
+ * \param branch Which branch wants the row, from 0 to branches-1.
+ * \return The row, or NULL if the branch already has it.
+ */
+__attribute__((gnu_inline)) inline uint8_t *ISC_process_tee_process( ISC_process_tee *ipt, uint8_t branch )
+{
+	uint8_t bit = 1 << branch;
+
+	if ( branch >= ipt->branches )
+		ISC_util_assert_message( "FATAL: That ISC_process_tee branch doesn't exist!" );
+
+	if ( !( ipt->waiting & bit ) )
+		return NULL;
+
+	ipt->waiting &= ~bit;
+	return ipt->row;
+}
+
+/**
+ * \brief ISC_process_tee context function.
+ *
+ * \param ipt The State Structure of the module.
+ * \return The Image Context of every branch.
+ */
+__attribute__((gnu_inline)) inline ISC_util_imagecontext ISC_process_tee_context( ISC_process_tee *ipt )
+{
+	return ipt->theContext;
+}
+
+/**
+ * \brief Gets the module ready for the next frame.
+ *
+ * Branches that didn't take the last row of the frame never get it.
+ *
+ * \param ipt The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_tee_reset( ISC_process_tee *ipt )
+{
+	DropWaiting( ipt );
+
+	ipt->rowsLeft = ipt->theContext.frame.height;
+	ipt->finished = false;
+}
+
+/**
+ * \brief Free ISC_process_tee module.
+ *
+ * \param ipt The State Structure of the module.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_tee_end( ISC_process_tee *ipt )
+{
+	DropWaiting( ipt );
+	free( ipt );
+}
+
+/**
+ * \brief Tells whether the module is done with the frame.
+ *
+ * The tee is done once every row of the frame came in.  The branches can
+ * still take the last row after that.
+ *
+ * \param ipt The State Structure of the module.
+ * \return TRUE if the module wants more rows, FALSE if the frame is finished.
+ */
+__attribute__((gnu_inline)) inline bool ISC_process_tee_running( ISC_process_tee *ipt )
+{
+	return !ipt->finished;
+}
@@ -0,0 +1,61 @@
+/***************************************************************************//**
+ * \file ISC_process_tee.h
+ * \brief Module for feeding one row stream to several modules.
+ *
+ * ISC_process_tee.h describes a module that splits a pipeline into branches,
+ * so that, for instance, the same frame can be histogrammed and saved as a
+ * JPEG in one pass.  The branches all get the very same row; it is shared
+ * with ShareRow instead of copied, so a tee costs no memory or time per
+ * branch beyond the row pointer.
+*******************************************************************************/
+
+#ifndef _ISC_PROCESS_TEE_H_
+#define _ISC_PROCESS_TEE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ISC_util_imagecontext.h"
+
+/**
+ * ISC_PROCESS_TEE_MAXBRANCHES is the most branches one tee can have.  Tees
+ * can be put after tees for more.
+ */
+#define ISC_PROCESS_TEE_MAXBRANCHES 8
+
+/**
+ * \brief Process-Module for splitting a pipeline.
+ *
+ * Every row fed in is handed out once to each branch by
+ * ISC_process_tee_process.  Each branch frees the row with FreeRow as usual,
+ * and the memory goes away after the last one does.  Since the branches
+ * share the row, the modules after a tee must only read the rows they are
+ * fed; all the process- and out-modules in the ISC Pipeline do.  A module
+ * that wants to change a row in place has to copy it first.
+ *
+ * If a new row comes in before some branch took the last one (because that
+ * branch's module is already done, say), the tee lets go of the old row for
+ * that branch.
+ */
+typedef struct
+{
+	//---------------------------USER-DEFINED-------------------------------
+	ISC_util_imagecontext theContext; //!< The Image Context.
+	uint8_t branches; //!< How many branches the rows go to.
+	//---------------------------SYSTEM-HANDLED-----------------------------
+	uint8_t *row; //!< The row being handed out.
+	uint8_t waiting; //!< One bit for each branch that hasn't taken row yet.
+	uint16_t rowsLeft; //!< The number of rows still to come this frame.
+	//----------------------ISC_PIPELINE REQUIREMENT------------------------
+	bool finished; //!< Is the module finished?
+} ISC_process_tee;
+
+ISC_process_tee *ISC_process_tee_start( ISC_util_imagecontext, uint8_t );
+void ISC_process_tee_feed( ISC_process_tee *, uint8_t * );
+uint8_t *ISC_process_tee_process( ISC_process_tee *, uint8_t );
+ISC_util_imagecontext ISC_process_tee_context( ISC_process_tee * );
+void ISC_process_tee_reset( ISC_process_tee * );
+void ISC_process_tee_end( ISC_process_tee * );
+bool ISC_process_tee_running( ISC_process_tee * );
+
+#endif
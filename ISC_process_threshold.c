@@ -0,0 +1,227 @@
+/***************************************************************************//**
+ * \file ISC_process_threshold.c
+ * \brief Module for color-threshold segmentation into run-length rows.
+ *
+ * ISC_process_threshold.c contains the functions for thresholding scanlines
+ * against per-channel color bounds and run-length encoding the result.  The
+ * memory and bandwidth used by a row scales with the number of blob edges in
+ * it instead of the width of the image.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <cc3.h>
+
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_rowqueue.h"
+#include "ISC_process_threshold.h"
+
+// Fill in the per-channel lookup tables from the class bounds.
+__attribute__((gnu_inline)) inline static void BuildLookups( ISC_process_threshold *ipt, const ISC_process_threshold_bounds *bounds, uint8_t classCount )
+{
+	uint16_t value, mask;
+	uint8_t channel, class;
+
+	for ( channel = 0; channel < 3; channel++ )
+	{
+		for ( value = 0; value < 256; value++ )
+		{
+			ipt->lookup[channel][value] = 0;
+			for ( class = 0; class < classCount; class++ )
+			{
+				if ( value >= bounds[class].min[channel] && value <= bounds[class].max[channel] )
+					ipt->lookup[channel][value] |= 1 << class;
+			}
+		}
+	}
+
+	// If a pixel falls into more than one class, the first class given to
+	// the module wins.  Working this out once here means the inner loop
+	// only has to do a table lookup.
+	ipt->labelOf[0] = 0;
+	for ( mask = 1; mask < 256; mask++ )
+	{
+		for ( class = 0; !( mask & (1 << class) ); class++ );
+		ipt->labelOf[mask] = class + 1;
+	}
+}
+
+// Close the run in progress (if it's a class run) and start a new one at x.
+__attribute__((gnu_inline)) inline static void SwitchRun( ISC_process_threshold *ipt, uint16_t *runCount, uint16_t *runStart, uint8_t *runLabel, uint8_t label, uint16_t x )
+{
+	if ( *runLabel )
+	{
+		ipt->scratch[*runCount].start = *runStart;
+		ipt->scratch[*runCount].length = x - *runStart;
+		ipt->scratch[*runCount].label = *runLabel;
+		(*runCount)++;
+	}
+	*runLabel = label;
+	*runStart = x;
+}
+
+/**
+ *  \brief Starts an ISC_process_threshold module.
+ *
+ *  This function creates an ISC_process_threshold module, which splits each
+ *  row into runs of pixels that fall inside the given color bounds.
+ *
+ *  \param context The image context of the input image.  Must have 1 or 3 channels.
+ *  \param bounds An array of classCount color bounds.  The first one is label 1.
+ *  \param classCount The number of color classes, up to ISC_THRESHOLD_MAXCLASSES.
+ *  \return A pointer to an ISC_process_threshold state structure.
+ */
+__attribute__((gnu_inline)) inline ISC_process_threshold *ISC_process_threshold_start( ISC_util_imagecontext context, const ISC_process_threshold_bounds *bounds, uint8_t classCount )
+{
+	ISC_process_threshold *ipt;
+
+	if ( classCount == 0 || classCount > ISC_THRESHOLD_MAXCLASSES )
+		ISC_util_assert_message( "FATAL: Bad number of threshold classes!" );
+	if ( context.frame.channels != 1 && context.frame.channels != 3 )
+		ISC_util_assert_message( "FATAL: Threshold needs a 1 or 3 channel image!" );
+
+	// Make the new state structure.
+	// MEMORY IS ALLOCATED HERE.
+	ipt = malloc( sizeof( ISC_process_threshold ) );
+	if ( !ipt )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate threshold!" );
+
+	ipt->theContext = context;
+	ipt->width = context.frame.width;
+
+	BuildLookups( ipt, bounds, classCount );
+
+	// The worst case is every pixel switching class, which is one run per
+	// pixel.  Rows are built here and then copied out at their real size.
+	// MEMORY IS ALLOCATED HERE.
+	ipt->scratch = malloc( sizeof( ISC_process_threshold_run ) * ipt->width );
+	if ( !ipt->scratch )
+		ISC_util_assert_message( "FATAL: Not enough memory for threshold runs!" );
+
+	// Make a rowqueue.
+	ipt->rqueue = ISC_util_rowqueue_start( 3 );
+
+	// Store the amount of rows left to threshold (all the ones in the image).
+	ipt->remainingRowCount = context.frame.height;
+
+	return ipt;
+}
+
+/**
+ *  \brief Feeds a row of pixels into the thresholder.
+ *
+ *  \param ipt The module state structure.
+ *  \param row The pixel row.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_threshold_feed( ISC_process_threshold *ipt, uint8_t *row )
+{
+	if ( row )
+		ISC_util_rowqueue_feed( ipt->rqueue, row );
+}
+
+/**
+ *  \brief Spits out a freshly-thresholded run-length row.
+ *
+ *  This function takes the oldest row fed in and returns it as a list of
+ *  runs.  Runs are only made for pixels that fall into a class, so a row with
+ *  nothing interesting in it comes back with a runCount of 0.
+ *
+ *  \param ipt The module state structure.
+ *  \return The run-length row, or NULL if no rows are waiting.
+ */
+__attribute__((gnu_inline)) inline ISC_process_threshold_runrow *ISC_process_threshold_process( ISC_process_threshold *ipt )
+{
+	uint8_t *fullRow, *pixel;
+	uint8_t label, runLabel = 0;
+	uint16_t x, runCount = 0, runStart = 0;
+	ISC_process_threshold_runrow *newRow;
+
+	if ( ipt->rqueue->currentSize == 0 )
+		return NULL;
+
+	fullRow = ISC_util_rowqueue_process( ipt->rqueue );
+	pixel = fullRow;
+
+	// Checking the channel count once out here beats checking it for every
+	// pixel, so there's a copy of the loop for each case.
+	if ( ipt->theContext.frame.channels == 3 )
+	{
+		for ( x = 0; x < ipt->width; x++ )
+		{
+			label = ipt->labelOf[ ipt->lookup[0][pixel[0]] & ipt->lookup[1][pixel[1]] & ipt->lookup[2][pixel[2]] ];
+			pixel += 3;
+			if ( label != runLabel )
+				SwitchRun( ipt, &runCount, &runStart, &runLabel, label, x );
+		}
+	}
+	else
+	{
+		for ( x = 0; x < ipt->width; x++ )
+		{
+			label = ipt->labelOf[ ipt->lookup[0][*pixel] ];
+			pixel++;
+			if ( label != runLabel )
+				SwitchRun( ipt, &runCount, &runStart, &runLabel, label, x );
+		}
+	}
+
+	// A run touching the right edge of the image is still open.
+	SwitchRun( ipt, &runCount, &runStart, &runLabel, 0, ipt->width );
+
+	// The pixel row has been thresholded, so its usefulness is now zero.
+	FreeRow( fullRow );
+
+	// MEMORY IS ALLOCATED HERE, ASSUMED TO BE HANDLED EXTERNALLY.
+	newRow = (ISC_process_threshold_runrow *)MallocRowBytes( sizeof( ISC_process_threshold_runrow ) + sizeof( ISC_process_threshold_run ) * runCount );
+	if ( !newRow )
+		ISC_util_assert_message( "FATAL: Not enough memory for a run-length row!" );
+	newRow->runCount = runCount;
+	memcpy( newRow->runs, ipt->scratch, sizeof( ISC_process_threshold_run ) * runCount );
+
+	ipt->remainingRowCount--;
+
+	return newRow;
+}
+
+/**
+ *  \brief Ends an ISC_process_threshold module.
+ *
+ *  \param ipt The module state structure.
+ *  \return Peace of mind.
+ */
+__attribute__((gnu_inline)) inline void ISC_process_threshold_end( ISC_process_threshold *ipt )
+{
+	ISC_util_rowqueue_end( ipt->rqueue );
+	free( ipt->scratch );
+	free( ipt );
+}
+
+/**
+ *  \brief Returns the image context.
+ *
+ *  The context is the same as the input one, since a run-length row still
+ *  describes a row of the same width.
+ *
+ *  \param ipt The module state structure.
+ *  \return Image context.
+ */
+__attribute__((gnu_inline)) inline ISC_util_imagecontext ISC_process_threshold_context( ISC_process_threshold *ipt )
+{
+	return ipt->theContext;
+}
+
+/**
+ *  \brief Returns whether or not the module is still running.
+ *
+ *  \param ipt The module state structure.
+ *  \return Whether or not the module is still doing work.
+ */
+__attribute__((gnu_inline)) inline bool ISC_process_threshold_running( ISC_process_threshold *ipt )
+{
+	if ( ipt->remainingRowCount > 0 )
+		return true;
+	else
+		return false;
+}
@@ -0,0 +1,98 @@
+/***************************************************************************//**
+ * \file ISC_process_threshold.h
+ * \brief Module for color-threshold segmentation into run-length rows.
+ *
+ * ISC_process_threshold.h describes a module that tests every pixel of a
+ * scanline against a set of per-channel min/max color bounds and emits the
+ * row as a list of run-length segments instead of pixels.  This is the
+ * classic CMUcam color-tracking operation, done scanline-by-scanline.
+*******************************************************************************/
+
+#ifndef _ISC_PROCESS_THRESHOLD_H_
+#define _ISC_PROCESS_THRESHOLD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_rowqueue.h"
+
+/**
+ * ISC_THRESHOLD_MAXCLASSES is the maximum number of color classes a single
+ * ISC_process_threshold module can track.  Each class gets one bit in the
+ * lookup tables, so this can't go past 8.
+ */
+#define ISC_THRESHOLD_MAXCLASSES 8
+
+/**
+ * \brief Color bounds for one class of ISC_process_threshold.
+ *
+ * A pixel belongs to the class if every channel is between min and max,
+ * inclusive.  Only the first frame.channels entries are looked at.
+ */
+typedef struct
+{
+	uint8_t min[3]; //!< Lower bound of each channel.
+	uint8_t max[3]; //!< Upper bound of each channel.
+} ISC_process_threshold_bounds;
+
+/**
+ * \brief One run of same-class pixels.
+ *
+ * A run covers pixels start through start+length-1 of its row.  The label is
+ * the class number (1 for the first bounds given to the module, 2 for the
+ * second, etc.)  Pixels that match no class are never put in a run.
+ */
+typedef struct
+{
+	uint16_t start; //!< The first pixel of the run.
+	uint16_t length; //!< The number of pixels in the run.
+	uint8_t label; //!< The class of the run.
+} ISC_process_threshold_run;
+
+/**
+ * \brief A row of run-length segments.
+ *
+ * This is what comes out of ISC_process_threshold_process instead of a pixel
+ * row.  It is allocated to hold exactly runCount runs, so its size depends on
+ * how many blob edges are in the row rather than on the width of the image.
+ * Whatever module accepts it is expected to FreeRow it, just like pixel rows.
+ */
+typedef struct
+{
+	uint16_t runCount; //!< The number of runs in the row.
+	ISC_process_threshold_run runs[]; //!< The runs, sorted by start.
+} ISC_process_threshold_runrow;
+
+/**
+ * \brief Process-Module for color-threshold segmentation.
+ *
+ * ISC_process_threshold turns pixel rows into run-length rows.  Classes are
+ * matched with three 256-entry lookup tables, one per channel, where each
+ * entry is a bitmask of the classes that value is inside the bounds of.  A
+ * pixel is classified by ANDing the masks of its channels together, so the
+ * per-pixel cost doesn't grow with the number of classes.
+ */
+typedef struct
+{
+	//---------------------------USER-EDITED STUFF------------------------------
+	ISC_util_imagecontext theContext; //!< The input image context.
+	//---------------------------INTERNAL STUFF---------------------------------
+	ISC_util_rowqueue *rqueue; //!< Rowqueue for temporary storage of rows.
+	uint8_t lookup[3][256]; //!< Per-channel class bitmasks.
+	uint8_t labelOf[256]; //!< Lowest class label of each combined bitmask.
+	ISC_process_threshold_run *scratch; //!< Worst-case run storage for one row.
+	uint16_t width; //!< The width of the image.
+	uint16_t remainingRowCount; //!< The number of rows left to threshold.
+} ISC_process_threshold;
+
+//--------------------------------PROTOTYPES------------------------------------
+ISC_process_threshold *ISC_process_threshold_start( ISC_util_imagecontext, const ISC_process_threshold_bounds *, uint8_t );
+void ISC_process_threshold_feed( ISC_process_threshold *, uint8_t * );
+ISC_process_threshold_runrow *ISC_process_threshold_process( ISC_process_threshold * );
+void ISC_process_threshold_end( ISC_process_threshold * );
+
+ISC_util_imagecontext ISC_process_threshold_context( ISC_process_threshold * );
+bool ISC_process_threshold_running( ISC_process_threshold * );
+
+#endif
@@ -108,7 +108,7 @@ __attribute__((gnu_inline)) inline uint8_t *ISC_process_tripler_process( ISC_pro
 	ipcc->remainingTripleCount--;
 	
 	// fullRow has been tripled, so its usefulness is now zero.
-	free( fullRow );
+	FreeRow( fullRow );
 
 	return tempRow;
 }
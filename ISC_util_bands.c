@@ -0,0 +1,344 @@
+/***************************************************************************//**
+ * \file ISC_util_bands.c
+ * \brief Runs the process-modules of a pipeline on horizontal bands in parallel.
+ *
+ * ISC_util_bands.c contains the band runner and the band stages of the
+ * windowed process-modules.
+ *
+ * The runner reads a whole frame from the in-module, then works out, from
+ * the last stage back to the first, which rows every stage needs for each
+ * band: the band itself, widened by each stage's halos and clipped to the
+ * frame.  Every band is a job for the thread pool.  A job copies its rows of
+ * the frame (the halos overlap, and modules free what they are fed), runs
+ * them through fresh modules one stage at a time, and throws away the rows
+ * the halos made once the next stage no longer needs them.
+*******************************************************************************/
+
+#ifndef VIRTUAL_CAM
+#error "ISC_util_bands uses pthreads and only builds for virtual-cam on the PC."
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cc3.h>
+
+#include "ISC_util_bands.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_pipeline.h"
+#include "ISC_util_threadpool.h"
+#include "ISC_process_convolution.h"
+#include "ISC_process_subsample.h"
+
+// One band of a frame, and what the job making it needs.
+typedef struct
+{
+	const ISC_util_bandstage *stages; // The stages to run.
+	uint8_t count; // How many stages there are.
+	ISC_util_imagecontext context; // The Image Context of the frame coming in.
+	uint8_t **frame; // The frame coming in.  Shared by every band; only read.
+	const uint16_t *heights; // heights[s] is the height of the rows going into stage s.
+	uint16_t *top; // top[s] is the first row going into stage s for this band.
+	uint16_t *bottom; // bottom[s] is one past the last.
+	uint8_t **rows; // The rows the band made.
+} Band;
+
+// Work out, from the last stage back, which rows each stage needs for the
+// band whose output is rows top[count] to bottom[count].
+__attribute__((gnu_inline)) inline static void FindBandRows( Band *band )
+{
+	const ISC_util_bandstage *stage;
+	int32_t top, bottom;
+	uint8_t s;
+
+	for ( s = band->count; s-- > 0; )
+	{
+		stage = band->stages + s;
+		top = (int32_t)band->top[s+1] * stage->rowStep - stage->haloAbove;
+		bottom = (int32_t)band->bottom[s+1] * stage->rowStep + stage->haloBelow;
+		band->top[s] = top < 0 ? 0 : top;
+		band->bottom[s] = bottom > band->heights[s] ? band->heights[s] : bottom;
+	}
+}
+
+// Keep a row a band's module made if the next stage needs it; rows made from
+// the halos are thrown away.
+__attribute__((gnu_inline)) inline static void KeepRow( uint8_t *row, uint16_t *made, uint16_t top, uint16_t bottom, uint8_t **kept, uint16_t *keptCount )
+{
+	if ( !row )
+		return;
+
+	if ( *made >= top && *made < bottom )
+		kept[(*keptCount)++] = row;
+	else
+		FreeRow( row );
+	(*made)++;
+}
+
+// The job for one band: copy its rows and run them through every stage.
+__attribute__((gnu_inline)) inline static void RunBand( void *argument )
+{
+	Band *band = argument;
+	const ISC_util_bandstage *stage;
+	ISC_util_imagecontext context = band->context;
+	uint32_t rowBytes = (uint32_t)context.frame.width * context.frame.channels;
+	uint8_t **rows, **kept;
+	uint16_t i, count, keptCount, made;
+	void *module;
+	uint8_t s;
+
+	count = band->bottom[0] - band->top[0];
+	// MEMORY IS ALLOCATED HERE.
+	rows = malloc( ( count + 1 ) * sizeof( uint8_t * ) );
+	if ( !rows )
+		ISC_util_assert_message( "FATAL: Not enough memory for the rows of a band!" );
+	for ( i = 0; i < count; i++ )
+	{
+		// MEMORY IS ALLOCATED HERE.
+		rows[i] = MallocRowBytes( rowBytes );
+		if ( !rows[i] )
+			ISC_util_assert_message( "FATAL: Not enough memory for the rows of a band!" );
+		memcpy( rows[i], band->frame[band->top[0] + i], rowBytes );
+	}
+
+	for ( s = 0, stage = band->stages; s < band->count; s++, stage++ )
+	{
+		context.frame.height = band->bottom[s] - band->top[s];
+		// MEMORY IS ALLOCATED HERE.
+		module = stage->start( context, stage->settings );
+		kept = malloc( ( band->bottom[s+1] - band->top[s+1] + 1 ) * sizeof( uint8_t * ) );
+		if ( !kept )
+			ISC_util_assert_message( "FATAL: Not enough memory for the rows of a band!" );
+		keptCount = 0;
+
+		// The module's first row is this row of the whole frame's stage.
+		made = band->top[s] / stage->rowStep;
+
+		// Just what a pipeline loop does, but over the band's rows.
+		for ( i = 0; i < count; i++ )
+		{
+			if ( !stage->running( module ) )
+			{
+				FreeRow( rows[i] );
+				continue;
+			}
+			stage->feed( module, rows[i] );
+			KeepRow( stage->process( module ), &made, band->top[s+1], band->bottom[s+1], kept, &keptCount );
+		}
+		// A band can be shorter than the kernel, so a NULL feed may not
+		// bring a row out right away; keep going until the module is done.
+		while ( stage->running( module ) )
+		{
+			stage->feed( module, NULL );
+			KeepRow( stage->process( module ), &made, band->top[s+1], band->bottom[s+1], kept, &keptCount );
+		}
+
+		context = stage->context( module );
+		stage->end( module );
+		free( rows );
+		rows = kept;
+		count = keptCount;
+
+		if ( count != band->bottom[s+1] - band->top[s+1] )
+			ISC_util_assert_message( "FATAL: A band stage didn't make the rows it was expected to!" );
+	}
+
+	band->rows = rows;
+}
+
+// Starts an ISC_process_convolution on a band.
+__attribute__((gnu_inline)) inline static void *ConvolutionStart( ISC_util_imagecontext context, const void *settings )
+{
+	return ISC_process_convolution_start( context, *(const ISC_process_convolution_kernel *)settings );
+}
+
+// Starts an ISC_process_subsample on a band.
+__attribute__((gnu_inline)) inline static void *SubsampleStart( ISC_util_imagecontext context, const void *settings )
+{
+	const ISC_util_bands_subsample *subsample = settings;
+
+	return ISC_process_subsample_start( context, subsample->skipFactorX, subsample->skipFactorY, subsample->subType );
+}
+
+/**
+ * \brief Makes a band stage of an ISC_process_convolution.
+ *
+ * The module starts with centerY-1 zero rows in its queue and puts a row out
+ * once it has kernelSize rows, so each output row looks centerY-1 rows up and
+ * kernelSize-centerY rows down; with the usual centerY of 1 that is a halo of
+ * kernelSize-1 rows below each band and none above.
+ *
+ * \param kernel The kernel.  Must last as long as the stage.
+ * \return The band stage.
+ */
+__attribute__((gnu_inline)) inline ISC_util_bandstage ISC_util_bandstage_convolution( const ISC_process_convolution_kernel *kernel )
+{
+	ISC_util_bandstage stage;
+	uint8_t above = kernel->centerY > 1 ? kernel->centerY - 1 : 0;
+
+	if ( above >= kernel->kernelSize )
+		ISC_util_assert_message( "FATAL: Convolution centerY is outside the kernel!" );
+
+	stage.name = "ISC_process_convolution";
+	stage.start = ConvolutionStart;
+	stage.feed = (ISC_util_stage_feed)ISC_process_convolution_feed;
+	stage.process = (ISC_util_stage_process)ISC_process_convolution_process;
+	stage.running = (ISC_util_stage_running)ISC_process_convolution_running;
+	stage.context = (ISC_util_bandstage_context)ISC_process_convolution_context;
+	stage.end = (ISC_util_bandstage_end)ISC_process_convolution_end;
+	stage.settings = kernel;
+	stage.rowStep = 1;
+	stage.haloAbove = above;
+	stage.haloBelow = kernel->kernelSize - 1 - above;
+	return stage;
+}
+
+/**
+ * \brief Makes a band stage of an ISC_process_subsample.
+ *
+ * No halos are needed, but every band starts on a group of skipFactorY rows.
+ *
+ * \param subsample The settings.  Must last as long as the stage.
+ * \return The band stage.
+ */
+__attribute__((gnu_inline)) inline ISC_util_bandstage ISC_util_bandstage_subsample( const ISC_util_bands_subsample *subsample )
+{
+	ISC_util_bandstage stage;
+
+	stage.name = "ISC_process_subsample";
+	stage.start = SubsampleStart;
+	stage.feed = (ISC_util_stage_feed)ISC_process_subsample_feed;
+	stage.process = (ISC_util_stage_process)ISC_process_subsample_process;
+	stage.running = (ISC_util_stage_running)ISC_process_subsample_running;
+	stage.context = (ISC_util_bandstage_context)ISC_process_subsample_context;
+	stage.end = (ISC_util_bandstage_end)ISC_process_subsample_end;
+	stage.settings = subsample;
+	stage.rowStep = subsample->skipFactorY;
+	stage.haloAbove = 0;
+	stage.haloBelow = 0;
+	return stage;
+}
+
+/**
+ * \brief Runs a pipeline with its process-modules cut into bands.
+ *
+ * ISC_util_bands_run reads each frame from the in-module, cuts the rows of
+ * the last stage into bands of about the same height, runs every band on the
+ * pool, and feeds the rows to the out-module in order once all the bands are
+ * done.  The out-module gets exactly the rows ISC_util_pipeline_runserial
+ * would give it with the same modules.
+ *
+ * The in- and out-module's hooks are used as in ISC_util_pipeline, and run on
+ * the caller's thread.  The process-modules are started and ended for every
+ * band of every frame, so they need no hooks.
+ *
+ * \param pool The thread pool to run the bands on.
+ * \param bands How many bands to cut each frame into.  A few per thread evens out bands that take longer.
+ * \param in The in-module's stage.
+ * \param context The in-module's Image Context.
+ * \param stages The process-modules' band stages, in order.
+ * \param count How many band stages there are.
+ * \param out The out-module's stage.
+ * \param frames How many frames to run.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_bands_run( ISC_util_threadpool *pool, uint8_t bands, ISC_util_stage *in, ISC_util_imagecontext context, const ISC_util_bandstage *stages, uint8_t count, ISC_util_stage *out, uint32_t frames )
+{
+	Band *bandList;
+	uint8_t **frameRows, *row;
+	uint16_t *heights, *edges;
+	uint16_t height, y, i;
+	uint32_t frame;
+	uint8_t b, s;
+
+	if ( in->feed || out->process || count == 0 )
+		ISC_util_assert_message( "FATAL: Banding needs an in-module, at least one band stage and an out-module!" );
+	for ( s = 0; s < count; s++ )
+		if ( stages[s].rowStep == 0 || ( stages[s].rowStep > 1 && ( stages[s].haloAbove || stages[s].haloBelow ) ) )
+			ISC_util_assert_message( "FATAL: A band stage with a rowStep above 1 can't have halos!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	heights = malloc( ( count + 1 ) * sizeof( uint16_t ) );
+	if ( !heights )
+		ISC_util_assert_message( "FATAL: Not enough memory to start banding!" );
+	heights[0] = context.frame.height;
+	for ( s = 0; s < count; s++ )
+		heights[s+1] = heights[s] / stages[s].rowStep;
+
+	height = heights[count];
+	if ( bands > height )
+		bands = height;
+	if ( bands == 0 )
+		bands = 1;
+
+	// MEMORY IS ALLOCATED HERE.
+	frameRows = malloc( ( heights[0] + 1 ) * sizeof( uint8_t * ) );
+	bandList = malloc( bands * sizeof( Band ) );
+	edges = malloc( 2 * bands * ( count + 1 ) * sizeof( uint16_t ) );
+	if ( !frameRows || !bandList || !edges )
+		ISC_util_assert_message( "FATAL: Not enough memory to start banding!" );
+
+	for ( b = 0; b < bands; b++ )
+	{
+		bandList[b].stages = stages;
+		bandList[b].count = count;
+		bandList[b].context = context;
+		bandList[b].frame = frameRows;
+		bandList[b].heights = heights;
+		bandList[b].top = edges + 2 * b * ( count + 1 );
+		bandList[b].bottom = bandList[b].top + count + 1;
+		bandList[b].top[count] = (uint32_t)height * b / bands;
+		bandList[b].bottom[count] = (uint32_t)height * ( b + 1 ) / bands;
+		FindBandRows( bandList + b );
+	}
+
+	for ( frame = 0; frame < frames; frame++ )
+	{
+		if ( frame > 0 )
+		{
+			if ( in->reset )
+				in->reset( in->module );
+			if ( out->reset )
+				out->reset( out->module );
+		}
+
+		// The bands need rows from all over the frame, so read all of it.
+		for ( y = 0; y < heights[0] && in->running( in->module ); )
+			if ( ( row = in->process( in->module ) ) )
+				frameRows[y++] = row;
+		if ( y < heights[0] )
+			ISC_util_assert_message( "FATAL: The in-module finished before the frame did!" );
+
+		for ( b = 0; b < bands; b++ )
+			ISC_util_threadpool_submit( pool, RunBand, bandList + b );
+		ISC_util_threadpool_wait( pool );
+
+		// Stitch the bands back together, top to bottom.
+		for ( b = 0; b < bands; b++ )
+		{
+			for ( i = 0; i < bandList[b].bottom[count] - bandList[b].top[count]; i++ )
+			{
+				if ( out->running( out->module ) )
+					out->feed( out->module, bandList[b].rows[i] );
+				else
+					FreeRow( bandList[b].rows[i] );
+			}
+			free( bandList[b].rows );
+		}
+
+		for ( y = 0; y < heights[0]; y++ )
+			FreeRow( frameRows[y] );
+
+		if ( in->frameDone )
+			in->frameDone( in->module );
+		if ( out->frameDone )
+			out->frameDone( out->module );
+	}
+
+	free( edges );
+	free( bandList );
+	free( frameRows );
+	free( heights );
+}
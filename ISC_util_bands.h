@@ -0,0 +1,89 @@
+/***************************************************************************//**
+ * \file ISC_util_bands.h
+ * \brief Runs the process-modules of a pipeline on horizontal bands in parallel.
+ *
+ * ISC_util_bands.h describes a band stage, which tells the band runner how to
+ * start a process-module on just part of a frame and which rows of its input
+ * each of its output rows looks at.  The runner cuts the frame into bands,
+ * runs the whole chain of process-modules on every band at once on an
+ * ISC_util_threadpool, and hands the rows to the out-module in order.  It
+ * uses pthreads, so it is only for virtual-cam builds on the PC.
+*******************************************************************************/
+
+#ifndef _ISC_UTIL_BANDS_H_
+#define _ISC_UTIL_BANDS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <cc3.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_pipeline.h"
+#include "ISC_util_threadpool.h"
+#include "ISC_process_convolution.h"
+
+/**
+ * \brief Starts a process-module on a band, given the band's Image Context.
+ */
+typedef void *(*ISC_util_bandstage_start)( ISC_util_imagecontext context, const void *settings );
+
+/**
+ * \brief A module's context function, with the module as a void pointer.
+ */
+typedef ISC_util_imagecontext (*ISC_util_bandstage_context)( void *module );
+
+/**
+ * \brief A module's end function, with the module as a void pointer.
+ */
+typedef void (*ISC_util_bandstage_end)( void *module );
+
+/**
+ * \brief One process-module of a banded pipeline.
+ *
+ * Output row j of the module is made from input rows
+ * j*rowStep-haloAbove to j*rowStep+rowStep-1+haloBelow, and rows past the
+ * top or bottom of the frame are whatever the module makes up for them (the
+ * zero rows of ISC_process_convolution, for instance).  The runner starts a
+ * new module for every band with the band's height in its Image Context and
+ * feeds it the band's rows plus the halos, so the module makes up rows only
+ * at the real edges of the frame, and every band's rows come out exactly as
+ * they would from one module over the whole frame.
+ *
+ * After its last row the module is fed NULL until its running function says
+ * it is done, so running has to turn FALSE once the band's rows are made.
+ *
+ * A module whose rows depend on every row above them, like
+ * ISC_process_integral, can't be cut into bands.  A module with a rowStep
+ * above 1 can't have halos, since its bands have to start on a group of rows.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	const char *name; //!< The stage's name, for reports.
+	ISC_util_bandstage_start start; //!< Starts the module on a band.
+	ISC_util_stage_feed feed; //!< The module's feed function.
+	ISC_util_stage_process process; //!< The module's process function.
+	ISC_util_stage_running running; //!< The module's running function.
+	ISC_util_bandstage_context context; //!< The module's context function.
+	ISC_util_bandstage_end end; //!< The module's end function.
+	const void *settings; //!< Passed to start.  Must last as long as the stage.
+	uint8_t rowStep; //!< Input rows per output row.
+	uint8_t haloAbove; //!< Extra input rows needed above a band.
+	uint8_t haloBelow; //!< Extra input rows needed below a band.
+} ISC_util_bandstage;
+
+/**
+ * \brief The settings of a banded ISC_process_subsample.
+ */
+typedef struct
+{
+	uint8_t skipFactorX; //!< The horizontal skip factor.
+	uint8_t skipFactorY; //!< The vertical skip factor.
+	cc3_subsample_mode_t subType; //!< The type of subsampling to do.
+} ISC_util_bands_subsample;
+
+ISC_util_bandstage ISC_util_bandstage_convolution( const ISC_process_convolution_kernel * );
+ISC_util_bandstage ISC_util_bandstage_subsample( const ISC_util_bands_subsample * );
+void ISC_util_bands_run( ISC_util_threadpool *, uint8_t, ISC_util_stage *, ISC_util_imagecontext, const ISC_util_bandstage *, uint8_t, ISC_util_stage *, uint32_t );
+
+#endif
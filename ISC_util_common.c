@@ -40,6 +40,38 @@ __attribute__((gnu_inline)) inline uint8_t PowerOfTwoDetect( uint8_t d )
 	return 0;
 }
 
+// Every row starts with this, just before its pixels.  It holds the number
+// of modules that still have to free the row, and takes up 8 bytes so the
+// pixels stay as aligned as malloc left them.
+typedef union
+{
+	uint32_t references;
+	uint64_t alignment;
+} RowHeader;
+
+/**
+ * \brief Allocate a row of any size.
+ *
+ * This function allocates a row with one reference, for rows that aren't
+ * pixels of the context, like the run-length rows of ISC_process_threshold.
+ * Rows passed from module to module have to come from here (or MallocRow or
+ * MallocZeroRow) and be let go of with FreeRow.
+ *
+ * \param bytes The size of the row.
+ * \return The row, or NULL if there isn't enough memory.
+ */
+__attribute__((gnu_inline)) inline uint8_t *MallocRowBytes( uint32_t bytes )
+{
+	RowHeader *header;
+
+	// MEMORY IS ALLOCATED HERE.
+	header = malloc( sizeof( RowHeader ) + bytes );
+	if ( !header )
+		return NULL;
+	header->references = 1;
+	return (uint8_t *)( header + 1 );
+}
+
 /**
  * \brief Allocate proper row memory.
  *
@@ -50,7 +82,7 @@ __attribute__((gnu_inline)) inline uint8_t *MallocRow( ISC_util_imagecontext *co
 {
 	uint8_t *result;
 
-	result = malloc( context->frame.width * context->frame.channels );
+	result = MallocRowBytes( context->frame.width * context->frame.channels );
 	return result;
 }
 
@@ -73,3 +105,53 @@ __attribute__((gnu_inline)) inline uint8_t *MallocZeroRow( ISC_util_imagecontext
 	return result;
 }
 
+/**
+ * \brief Give a row to more modules.
+ *
+ * This function adds references to a row, so it can be fed to more than one
+ * module without being copied; each of them frees it with FreeRow, and the
+ * memory goes away when the last one does.  Modules that share a row must
+ * only read it.
+ *
+ * \param row The row.
+ * \param more How many more modules will free it.
+ * \return The row.
+ */
+__attribute__((gnu_inline)) inline uint8_t *ShareRow( uint8_t *row, uint8_t more )
+{
+	RowHeader *header = (RowHeader *)row - 1;
+
+#ifdef VIRTUAL_CAM
+	// Threaded pipelines on the PC can let go of a row from two threads.
+	__sync_add_and_fetch( &header->references, more );
+#else
+	header->references += more;
+#endif
+	return row;
+}
+
+/**
+ * \brief Let go of a row.
+ *
+ * This function is what modules call instead of free when they are done
+ * with a row.  The row is freed once every module it was given to has let
+ * go of it.  NULL is ignored, like with free.
+ *
+ * \param row The row.
+ */
+__attribute__((gnu_inline)) inline void FreeRow( uint8_t *row )
+{
+	RowHeader *header;
+
+	if ( !row )
+		return;
+	header = (RowHeader *)row - 1;
+
+#ifdef VIRTUAL_CAM
+	if ( __sync_sub_and_fetch( &header->references, 1 ) == 0 )
+		free( header );
+#else
+	if ( --header->references == 0 )
+		free( header );
+#endif
+}
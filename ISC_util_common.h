@@ -13,8 +13,11 @@
 #include "ISC_util_imagecontext.h"
 
 uint8_t PowerOfTwoDetect( uint8_t d );
+uint8_t *MallocRowBytes( uint32_t );
 uint8_t *MallocRow( ISC_util_imagecontext * );
 uint8_t *MallocZeroRow( ISC_util_imagecontext * );
+uint8_t *ShareRow( uint8_t *, uint8_t );
+void FreeRow( uint8_t * );
 
 #endif
 
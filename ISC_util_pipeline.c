@@ -0,0 +1,243 @@
+/***************************************************************************//**
+ * \file ISC_util_pipeline.c
+ * \brief Runs a pipeline of modules, one thread per module, on the PC.
+ *
+ * ISC_util_pipeline.c contains the serial and threaded pipeline runners.
+ *
+ * In the threaded runner, each stage's thread pulls rows from the queue
+ * before it and pushes what it makes onto the queue after it.  Modules only
+ * ever see rows from their own thread, and a row belongs to exactly one
+ * thread at a time, so the modules themselves need no changes.  The end of a
+ * frame is a marker pushed after its last row, which lets a stage start on
+ * the next frame while the stages after it are still finishing this one.
+*******************************************************************************/
+
+#ifndef VIRTUAL_CAM
+#error "ISC_util_pipeline uses pthreads and only builds for virtual-cam on the PC."
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "ISC_util_pipeline.h"
+#include "ISC_util_spscqueue.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+
+// What a stage's thread needs to know.
+typedef struct
+{
+	ISC_util_stage *stage; // The stage it runs.
+	ISC_util_spscqueue *in; // Where its rows come from.  NULL for the in-module.
+	ISC_util_spscqueue *out; // Where its rows go.  NULL for the out-module.
+	uint32_t frames; // How many frames to run.
+} StageWorker;
+
+// Pushed after the last row of each frame.  Only its address matters.
+static uint8_t endOfFrame;
+
+// Run one frame of a stage on its thread.
+__attribute__((gnu_inline)) inline static void RunStageFrame( StageWorker *worker )
+{
+	ISC_util_stage *stage = worker->stage;
+	bool inputEnded = !worker->in;
+	uint8_t *row, *outRow;
+
+	while ( stage->running( stage->module ) )
+	{
+		row = NULL;
+		if ( !inputEnded )
+		{
+			row = ISC_util_spscqueue_pop( worker->in );
+			if ( row == &endOfFrame )
+			{
+				inputEnded = true;
+				row = NULL;
+			}
+		}
+		// Nothing more is coming, and an out-module has nothing to give.
+		else if ( !stage->process )
+			break;
+
+		if ( stage->feed )
+			stage->feed( stage->module, row );
+
+		if ( stage->process )
+		{
+			outRow = stage->process( stage->module );
+			if ( outRow )
+				ISC_util_spscqueue_push( worker->out, outRow );
+			// Once its input is gone, a process-module is fed NULL for as
+			// long as that still brings rows out (convolution's bottom
+			// edge); after that it is done.
+			else if ( inputEnded && worker->in )
+				break;
+		}
+	}
+
+	// Rows a finished module wasn't waiting for are thrown away, so the
+	// next frame starts lined up.
+	while ( !inputEnded )
+	{
+		row = ISC_util_spscqueue_pop( worker->in );
+		if ( row == &endOfFrame )
+			inputEnded = true;
+		else
+			FreeRow( row );
+	}
+
+	if ( worker->out )
+		ISC_util_spscqueue_push( worker->out, &endOfFrame );
+}
+
+// The thread of one stage.
+__attribute__((gnu_inline)) inline static void *StageThread( void *argument )
+{
+	StageWorker *worker = argument;
+	ISC_util_stage *stage = worker->stage;
+	uint32_t frame;
+
+	for ( frame = 0; frame < worker->frames; frame++ )
+	{
+		if ( frame > 0 && stage->reset )
+			stage->reset( stage->module );
+		RunStageFrame( worker );
+		if ( stage->frameDone )
+			stage->frameDone( stage->module );
+	}
+	return NULL;
+}
+
+/**
+ * \brief Makes a stage.
+ *
+ * ISC_UTIL_STAGE_IN, ISC_UTIL_STAGE_PROCESS and ISC_UTIL_STAGE_OUT are the
+ * easy way to call this.  The hooks start out NULL.
+ *
+ * \param name The stage's name, for reports.
+ * \param module The module's State Structure.
+ * \param feed The module's feed function, or NULL for an in-module.
+ * \param process The module's process function, or NULL for an out-module.
+ * \param running The module's running function.
+ * \return The stage.
+ */
+__attribute__((gnu_inline)) inline ISC_util_stage ISC_util_stage_make( const char *name, void *module, ISC_util_stage_feed feed, ISC_util_stage_process process, ISC_util_stage_running running )
+{
+	ISC_util_stage stage;
+
+	stage.name = name;
+	stage.module = module;
+	stage.feed = feed;
+	stage.process = process;
+	stage.running = running;
+	stage.frameDone = NULL;
+	stage.reset = NULL;
+	return stage;
+}
+
+/**
+ * \brief Runs a pipeline on this thread.
+ *
+ * ISC_util_pipeline_runserial does just what a pipeline loop in main.c does:
+ * until the out-module is done, take a row from the in-module and pass it
+ * through every stage in turn.  It is what the threaded run is measured
+ * against, and gives the same results.
+ *
+ * \param stages The stages, in-module first and out-module last.
+ * \param count How many stages there are.  At least 2.
+ * \param frames How many frames to run.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_pipeline_runserial( ISC_util_stage *stages, uint8_t count, uint32_t frames )
+{
+	ISC_util_stage *stage, *last = stages + count - 1;
+	uint32_t frame;
+	uint8_t *row;
+	uint8_t i;
+
+	if ( count < 2 || stages[0].feed || last->process )
+		ISC_util_assert_message( "FATAL: A pipeline needs an in-module first and an out-module last!" );
+
+	for ( frame = 0; frame < frames; frame++ )
+	{
+		if ( frame > 0 )
+			for ( i = 0; i < count; i++ )
+				if ( stages[i].reset )
+					stages[i].reset( stages[i].module );
+
+		while ( last->running( last->module ) )
+		{
+			row = NULL;
+			for ( i = 0, stage = stages; i < count; i++, stage++ )
+			{
+				// A module that is done doesn't get any more rows.
+				if ( stage != last && !stage->running( stage->module ) )
+				{
+					FreeRow( row );
+					row = NULL;
+					continue;
+				}
+				if ( stage->feed )
+					stage->feed( stage->module, row );
+				row = stage->process ? stage->process( stage->module ) : NULL;
+			}
+		}
+
+		for ( i = 0; i < count; i++ )
+			if ( stages[i].frameDone )
+				stages[i].frameDone( stages[i].module );
+	}
+}
+
+/**
+ * \brief Runs a pipeline with each stage on its own thread.
+ *
+ * ISC_util_pipeline_runthreaded starts a thread for every stage, connects
+ * them with ISC_util_spscqueues, and returns when every stage has run every
+ * frame.  The stages work on different rows (and, near the ends of a frame,
+ * different frames) at the same time, so a pipeline of N heavy stages can go
+ * up to N times as fast, if there are N cores and the stages take about the
+ * same time.  The slowest stage sets the pace.
+ *
+ * \param stages The stages, in-module first and out-module last.
+ * \param count How many stages there are.  At least 2.
+ * \param frames How many frames to run.
+ * \param queueRows How many rows each queue holds.  A few are enough to smooth out uneven stages.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_pipeline_runthreaded( ISC_util_stage *stages, uint8_t count, uint32_t frames, uint32_t queueRows )
+{
+	StageWorker *workers;
+	pthread_t *threads;
+	uint8_t i;
+
+	if ( count < 2 || stages[0].feed || stages[count-1].process )
+		ISC_util_assert_message( "FATAL: A pipeline needs an in-module first and an out-module last!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	workers = malloc( count * sizeof( StageWorker ) );
+	threads = malloc( count * sizeof( pthread_t ) );
+	if ( !workers || !threads )
+		ISC_util_assert_message( "FATAL: Not enough memory to start the pipeline threads!" );
+
+	for ( i = 0; i < count; i++ )
+	{
+		workers[i].stage = stages + i;
+		workers[i].frames = frames;
+		workers[i].in = i > 0 ? workers[i-1].out : NULL;
+		// MEMORY IS ALLOCATED HERE.
+		workers[i].out = i + 1 < count ? ISC_util_spscqueue_start( queueRows ) : NULL;
+	}
+
+	for ( i = 0; i < count; i++ )
+		if ( pthread_create( threads + i, NULL, StageThread, workers + i ) != 0 )
+			ISC_util_assert_message( "FATAL: Couldn't start a pipeline thread!" );
+
+	for ( i = 0; i < count; i++ )
+		pthread_join( threads[i], NULL );
+
+	for ( i = 0; i + 1 < count; i++ )
+		ISC_util_spscqueue_end( workers[i].out );
+	free( workers );
+	free( threads );
+}
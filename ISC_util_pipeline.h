@@ -0,0 +1,83 @@
+/***************************************************************************//**
+ * \file ISC_util_pipeline.h
+ * \brief Runs a pipeline of modules, one thread per module, on the PC.
+ *
+ * ISC_util_pipeline.h describes a stage, which wraps any in-, process- or
+ * out-module behind the same few function pointers, and two ways of running
+ * a list of stages: one after another on one thread, just like the pipeline
+ * loops in main.c, or each on its own thread with ISC_util_spscqueues
+ * between them.  It uses pthreads, so it is only for virtual-cam builds on
+ * the PC; on the CMUcam3 pipelines are still written out as loops.
+*******************************************************************************/
+
+#ifndef _ISC_UTIL_PIPELINE_H_
+#define _ISC_UTIL_PIPELINE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \brief A module's feed function, with the module as a void pointer.
+ */
+typedef void (*ISC_util_stage_feed)( void *module, uint8_t *row );
+
+/**
+ * \brief A module's process function, with the module as a void pointer.
+ */
+typedef uint8_t *(*ISC_util_stage_process)( void *module );
+
+/**
+ * \brief A module's running function, with the module as a void pointer.
+ */
+typedef bool (*ISC_util_stage_running)( void *module );
+
+/**
+ * \brief Something to do with a module between frames.
+ */
+typedef void (*ISC_util_stage_hook)( void *module );
+
+/**
+ * \brief One module of a pipeline.
+ *
+ * An in-module has no feed, an out-module has no process, and a
+ * process-module has both.  The first stage of a pipeline must be an
+ * in-module and the last an out-module.  Make one with ISC_UTIL_STAGE_IN,
+ * ISC_UTIL_STAGE_PROCESS or ISC_UTIL_STAGE_OUT, then set the hooks it needs.
+ *
+ * For more than one frame, every stage needs a reset hook, and the in-module's
+ * has to get the next frame too (cc3_pixbuf_load and ISC_in_cmucam_reset, for
+ * instance).  frameDone is where to use a finished frame, like exporting a
+ * histogram; it runs before the next reset.  In a threaded run the hooks run
+ * on the stage's own thread, so they must only touch their own module.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	const char *name; //!< The stage's name, for reports.
+	void *module; //!< The module's State Structure.
+	ISC_util_stage_feed feed; //!< The module's feed function.  NULL for in-modules.
+	ISC_util_stage_process process; //!< The module's process function.  NULL for out-modules.
+	ISC_util_stage_running running; //!< The module's running function.
+	ISC_util_stage_hook frameDone; //!< Called after each frame.  May be NULL.
+	ISC_util_stage_hook reset; //!< Called before each frame after the first.  May be NULL for one frame.
+} ISC_util_stage;
+
+/**
+ * These make a stage out of a module and its functions, going by the names
+ * every module uses.  For example,
+ *     ISC_UTIL_STAGE_PROCESS( ISC_process_convolution, ipc )
+ * uses ISC_process_convolution_feed, ISC_process_convolution_process and
+ * ISC_process_convolution_running.
+ */
+#define ISC_UTIL_STAGE_IN( prefix, module ) \
+	ISC_util_stage_make( #prefix, module, NULL, (ISC_util_stage_process)prefix##_process, (ISC_util_stage_running)prefix##_running )
+#define ISC_UTIL_STAGE_PROCESS( prefix, module ) \
+	ISC_util_stage_make( #prefix, module, (ISC_util_stage_feed)prefix##_feed, (ISC_util_stage_process)prefix##_process, (ISC_util_stage_running)prefix##_running )
+#define ISC_UTIL_STAGE_OUT( prefix, module ) \
+	ISC_util_stage_make( #prefix, module, (ISC_util_stage_feed)prefix##_feed, NULL, (ISC_util_stage_running)prefix##_running )
+
+ISC_util_stage ISC_util_stage_make( const char *, void *, ISC_util_stage_feed, ISC_util_stage_process, ISC_util_stage_running );
+void ISC_util_pipeline_runserial( ISC_util_stage *, uint8_t, uint32_t );
+void ISC_util_pipeline_runthreaded( ISC_util_stage *, uint8_t, uint32_t, uint32_t );
+
+#endif
@@ -0,0 +1,379 @@
+/***************************************************************************//**
+ * \file ISC_util_replay.c
+ * \brief Replays the frames of a frame log through many copies of a pipeline.
+ *
+ * ISC_util_replay.c contains the workers and the writer of a replay.
+ *
+ * Every worker takes the next frame number, seeks its own ISC_in_framelog to
+ * it and runs the frame through its own pipeline.  The pipeline writes to a
+ * FILE that puts the bytes into a slot for that frame, and the caller's
+ * thread writes the slots out in frame order.  There are only a few slots, so
+ * a worker that gets too far ahead of the writer waits instead of holding
+ * the results of the whole log in memory.
+*******************************************************************************/
+
+#ifndef VIRTUAL_CAM
+#error "ISC_util_replay uses pthreads and only builds for virtual-cam on the PC."
+#endif
+
+// fopencookie is a GNU extension.
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "ISC_util_replay.h"
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_pipeline.h"
+#include "ISC_util_threadpool.h"
+#include "ISC_in_framelog.h"
+
+// Slots per worker.  Two lets a worker start its next frame while the
+// writer is still on the last one.
+#define SLOTS_PER_WORKER 2
+
+// What one frame's pipeline wrote, waiting for its turn to be written out.
+typedef struct
+{
+	uint8_t *data; // The bytes.
+	size_t used; // How many bytes there are.
+	size_t size; // How many fit before data has to grow.
+	bool ready; // Set once the frame is done.
+	bool failed; // Set if some of the frame's output couldn't be kept.
+} Slot;
+
+// Everything the workers and the writer share.
+typedef struct
+{
+	const char *path; // The log.
+	ISC_util_replay_start start; // Builds a worker's pipeline.
+	ISC_util_replay_end end; // Ends a worker's pipeline.
+	void *user; // Passed to start and end.
+	uint32_t frames; // How many frames the log has.
+	Slot *slots; // The slots; frame f uses slot f % slotCount.
+	uint32_t slotCount; // How many slots there are.
+	pthread_mutex_t lock; // Guards everything below, and the slots' ready flags.
+	pthread_cond_t frameReady; // Signalled when a slot is ready.
+	pthread_cond_t slotFree; // Signalled when the writer frees a slot.
+	uint32_t nextFrame; // The next frame to hand out.
+	uint32_t nextWrite; // The next frame to write out.
+	ISC_util_replay_report *report; // Where the workers add their times.
+} Replay;
+
+// One worker.
+typedef struct
+{
+	Replay *replay; // The replay it works for.
+	Slot *slot; // Where its pipeline's writes go.  NULL between frames.
+} Worker;
+
+// Microseconds from a clock.
+__attribute__((gnu_inline)) inline static uint64_t Microseconds( clockid_t clock )
+{
+	struct timespec now;
+
+	clock_gettime( clock, &now );
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// The write function of a worker's FILE.  Bytes written between frames,
+// like what a module writes when it is ended, have no frame to go to and are
+// dropped.  Returns 0 if the slot can't grow, as fopencookie wants.
+__attribute__((gnu_inline)) inline static ssize_t SlotWrite( void *cookie, const char *data, size_t length )
+{
+	Worker *worker = cookie;
+	Slot *slot = worker->slot;
+	uint8_t *grown;
+	size_t size;
+
+	if ( !slot )
+		return length;
+
+	if ( slot->used + length > slot->size )
+	{
+		size = slot->size ? slot->size : 4096;
+		while ( size < slot->used + length )
+			size *= 2;
+		// MEMORY IS ALLOCATED HERE.
+		grown = realloc( slot->data, size );
+		if ( !grown )
+			return 0;
+		slot->data = grown;
+		slot->size = size;
+	}
+
+	memcpy( slot->data + slot->used, data, length );
+	slot->used += length;
+	return length;
+}
+
+// Push what the pipeline wrote into the worker's slot.  If some of it
+// couldn't be kept, the slot is marked failed and whatever is still in the
+// FILE is dropped, so it doesn't end up in the next frame's slot.
+__attribute__((gnu_inline)) inline static void FlushToSlot( Worker *worker, FILE *out )
+{
+	if ( fflush( out ) == 0 && !ferror( out ) )
+		return;
+
+	if ( worker->slot )
+		worker->slot->failed = true;
+	worker->slot = NULL;
+	fflush( out );
+	clearerr( out );
+}
+
+// Whether a pipeline built for one Image Context can take frames of another.
+__attribute__((gnu_inline)) inline static bool SameShape( ISC_util_imagecontext a, ISC_util_imagecontext b )
+{
+	return a.frame.width == b.frame.width && a.frame.height == b.frame.height &&
+		a.frame.channels == b.frame.channels && a.colorspace == b.colorspace;
+}
+
+// Run one frame through a worker's stages, just like
+// ISC_util_pipeline_runserial, adding up the time spent in each stage.  The
+// time is the thread's own CPU time, so it doesn't count the time another
+// worker had the core when there are more workers than cores.
+__attribute__((gnu_inline)) inline static void RunFrame( ISC_util_stage *stages, uint8_t count, uint64_t *times )
+{
+	ISC_util_stage *stage, *last = stages + count - 1;
+	uint64_t start;
+	uint8_t *row;
+	uint8_t i;
+
+	while ( last->running( last->module ) )
+	{
+		row = NULL;
+		for ( i = 0, stage = stages; i < count; i++, stage++ )
+		{
+			if ( stage != last && !stage->running( stage->module ) )
+			{
+				FreeRow( row );
+				row = NULL;
+				continue;
+			}
+			start = Microseconds( CLOCK_THREAD_CPUTIME_ID );
+			if ( stage->feed )
+				stage->feed( stage->module, row );
+			row = stage->process ? stage->process( stage->module ) : NULL;
+			times[i] += Microseconds( CLOCK_THREAD_CPUTIME_ID ) - start;
+		}
+	}
+}
+
+// The job of one worker: take frames until there are none left.
+__attribute__((gnu_inline)) inline static void WorkerJob( void *argument )
+{
+	Worker *worker = argument;
+	Replay *replay = worker->replay;
+	ISC_in_framelog *ilf;
+	ISC_util_stage stages[ISC_UTIL_REPLAY_MAXSTAGES + 1];
+	ISC_util_imagecontext built;
+	cookie_io_functions_t functions = { NULL, SlotWrite, NULL, NULL };
+	uint64_t times[ISC_UTIL_REPLAY_MAXSTAGES + 1];
+	uint32_t frame;
+	uint8_t count = 0, i;
+	FILE *out;
+
+	// MEMORY IS ALLOCATED HERE.
+	ilf = ISC_in_framelog_start( replay->path );
+	out = fopencookie( worker, "w", functions );
+	if ( !ilf || !out )
+		ISC_util_assert_message( "FATAL: A replay worker couldn't open the log or its output!" );
+	memset( times, 0, sizeof( times ) );
+	stages[0] = ISC_UTIL_STAGE_IN( ISC_in_framelog, ilf );
+
+	for ( ;; )
+	{
+		pthread_mutex_lock( &replay->lock );
+		while ( replay->nextFrame < replay->frames && replay->nextFrame >= replay->nextWrite + replay->slotCount )
+			pthread_cond_wait( &replay->slotFree, &replay->lock );
+		frame = replay->nextFrame;
+		if ( frame < replay->frames )
+			replay->nextFrame++;
+		pthread_mutex_unlock( &replay->lock );
+		if ( frame >= replay->frames )
+			break;
+
+		ISC_in_framelog_seek( ilf, frame );
+		worker->slot = replay->slots + frame % replay->slotCount;
+
+		// The first frame, or a frame of another size, gets a new pipeline.
+		if ( count == 0 || !SameShape( built, ISC_in_framelog_context( ilf ) ) )
+		{
+			// What the old pipeline writes as it ends has to reach the FILE
+			// while there is no slot, or it would land in this frame's.
+			worker->slot = NULL;
+			if ( count > 0 )
+			{
+				replay->end( stages + 1, count - 1, replay->user );
+				FlushToSlot( worker, out );
+			}
+			worker->slot = replay->slots + frame % replay->slotCount;
+
+			built = ISC_in_framelog_context( ilf );
+			count = replay->start( built, out, ilf, stages + 1, replay->user ) + 1;
+			if ( count < 2 || count > ISC_UTIL_REPLAY_MAXSTAGES + 1 || stages[count-1].process )
+				ISC_util_assert_message( "FATAL: A replayed pipeline needs 1 to ISC_UTIL_REPLAY_MAXSTAGES stages, with an out-module last!" );
+
+			pthread_mutex_lock( &replay->lock );
+			replay->report->stageCount = count;
+			for ( i = 0; i < count; i++ )
+				replay->report->stageNames[i] = stages[i].name;
+			pthread_mutex_unlock( &replay->lock );
+		}
+		else
+			for ( i = 1; i < count; i++ )
+				if ( stages[i].reset )
+					stages[i].reset( stages[i].module );
+
+		RunFrame( stages, count, times );
+		for ( i = 1; i < count; i++ )
+			if ( stages[i].frameDone )
+				stages[i].frameDone( stages[i].module );
+		FlushToSlot( worker, out );
+		worker->slot = NULL;
+
+		pthread_mutex_lock( &replay->lock );
+		replay->slots[frame % replay->slotCount].ready = true;
+		pthread_cond_broadcast( &replay->frameReady );
+		pthread_mutex_unlock( &replay->lock );
+	}
+
+	if ( count > 0 )
+		replay->end( stages + 1, count - 1, replay->user );
+	fclose( out );
+	ISC_in_framelog_end( ilf );
+
+	pthread_mutex_lock( &replay->lock );
+	for ( i = 0; i < count; i++ )
+		replay->report->stageMicroseconds[i] += times[i];
+	pthread_mutex_unlock( &replay->lock );
+}
+
+/**
+ * \brief Replays every frame of a frame log.
+ *
+ * ISC_util_replay_run starts a thread pool and a copy of the pipeline for
+ * each worker, replays the log, and writes what the pipelines wrote for each
+ * frame to out, in frame order, on the caller's thread.  With the same
+ * pipeline, out gets the same bytes for any number of workers, except for
+ * anything that depends on the clock or on how many frames a module has
+ * seen (use the frame ids of the ISC_in_framelog instead).  Whatever modules
+ * write when they are ended is dropped, since it belongs to no frame.  A
+ * frame whose output couldn't all be kept in memory is left out, and the run
+ * returns FALSE.
+ *
+ * A pipeline is rebuilt when a worker comes to a frame of another size.
+ *
+ * \param path The frame log.
+ * \param workers How many worker threads to use.  The number of cores is a good choice.
+ * \param start Builds a worker's copy of the pipeline.
+ * \param end Ends a worker's copy of the pipeline.
+ * \param user Passed to start and end.
+ * \param out Where the results go.
+ * \param report The report to add this run to.
+ * \return TRUE if the log was replayed and every result was kept and written.
+ */
+__attribute__((gnu_inline)) inline bool ISC_util_replay_run( const char *path, uint8_t workers, ISC_util_replay_start start, ISC_util_replay_end end, void *user, FILE *out, ISC_util_replay_report *report )
+{
+	Replay replay;
+	Worker *workerList;
+	ISC_util_threadpool *pool;
+	ISC_in_framelog *ilf;
+	Slot *slot;
+	uint64_t began;
+	uint32_t frame;
+	bool ok = true;
+	uint8_t w;
+
+	// Open the log once here to count the frames; each worker maps its own.
+	ilf = ISC_in_framelog_start( path );
+	if ( !ilf )
+		return false;
+	replay.frames = ISC_in_framelog_frames( ilf );
+	ISC_in_framelog_end( ilf );
+
+	if ( workers == 0 )
+		workers = 1;
+	began = Microseconds( CLOCK_MONOTONIC );
+
+	replay.path = path;
+	replay.start = start;
+	replay.end = end;
+	replay.user = user;
+	replay.slotCount = SLOTS_PER_WORKER * workers;
+	replay.nextFrame = 0;
+	replay.nextWrite = 0;
+	replay.report = report;
+	pthread_mutex_init( &replay.lock, NULL );
+	pthread_cond_init( &replay.frameReady, NULL );
+	pthread_cond_init( &replay.slotFree, NULL );
+
+	// MEMORY IS ALLOCATED HERE.
+	replay.slots = calloc( replay.slotCount, sizeof( Slot ) );
+	workerList = malloc( workers * sizeof( Worker ) );
+	if ( !replay.slots || !workerList )
+		ISC_util_assert_message( "FATAL: Not enough memory to start a replay!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	pool = ISC_util_threadpool_start( workers );
+	for ( w = 0; w < workers; w++ )
+	{
+		workerList[w].replay = &replay;
+		workerList[w].slot = NULL;
+		ISC_util_threadpool_submit( pool, WorkerJob, workerList + w );
+	}
+
+	// Write the frames out as they come, in order.
+	for ( frame = 0; frame < replay.frames; frame++ )
+	{
+		slot = replay.slots + frame % replay.slotCount;
+
+		pthread_mutex_lock( &replay.lock );
+		while ( !slot->ready )
+			pthread_cond_wait( &replay.frameReady, &replay.lock );
+		pthread_mutex_unlock( &replay.lock );
+
+		// A frame that lost some of its output is left out rather than
+		// written cut short.
+		if ( slot->failed )
+			ok = false;
+		else if ( slot->used > 0 && fwrite( slot->data, 1, slot->used, out ) != slot->used )
+			ok = false;
+
+		pthread_mutex_lock( &replay.lock );
+		slot->ready = false;
+		slot->failed = false;
+		slot->used = 0;
+		replay.nextWrite++;
+		pthread_cond_broadcast( &replay.slotFree );
+		pthread_mutex_unlock( &replay.lock );
+	}
+
+	ISC_util_threadpool_wait( pool );
+	ISC_util_threadpool_end( pool );
+	if ( fflush( out ) != 0 )
+		ok = false;
+
+	for ( frame = 0; frame < replay.slotCount; frame++ )
+		free( replay.slots[frame].data );
+	free( replay.slots );
+	free( workerList );
+	pthread_mutex_destroy( &replay.lock );
+	pthread_cond_destroy( &replay.frameReady );
+	pthread_cond_destroy( &replay.slotFree );
+
+	report->frames += replay.frames;
+	report->milliseconds += ( Microseconds( CLOCK_MONOTONIC ) - began ) / 1000;
+	if ( !ok )
+		report->writeFailed = true;
+	return ok;
+}
@@ -0,0 +1,67 @@
+/***************************************************************************//**
+ * \file ISC_util_replay.h
+ * \brief Replays the frames of a frame log through many copies of a pipeline.
+ *
+ * ISC_util_replay.h describes a batch runner for going back over logged
+ * frames with a new kernel or classifier.  Frames don't depend on each other,
+ * so each worker thread gets its own copy of the pipeline and its own reader
+ * of the log and takes whole frames, while what the pipelines write comes out
+ * in frame order as if one pipeline had done them all.  It uses pthreads and
+ * ISC_in_framelog, so it is only for virtual-cam builds on the PC.
+*******************************************************************************/
+
+#ifndef _ISC_UTIL_REPLAY_H_
+#define _ISC_UTIL_REPLAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ISC_util_imagecontext.h"
+#include "ISC_util_pipeline.h"
+#include "ISC_in_framelog.h"
+
+/**
+ * ISC_UTIL_REPLAY_MAXSTAGES is the most stages a replayed pipeline can have
+ * after the in-module.
+ */
+#define ISC_UTIL_REPLAY_MAXSTAGES 15
+
+/**
+ * \brief Builds one worker's copy of the pipeline.
+ *
+ * It gets the Image Context of the frames, the FILE the pipeline should
+ * write its results to, and the worker's ISC_in_framelog (for the frame ids
+ * and timestamps of the frames being replayed).  It fills in stages with the
+ * process-modules in order and the out-module last, with the reset hooks
+ * they need for more than one frame (the in-module is taken care of), and
+ * returns how many there are.  It runs on the worker's thread.
+ */
+typedef uint8_t (*ISC_util_replay_start)( ISC_util_imagecontext context, FILE *out, ISC_in_framelog *source, ISC_util_stage *stages, void *user );
+
+/**
+ * \brief Ends the modules of one worker's copy of the pipeline.
+ */
+typedef void (*ISC_util_replay_end)( ISC_util_stage *stages, uint8_t count, void *user );
+
+/**
+ * \brief What a replay did and where the time went.
+ *
+ * Set it to zeros before the first ISC_util_replay_run; each run adds to it,
+ * so replaying a directory of logs gives one report for all of them.  The
+ * stage times are added up over every worker, so they can be more than the
+ * run took; they say which stage to make faster.
+ */
+typedef struct
+{
+	uint32_t frames; //!< How many frames were replayed.
+	uint32_t milliseconds; //!< How long the runs took, start to finish.
+	uint8_t stageCount; //!< How many stages were timed, the in-module first.
+	const char *stageNames[ISC_UTIL_REPLAY_MAXSTAGES + 1]; //!< The stages' names.
+	uint64_t stageMicroseconds[ISC_UTIL_REPLAY_MAXSTAGES + 1]; //!< The time spent in each stage.
+	bool writeFailed; //!< Set if some of the results couldn't be written.
+} ISC_util_replay_report;
+
+bool ISC_util_replay_run( const char *, uint8_t, ISC_util_replay_start, ISC_util_replay_end, void *, FILE *, ISC_util_replay_report * );
+
+#endif
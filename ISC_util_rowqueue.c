@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include "ISC_util_rowqueue.h"
 #include "ISC_util_assert.h"
+#include "ISC_util_common.h"
 
 /**
  * \brief Initialize a row queue.
@@ -158,7 +159,7 @@ __attribute__((gnu_inline)) inline void ISC_util_rowqueue_end( ISC_util_rowqueue
 	{
 		// Pop all rows from the rowqueue and free the rows as you get 
 		// them.
-		free(ISC_util_rowqueue_process( queue ));
+		FreeRow(ISC_util_rowqueue_process( queue ));
 	}
 	// Free the queue itself.
 	free( queue );	
@@ -0,0 +1,102 @@
+/***************************************************************************//**
+ * \file ISC_util_sink.c
+ * \brief Byte sinks for encoders.
+ *
+ * ISC_util_sink.c contains the file and memory sinks and the function that
+ * writes to any sink.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ISC_util_sink.h"
+
+// Write bytes to a FILE.  On the CMUcam3, stdout is the serial port.
+__attribute__((gnu_inline)) inline static bool FileWrite( void *target, const uint8_t *data, uint32_t length )
+{
+	return fwrite( data, 1, length, (FILE *)target ) == length;
+}
+
+// Copy bytes into a block of memory, if they fit.
+__attribute__((gnu_inline)) inline static bool MemoryWrite( void *target, const uint8_t *data, uint32_t length )
+{
+	ISC_util_sink_memory *memory = target;
+
+	if ( length > memory->size - memory->used )
+		return false;
+
+	memcpy( memory->data + memory->used, data, length );
+	memory->used += length;
+	return true;
+}
+
+/**
+ * \brief Makes a sink that writes to a file.
+ *
+ * \param fp The file pointer.  Use stdout for the serial port.
+ * \return The sink.
+ */
+__attribute__((gnu_inline)) inline ISC_util_sink ISC_util_sink_fromfile( FILE *fp )
+{
+	return ISC_util_sink_fromfunction( FileWrite, fp );
+}
+
+/**
+ * \brief Makes a sink that fills a block of memory.
+ *
+ * \param memory The block to fill.  It has to stay around as long as the sink is used.
+ * \return The sink.
+ */
+__attribute__((gnu_inline)) inline ISC_util_sink ISC_util_sink_frommemory( ISC_util_sink_memory *memory )
+{
+	return ISC_util_sink_fromfunction( MemoryWrite, memory );
+}
+
+/**
+ * \brief Makes a sink that hands the bytes to a function.
+ *
+ * \param write The function to call with each block of bytes.
+ * \param target Passed to the function untouched.
+ * \return The sink.
+ */
+__attribute__((gnu_inline)) inline ISC_util_sink ISC_util_sink_fromfunction( ISC_util_sink_function write, void *target )
+{
+	ISC_util_sink sink;
+
+	sink.write = write;
+	sink.target = target;
+	return sink;
+}
+
+/**
+ * \brief Writes bytes to a sink.
+ *
+ * \param sink The sink.
+ * \param data The bytes.
+ * \param length How many bytes there are.
+ * \return TRUE if the sink took all of them.
+ */
+__attribute__((gnu_inline)) inline bool ISC_util_sink_write( ISC_util_sink *sink, const uint8_t *data, uint32_t length )
+{
+	if ( length == 0 )
+		return true;
+	return sink->write( sink->target, data, length );
+}
+
+/**
+ * \brief Pushes out whatever a sink has buffered.
+ *
+ * For a file sink this is fflush, so the bytes reach the card or the serial
+ * port.  Memory and function sinks don't buffer anything of their own.
+ *
+ * \param sink The sink.
+ * \return TRUE unless flushing the file failed.
+ */
+__attribute__((gnu_inline)) inline bool ISC_util_sink_flush( ISC_util_sink *sink )
+{
+	if ( sink->write == FileWrite )
+		return fflush( (FILE *)sink->target ) == 0;
+	return true;
+}
@@ -0,0 +1,57 @@
+/***************************************************************************//**
+ * \file ISC_util_sink.h
+ * \brief Byte sinks for encoders.
+ *
+ * ISC_util_sink.h describes a small "somewhere to put bytes" type that the
+ * encoding out-modules can write to, so they don't care whether the bytes go
+ * to a file on the SD card, the serial port, a buffer in memory, or a function
+ * the user wrote.
+*******************************************************************************/
+
+#ifndef _ISC_UTIL_SINK_H_
+#define _ISC_UTIL_SINK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * \brief A function that takes bytes.
+ *
+ * It gets the target the sink was made with, the bytes and how many there
+ * are.  It should send back FALSE if the bytes couldn't all be taken.
+ */
+typedef bool (*ISC_util_sink_function)( void *target, const uint8_t *data, uint32_t length );
+
+/**
+ * \brief Somewhere to put bytes.
+ *
+ * Make one with ISC_util_sink_fromfile, ISC_util_sink_frommemory or
+ * ISC_util_sink_fromfunction.  It's small, so pass it around by value.
+ */
+typedef struct
+{
+	ISC_util_sink_function write; //!< The function that takes the bytes.
+	void *target; //!< What the function writes to.
+} ISC_util_sink;
+
+/**
+ * \brief A block of memory for a memory sink to fill.
+ *
+ * Set data and size, and set used to 0 before writing.  Writes that don't
+ * fit are refused and nothing past size is touched.
+ */
+typedef struct
+{
+	uint8_t *data; //!< Where to put the bytes.
+	uint32_t size; //!< How many bytes fit.
+	uint32_t used; //!< How many bytes have been written.
+} ISC_util_sink_memory;
+
+ISC_util_sink ISC_util_sink_fromfile( FILE * );
+ISC_util_sink ISC_util_sink_frommemory( ISC_util_sink_memory * );
+ISC_util_sink ISC_util_sink_fromfunction( ISC_util_sink_function, void * );
+bool ISC_util_sink_write( ISC_util_sink *, const uint8_t *, uint32_t );
+bool ISC_util_sink_flush( ISC_util_sink * );
+
+#endif
@@ -0,0 +1,150 @@
+/***************************************************************************//**
+ * \file ISC_util_spscqueue.c
+ * \brief Lock-free row queue between two threads.
+ *
+ * ISC_util_spscqueue.c contains the push and pop functions of the queue.  The
+ * blocking versions spin a little and then give the core away, since on the
+ * PC the other thread may need this core to make progress.
+*******************************************************************************/
+
+#ifndef VIRTUAL_CAM
+#error "ISC_util_spscqueue is for threaded pipelines on the PC; build it with VIRTUAL_CAM."
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include "ISC_util_spscqueue.h"
+#include "ISC_util_assert.h"
+
+// How many times a blocked push or pop checks again before yielding.
+#define SPINS 64
+
+/**
+ * \brief Creates a new ISC_util_spscqueue.
+ *
+ * \param capacity How many rows the queue holds before push has to wait.  Rounded up to a power of two.
+ * \return The new queue.
+ */
+__attribute__((gnu_inline)) inline ISC_util_spscqueue *ISC_util_spscqueue_start( uint32_t capacity )
+{
+	ISC_util_spscqueue *queue;
+	uint32_t size = 1;
+
+	while ( size < capacity )
+		size <<= 1;
+
+	// MEMORY IS ALLOCATED HERE.
+	queue = malloc( sizeof( ISC_util_spscqueue ) );
+	if ( !queue )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_util_spscqueue!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	queue->slots = malloc( size * sizeof( uint8_t * ) );
+	if ( !queue->slots )
+		ISC_util_assert_message( "FATAL: Not enough memory for the ISC_util_spscqueue slots!" );
+
+	queue->capacity = size;
+	queue->mask = size - 1;
+	queue->tail = 0;
+	queue->headCache = 0;
+	queue->head = 0;
+	queue->tailCache = 0;
+
+	return queue;
+}
+
+/**
+ * \brief Adds a row to the queue if there is room.  Producer only.
+ *
+ * \param queue The queue.
+ * \param row The row.
+ * \return TRUE if the row was added, FALSE if the queue was full.
+ */
+__attribute__((gnu_inline)) inline bool ISC_util_spscqueue_trypush( ISC_util_spscqueue *queue, uint8_t *row )
+{
+	uint32_t tail = queue->tail;
+
+	if ( tail - queue->headCache == queue->capacity )
+	{
+		queue->headCache = __atomic_load_n( &queue->head, __ATOMIC_ACQUIRE );
+		if ( tail - queue->headCache == queue->capacity )
+			return false;
+	}
+
+	queue->slots[tail & queue->mask] = row;
+	__atomic_store_n( &queue->tail, tail + 1, __ATOMIC_RELEASE );
+	return true;
+}
+
+/**
+ * \brief Adds a row to the queue, waiting for room.  Producer only.
+ *
+ * \param queue The queue.
+ * \param row The row.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_spscqueue_push( ISC_util_spscqueue *queue, uint8_t *row )
+{
+	uint32_t spins = 0;
+
+	while ( !ISC_util_spscqueue_trypush( queue, row ) )
+		if ( ++spins % SPINS == 0 )
+			sched_yield();
+}
+
+/**
+ * \brief Takes the next row off the queue if there is one.  Consumer only.
+ *
+ * \param queue The queue.
+ * \param row Where to put the row.
+ * \return TRUE if a row was taken, FALSE if the queue was empty.
+ */
+__attribute__((gnu_inline)) inline bool ISC_util_spscqueue_trypop( ISC_util_spscqueue *queue, uint8_t **row )
+{
+	uint32_t head = queue->head;
+
+	if ( head == queue->tailCache )
+	{
+		queue->tailCache = __atomic_load_n( &queue->tail, __ATOMIC_ACQUIRE );
+		if ( head == queue->tailCache )
+			return false;
+	}
+
+	*row = queue->slots[head & queue->mask];
+	__atomic_store_n( &queue->head, head + 1, __ATOMIC_RELEASE );
+	return true;
+}
+
+/**
+ * \brief Takes the next row off the queue, waiting for one.  Consumer only.
+ *
+ * \param queue The queue.
+ * \return The row.
+ */
+__attribute__((gnu_inline)) inline uint8_t *ISC_util_spscqueue_pop( ISC_util_spscqueue *queue )
+{
+	uint8_t *row;
+	uint32_t spins = 0;
+
+	while ( !ISC_util_spscqueue_trypop( queue, &row ) )
+		if ( ++spins % SPINS == 0 )
+			sched_yield();
+	return row;
+}
+
+/**
+ * \brief Frees the queue.
+ *
+ * Rows still in the queue are not freed, since the queue can't tell which
+ * pointers are rows and which are markers the threads passed each other.
+ * Both threads have to be done with the queue.
+ *
+ * \param queue The queue.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_spscqueue_end( ISC_util_spscqueue *queue )
+{
+	free( queue->slots );
+	free( queue );
+}
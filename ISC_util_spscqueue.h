@@ -0,0 +1,60 @@
+/***************************************************************************//**
+ * \file ISC_util_spscqueue.h
+ * \brief Lock-free row queue between two threads.
+ *
+ * ISC_util_spscqueue.h describes a bounded queue of row pointers for passing
+ * rows from one thread to another without locks.  It is what connects the
+ * stages of ISC_util_pipeline when they run on their own threads.
+*******************************************************************************/
+
+#ifndef _ISC_UTIL_SPSCQUEUE_H_
+#define _ISC_UTIL_SPSCQUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * ISC_UTIL_SPSCQUEUE_LINE is the cache line size the queue keeps the two
+ * threads' counters apart by, so they don't slow each other down by writing
+ * to the same line.
+ */
+#define ISC_UTIL_SPSCQUEUE_LINE 64
+
+/**
+ * \brief A single-producer, single-consumer queue of rows.
+ *
+ * Exactly one thread may push and exactly one other thread may pop.  The
+ * producer only writes tail and the consumer only writes head, and each one
+ * publishes its counter with a release store after touching the slot, so no
+ * locks are needed.  Each side also keeps its own copy of the other side's
+ * counter and only reads the real one when the copy says the queue is full
+ * (or empty), which keeps the two cores from passing the counters back and
+ * forth on every row.
+ *
+ * The counters run freely and wrap; the capacity is a power of two so a slot
+ * is just the counter masked.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	uint32_t capacity; //!< How many rows fit.  A power of two.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	uint8_t **slots; //!< The rows in the queue.
+	uint32_t mask; //!< capacity - 1.
+	uint8_t padding0[ISC_UTIL_SPSCQUEUE_LINE]; //!< Keeps the producer's counters on their own line.
+	uint32_t tail; //!< The next slot to push to.  Only the producer writes it.
+	uint32_t headCache; //!< The producer's last look at head.
+	uint8_t padding1[ISC_UTIL_SPSCQUEUE_LINE]; //!< Keeps the consumer's counters on their own line.
+	uint32_t head; //!< The next slot to pop from.  Only the consumer writes it.
+	uint32_t tailCache; //!< The consumer's last look at tail.
+	uint8_t padding2[ISC_UTIL_SPSCQUEUE_LINE]; //!< Keeps the next allocation off the consumer's line.
+} ISC_util_spscqueue;
+
+ISC_util_spscqueue *ISC_util_spscqueue_start( uint32_t );
+bool ISC_util_spscqueue_trypush( ISC_util_spscqueue *, uint8_t * );
+void ISC_util_spscqueue_push( ISC_util_spscqueue *, uint8_t * );
+bool ISC_util_spscqueue_trypop( ISC_util_spscqueue *, uint8_t ** );
+uint8_t *ISC_util_spscqueue_pop( ISC_util_spscqueue * );
+void ISC_util_spscqueue_end( ISC_util_spscqueue * );
+
+#endif
@@ -0,0 +1,166 @@
+/***************************************************************************//**
+ * \file ISC_util_threadpool.c
+ * \brief A fixed set of worker threads for running jobs on the PC.
+ *
+ * ISC_util_threadpool.c contains the worker loop and the functions for
+ * submitting and waiting on jobs.  Jobs here are big (a band of a frame, or a
+ * whole frame), so a plain mutex-guarded list is all the pool needs.
+*******************************************************************************/
+
+#ifndef VIRTUAL_CAM
+#error "ISC_util_threadpool uses pthreads and only builds for virtual-cam on the PC."
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "ISC_util_threadpool.h"
+#include "ISC_util_assert.h"
+
+// The loop each worker thread runs until the pool ends.
+__attribute__((gnu_inline)) inline static void *WorkerThread( void *argument )
+{
+	ISC_util_threadpool *pool = argument;
+	ISC_util_threadpool_task *task;
+
+	pthread_mutex_lock( &pool->lock );
+	for ( ;; )
+	{
+		while ( !pool->first && !pool->stopping )
+			pthread_cond_wait( &pool->jobReady, &pool->lock );
+		if ( !pool->first )
+			break;
+
+		task = pool->first;
+		pool->first = task->next;
+		if ( !pool->first )
+			pool->last = NULL;
+		pthread_mutex_unlock( &pool->lock );
+
+		task->job( task->argument );
+		free( task );
+
+		pthread_mutex_lock( &pool->lock );
+		pool->outstanding--;
+		if ( pool->outstanding == 0 )
+			pthread_cond_broadcast( &pool->jobsDone );
+	}
+	pthread_mutex_unlock( &pool->lock );
+	return NULL;
+}
+
+/**
+ * \brief Starts a thread pool.
+ *
+ * \param threadCount How many worker threads to start.  At least 1; the number of cores is a good choice.
+ * \return The new pool.
+ */
+__attribute__((gnu_inline)) inline ISC_util_threadpool *ISC_util_threadpool_start( uint8_t threadCount )
+{
+	ISC_util_threadpool *pool;
+	uint8_t i;
+
+	if ( threadCount == 0 )
+		ISC_util_assert_message( "FATAL: An ISC_util_threadpool needs at least one thread!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	pool = malloc( sizeof( ISC_util_threadpool ) );
+	if ( !pool )
+		ISC_util_assert_message( "FATAL: Not enough memory to allocate an ISC_util_threadpool!" );
+
+	// MEMORY IS ALLOCATED HERE.
+	pool->threads = malloc( threadCount * sizeof( pthread_t ) );
+	if ( !pool->threads )
+		ISC_util_assert_message( "FATAL: Not enough memory for the ISC_util_threadpool threads!" );
+
+	pool->threadCount = threadCount;
+	pool->first = NULL;
+	pool->last = NULL;
+	pool->outstanding = 0;
+	pool->stopping = false;
+	pthread_mutex_init( &pool->lock, NULL );
+	pthread_cond_init( &pool->jobReady, NULL );
+	pthread_cond_init( &pool->jobsDone, NULL );
+
+	for ( i = 0; i < threadCount; i++ )
+		if ( pthread_create( pool->threads + i, NULL, WorkerThread, pool ) != 0 )
+			ISC_util_assert_message( "FATAL: Couldn't start an ISC_util_threadpool thread!" );
+
+	return pool;
+}
+
+/**
+ * \brief Hands a job to the pool.
+ *
+ * The job starts as soon as a thread is free.
+ *
+ * \param pool The pool.
+ * \param job The function to run.
+ * \param argument What to pass it.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_threadpool_submit( ISC_util_threadpool *pool, ISC_util_threadpool_job job, void *argument )
+{
+	ISC_util_threadpool_task *task;
+
+	// MEMORY IS ALLOCATED HERE.
+	task = malloc( sizeof( ISC_util_threadpool_task ) );
+	if ( !task )
+		ISC_util_assert_message( "FATAL: Not enough memory to submit an ISC_util_threadpool job!" );
+	task->job = job;
+	task->argument = argument;
+	task->next = NULL;
+
+	pthread_mutex_lock( &pool->lock );
+	if ( pool->last )
+		pool->last->next = task;
+	else
+		pool->first = task;
+	pool->last = task;
+	pool->outstanding++;
+	pthread_cond_signal( &pool->jobReady );
+	pthread_mutex_unlock( &pool->lock );
+}
+
+/**
+ * \brief Waits until every job submitted so far has finished.
+ *
+ * Everything the jobs wrote is visible to the caller afterwards.
+ *
+ * \param pool The pool.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_threadpool_wait( ISC_util_threadpool *pool )
+{
+	pthread_mutex_lock( &pool->lock );
+	while ( pool->outstanding > 0 )
+		pthread_cond_wait( &pool->jobsDone, &pool->lock );
+	pthread_mutex_unlock( &pool->lock );
+}
+
+/**
+ * \brief Ends the pool.
+ *
+ * Jobs already submitted are finished first, then the threads are joined and
+ * the pool is freed.
+ *
+ * \param pool The pool.
+ */
+__attribute__((gnu_inline)) inline void ISC_util_threadpool_end( ISC_util_threadpool *pool )
+{
+	uint8_t i;
+
+	pthread_mutex_lock( &pool->lock );
+	pool->stopping = true;
+	pthread_cond_broadcast( &pool->jobReady );
+	pthread_mutex_unlock( &pool->lock );
+
+	for ( i = 0; i < pool->threadCount; i++ )
+		pthread_join( pool->threads[i], NULL );
+
+	pthread_mutex_destroy( &pool->lock );
+	pthread_cond_destroy( &pool->jobReady );
+	pthread_cond_destroy( &pool->jobsDone );
+	free( pool->threads );
+	free( pool );
+}
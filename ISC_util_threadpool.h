@@ -0,0 +1,60 @@
+/***************************************************************************//**
+ * \file ISC_util_threadpool.h
+ * \brief A fixed set of worker threads for running jobs on the PC.
+ *
+ * ISC_util_threadpool.h describes a pool of threads that take jobs (a
+ * function and its argument) off a shared list until the pool is ended.  The
+ * caller hands out a batch of jobs and then waits for all of them.  It uses
+ * pthreads, so it is only for virtual-cam builds on the PC.
+*******************************************************************************/
+
+#ifndef _ISC_UTIL_THREADPOOL_H_
+#define _ISC_UTIL_THREADPOOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * \brief A job for the pool.
+ */
+typedef void (*ISC_util_threadpool_job)( void *argument );
+
+/**
+ * \brief One job waiting for a thread.
+ */
+typedef struct ISC_util_threadpool_task
+{
+	ISC_util_threadpool_job job; //!< What to run.
+	void *argument; //!< What to run it on.
+	struct ISC_util_threadpool_task *next; //!< The job after this one.
+} ISC_util_threadpool_task;
+
+/**
+ * \brief A pool of worker threads.
+ *
+ * Jobs run in the order they were submitted, but as many at a time as there
+ * are threads, so they may finish in any order.  A job must not touch
+ * anything another job of the same batch is using.
+ */
+typedef struct
+{
+	//----------------------------USER-DEFINED----------------------------------
+	uint8_t threadCount; //!< How many worker threads there are.
+	//----------------------------SYSTEM-HANDLED--------------------------------
+	pthread_t *threads; //!< The worker threads.
+	pthread_mutex_t lock; //!< Guards everything below.
+	pthread_cond_t jobReady; //!< Signalled when a job is added or the pool is ending.
+	pthread_cond_t jobsDone; //!< Signalled when the last outstanding job finishes.
+	ISC_util_threadpool_task *first; //!< The next job to run.
+	ISC_util_threadpool_task *last; //!< The last job submitted.
+	uint32_t outstanding; //!< Jobs submitted and not yet finished.
+	bool stopping; //!< Set by ISC_util_threadpool_end.
+} ISC_util_threadpool;
+
+ISC_util_threadpool *ISC_util_threadpool_start( uint8_t );
+void ISC_util_threadpool_submit( ISC_util_threadpool *, ISC_util_threadpool_job, void * );
+void ISC_util_threadpool_wait( ISC_util_threadpool * );
+void ISC_util_threadpool_end( ISC_util_threadpool * );
+
+#endif
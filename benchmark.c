@@ -0,0 +1,916 @@
+// ISC Pipeline Benchmark Program
+// Derived from main.c.
+//
+// This program times ISC Pipeline modules on the CMUcam3 (or virtual-cam) and
+// prints the results over the serial port.  To use it, put benchmark.c in
+// place of main.c in CSOURCES in the Makefile.
+//
+// Most modules can't be timed on their own, since there isn't enough RAM to
+// keep a whole frame around.  Instead, each benchmark runs a full frame
+// through ISC_in_cmucam with and without the module and reports the
+// difference, so the time spent reading the FIFO is taken out.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cc3.h>
+
+#include "ISC_util_assert.h"
+#include "ISC_util_common.h"
+#include "ISC_in_cmucam.h"
+#include "ISC_out_histogram.h"
+#include "ISC_out_classify.h"
+#include "ISC_out_tilestats.h"
+#include "ISC_out_ppm.h"
+#include "ISC_out_jpeg.h"
+#include "ISC_out_png.h"
+#include "ISC_out_mjpeg.h"
+#include "ISC_out_framelog.h"
+#include "ISC_out_y4m.h"
+#include "ISC_process_convolution.h"
+#include "ISC_process_tee.h"
+#ifdef VIRTUAL_CAM
+#include "ISC_util_pipeline.h"
+#include "ISC_util_bands.h"
+#include "ISC_util_threadpool.h"
+#endif
+
+// How many frames each measurement is averaged over.
+#ifndef BENCH_FRAMES
+#define BENCH_FRAMES 20
+#endif
+
+// Where the file-writing benchmarks write to.
+#ifndef BENCH_FILE
+#ifdef VIRTUAL_CAM
+#define BENCH_FILE "bench.out"
+#else
+#define BENCH_FILE "c:/bench.out"
+#endif
+#endif
+
+void DoFullBenchmark( void );
+void PrintResult( const char *, cc3_camera_resolution_t, uint32_t, uint32_t );
+uint32_t BenchBaseline( cc3_camera_resolution_t );
+void BenchHistogram( cc3_camera_resolution_t, uint32_t );
+void BenchJointHistogram( cc3_camera_resolution_t, uint32_t );
+void BenchSampledHistogram( cc3_camera_resolution_t, uint32_t );
+void BenchHistogramModes( cc3_camera_resolution_t, uint32_t, uint8_t, bool );
+void BenchClassify( cc3_camera_resolution_t, uint32_t, bool );
+void BenchTileStats( cc3_camera_resolution_t, uint32_t );
+void BenchPPM( cc3_camera_resolution_t, uint32_t, uint8_t );
+void BenchPPMByteAtATime( cc3_camera_resolution_t, uint32_t );
+void BenchJPEG( cc3_camera_resolution_t, uint32_t, const char *, const ISC_out_jpeg_profile * );
+void BenchPNG( cc3_camera_resolution_t, uint32_t, const char *, const ISC_out_png_profile * );
+void BenchMJPEG( cc3_camera_resolution_t, uint32_t );
+void BenchFrameLog( cc3_camera_resolution_t, uint32_t );
+void BenchY4M( cc3_camera_resolution_t, uint32_t, const char *, ISC_out_y4m_chroma );
+void BenchTee( cc3_camera_resolution_t, uint32_t, bool );
+void BenchPrefetch( cc3_camera_resolution_t );
+#ifdef VIRTUAL_CAM
+void BenchPipeline( cc3_camera_resolution_t, uint8_t );
+void BenchBands( cc3_camera_resolution_t, uint8_t, uint8_t );
+#endif
+
+int main (void)
+{
+	#ifndef VIRTUAL_CAM
+	int32_t val;
+	#endif
+
+  	// configure uarts
+ 	cc3_uart_init (0, CC3_UART_RATE_115200, CC3_UART_MODE_8N1, CC3_UART_BINMODE_BINARY);
+  	// Make it so that stdout and stdin are not buffered
+  	#ifndef VIRTUAL_CAM
+  	val = setvbuf (stdout, NULL, _IONBF, 0);
+	#endif
+
+  	cc3_camera_init ();
+
+  	cc3_camera_set_colorspace (CC3_COLORSPACE_RGB);
+  	cc3_camera_set_auto_white_balance (true);
+  	cc3_camera_set_auto_exposure (true);
+
+  	cc3_timer_wait_ms (1000);
+	cc3_camera_set_power_state (true);
+
+	DoFullBenchmark();
+
+	#ifndef VIRTUAL_CAM
+	while (1);
+	#endif
+
+  	return 0;
+}
+
+void DoFullBenchmark( void )
+{
+	uint32_t baseline;
+
+	printf( "ISC Pipeline benchmark, %d frames per test.\n", BENCH_FRAMES );
+
+	cc3_camera_set_resolution( CC3_CAMERA_RESOLUTION_LOW );
+	baseline = BenchBaseline( CC3_CAMERA_RESOLUTION_LOW );
+	printf( "LOW: in_cmucam only: %lu ms/frame\n", (unsigned long)baseline / BENCH_FRAMES );
+	BenchHistogram( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchJointHistogram( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchSampledHistogram( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_LOW, baseline, 4, false );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_LOW, baseline, 4, true );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_LOW, baseline, 16, false );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_LOW, baseline, 16, true );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_LOW, baseline, 64, false );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_LOW, baseline, 64, true );
+	BenchClassify( CC3_CAMERA_RESOLUTION_LOW, baseline, false );
+	BenchClassify( CC3_CAMERA_RESOLUTION_LOW, baseline, true );
+	BenchTileStats( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchPPMByteAtATime( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchPPM( CC3_CAMERA_RESOLUTION_LOW, baseline, 0 );
+	BenchPPM( CC3_CAMERA_RESOLUTION_LOW, baseline, 8 );
+	BenchJPEG( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_jpeg default", NULL );
+	BenchJPEG( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_jpeg fast preview", &ISC_out_jpeg_profile_fastpreview );
+	BenchJPEG( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_jpeg archive", &ISC_out_jpeg_profile_archive );
+	BenchMJPEG( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchFrameLog( CC3_CAMERA_RESOLUTION_LOW, baseline );
+	BenchY4M( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_y4m 4:2:0", ISC_OUT_Y4M_420 );
+	BenchY4M( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_y4m mono", ISC_OUT_Y4M_MONO );
+	BenchTee( CC3_CAMERA_RESOLUTION_LOW, baseline, false );
+	BenchTee( CC3_CAMERA_RESOLUTION_LOW, baseline, true );
+	BenchPrefetch( CC3_CAMERA_RESOLUTION_LOW );
+	BenchPNG( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_png default", NULL );
+	BenchPNG( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_png low memory", &ISC_out_png_profile_lowmemory );
+	BenchPNG( CC3_CAMERA_RESOLUTION_LOW, baseline, "out_png fast", &ISC_out_png_profile_fast );
+	#ifdef VIRTUAL_CAM
+	BenchPipeline( CC3_CAMERA_RESOLUTION_LOW, 1 );
+	BenchPipeline( CC3_CAMERA_RESOLUTION_LOW, 2 );
+	BenchPipeline( CC3_CAMERA_RESOLUTION_LOW, 3 );
+	BenchBands( CC3_CAMERA_RESOLUTION_LOW, 3, 1 );
+	BenchBands( CC3_CAMERA_RESOLUTION_LOW, 3, 4 );
+	#endif
+
+	cc3_camera_set_resolution( CC3_CAMERA_RESOLUTION_HIGH );
+	baseline = BenchBaseline( CC3_CAMERA_RESOLUTION_HIGH );
+	printf( "HIGH: in_cmucam only: %lu ms/frame\n", (unsigned long)baseline / BENCH_FRAMES );
+	BenchHistogram( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	BenchJointHistogram( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	BenchSampledHistogram( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_HIGH, baseline, 4, false );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_HIGH, baseline, 4, true );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_HIGH, baseline, 16, false );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_HIGH, baseline, 16, true );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_HIGH, baseline, 64, false );
+	BenchHistogramModes( CC3_CAMERA_RESOLUTION_HIGH, baseline, 64, true );
+	BenchClassify( CC3_CAMERA_RESOLUTION_HIGH, baseline, false );
+	BenchClassify( CC3_CAMERA_RESOLUTION_HIGH, baseline, true );
+	BenchTileStats( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	BenchPPMByteAtATime( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	BenchPPM( CC3_CAMERA_RESOLUTION_HIGH, baseline, 0 );
+	BenchPPM( CC3_CAMERA_RESOLUTION_HIGH, baseline, 8 );
+	BenchJPEG( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_jpeg default", NULL );
+	BenchJPEG( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_jpeg fast preview", &ISC_out_jpeg_profile_fastpreview );
+	BenchJPEG( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_jpeg archive", &ISC_out_jpeg_profile_archive );
+	BenchMJPEG( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	BenchFrameLog( CC3_CAMERA_RESOLUTION_HIGH, baseline );
+	// 4:2:0 at high resolution holds more chroma than the CMUcam3 has RAM.
+	#ifdef VIRTUAL_CAM
+	BenchY4M( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_y4m 4:2:0", ISC_OUT_Y4M_420 );
+	#endif
+	BenchY4M( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_y4m mono", ISC_OUT_Y4M_MONO );
+	BenchTee( CC3_CAMERA_RESOLUTION_HIGH, baseline, false );
+	BenchTee( CC3_CAMERA_RESOLUTION_HIGH, baseline, true );
+	BenchPrefetch( CC3_CAMERA_RESOLUTION_HIGH );
+	BenchPNG( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_png default", NULL );
+	BenchPNG( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_png low memory", &ISC_out_png_profile_lowmemory );
+	BenchPNG( CC3_CAMERA_RESOLUTION_HIGH, baseline, "out_png fast", &ISC_out_png_profile_fast );
+	#ifdef VIRTUAL_CAM
+	BenchPipeline( CC3_CAMERA_RESOLUTION_HIGH, 1 );
+	BenchPipeline( CC3_CAMERA_RESOLUTION_HIGH, 2 );
+	BenchPipeline( CC3_CAMERA_RESOLUTION_HIGH, 3 );
+	BenchBands( CC3_CAMERA_RESOLUTION_HIGH, 3, 1 );
+	BenchBands( CC3_CAMERA_RESOLUTION_HIGH, 3, 4 );
+	#endif
+}
+
+// Print one result line.  total and baseline are for all BENCH_FRAMES
+// frames, and the result is given in microseconds per frame so the numbers
+// for small modules don't round down to nothing.
+void PrintResult( const char *name, cc3_camera_resolution_t res, uint32_t total, uint32_t baseline )
+{
+	uint32_t moduleTime = total > baseline ? total - baseline : 0;
+
+	printf( "%s: %s: %lu us/frame\n", res == CC3_CAMERA_RESOLUTION_LOW ? "LOW" : "HIGH", name, (unsigned long)( moduleTime * 1000 / BENCH_FRAMES ) );
+}
+
+// Time pulling BENCH_FRAMES frames out of the camera and throwing them away.
+uint32_t BenchBaseline( cc3_camera_resolution_t res )
+{
+	ISC_in_cmucam *iic;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		while ( ISC_in_cmucam_running( iic ) )
+			FreeRow( ISC_in_cmucam_process( iic ) );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	return total;
+}
+
+// Time the 16x16 tile, 4 bin histogram used by main.c.
+void BenchHistogram( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_histogram *ihs;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, 4 );
+		while ( ISC_out_histogram_running( ihs ) )
+			ISC_out_histogram_feed( ihs, ISC_in_cmucam_process( iic ) );
+		ISC_out_histogram_end( ihs );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( "out_histogram 16x16x4", res, total, baseline );
+}
+
+// Time the same tiles in joint mode, with 2-byte counters.
+void BenchJointHistogram( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_histogram *ihs;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ihs = ISC_out_histogram_start_joint( ISC_in_cmucam_context( iic ), 16, 16, 4, 2 );
+		while ( ISC_out_histogram_running( ihs ) )
+			ISC_out_histogram_feed( ihs, ISC_in_cmucam_process( iic ) );
+		ISC_out_histogram_end( ihs );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( "out_histogram joint 16x16x4 (16-bit)", res, total, baseline );
+}
+
+// Time the main.c histogram counting one pixel in four (every other pixel of
+// every other row, jittered), with the unwanted rows skipped at the source.
+void BenchSampledHistogram( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_histogram *ihs;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, 4 );
+		ISC_out_histogram_sampling( ihs, 2, 2, true );
+		while ( ISC_out_histogram_running( ihs ) )
+		{
+			if ( ISC_out_histogram_wantrow( ihs ) )
+				ISC_out_histogram_feed( ihs, ISC_in_cmucam_process( iic ) );
+			else
+			{
+				ISC_in_cmucam_skip( iic );
+				ISC_out_histogram_skip( ihs );
+			}
+		}
+		ISC_out_histogram_end( ihs );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( "out_histogram 16x16x4 sampled 1/4", res, total, baseline );
+}
+
+// Time finding the modes of every tile, the way ISC_out_classify does, with
+// and without ISC_out_histogram_trackmodes.
+void BenchHistogramModes( cc3_camera_resolution_t res, uint32_t baseline, uint8_t colorBins, bool track )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_histogram *ihs;
+	uint32_t start, total = 0;
+	uint16_t frame;
+	uint8_t tile, modes[3];
+	char name[48];
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, colorBins );
+		ISC_out_histogram_trackmodes( ihs, track );
+		while ( ISC_out_histogram_running( ihs ) )
+		{
+			ISC_out_histogram_feed( ihs, ISC_in_cmucam_process( iic ) );
+			if ( ihs->linesLeft == 0 )
+				for ( tile = 0; tile < ihs->Xsubdivisions; tile++ )
+					ISC_out_histogram_getmodes( ihs, tile, modes );
+		}
+		ISC_out_histogram_end( ihs );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	sprintf( name, "out_histogram 16x16x%u + getmodes%s", colorBins, track ? ", tracked" : "" );
+	PrintResult( name, res, total, baseline );
+}
+
+// Time main.c's classifier, with and without mode tracking.
+void BenchClassify( cc3_camera_resolution_t res, uint32_t baseline, bool track )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_classify *ico;
+	uint8_t table[64];
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	ISC_out_classify_table_igvc( table );
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ico = ISC_out_classify_start( ISC_in_cmucam_context( iic ), 16, 16, 4, table );
+		ISC_out_classify_trackmodes( ico, track );
+		while ( ISC_out_classify_running( ico ) )
+			ISC_out_classify_feed( ico, ISC_in_cmucam_process( iic ) );
+		ISC_out_classify_end( ico );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( track ? "out_classify 16x16x4, tracked" : "out_classify 16x16x4", res, total, baseline );
+}
+
+// Time 16x16 tile statistics, to compare with out_histogram.
+void BenchTileStats( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_tilestats *its;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		its = ISC_out_tilestats_start( ISC_in_cmucam_context( iic ), 16, 16 );
+		while ( ISC_out_tilestats_running( its ) )
+			ISC_out_tilestats_feed( its, ISC_in_cmucam_process( iic ) );
+		ISC_out_tilestats_end( its );
+		ISC_in_cmucam_end( iic );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( "out_tilestats 16x16", res, total, baseline );
+}
+
+// Time writing frames to BENCH_FILE with ISC_out_ppm.
+void BenchPPM( cc3_camera_resolution_t res, uint32_t baseline, uint8_t bufferRows )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_ppm *ipw;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+	char name[40];
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ipw = ISC_out_ppm_start( ISC_in_cmucam_context( iic ), fp, bufferRows );
+		while ( ISC_out_ppm_running( ipw ) )
+			ISC_out_ppm_feed( ipw, ISC_in_cmucam_process( iic ) );
+		ISC_out_ppm_end( ipw );
+		ISC_in_cmucam_end( iic );
+		fflush( fp );
+		total += cc3_timer_get_current_ms() - start;
+	}
+	fclose( fp );
+
+	sprintf( name, "out_ppm, %u buffered rows", bufferRows );
+	PrintResult( name, res, total, baseline );
+}
+
+// Time writing frames the way ISC_out_ppm used to, one fputc per byte, to
+// compare against.
+void BenchPPMByteAtATime( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_util_imagecontext ic;
+	FILE *fp;
+	uint8_t *row;
+	uint32_t start, total = 0;
+	uint16_t frame, x;
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ic = ISC_in_cmucam_context( iic );
+		fprintf( fp, "P6\n%d %d\n255\n", ic.frame.width, ic.frame.height );
+		while ( ISC_in_cmucam_running( iic ) )
+		{
+			row = ISC_in_cmucam_process( iic );
+			for ( x = 0; x < ic.frame.width*3; x++ )
+				fputc( row[x], fp );
+			FreeRow( row );
+		}
+		ISC_in_cmucam_end( iic );
+		fflush( fp );
+		total += cc3_timer_get_current_ms() - start;
+	}
+	fclose( fp );
+
+	PrintResult( "fputc per byte (old out_ppm)", res, total, baseline );
+}
+
+// Time encoding frames to BENCH_FILE with an ISC_out_jpeg profile, and print
+// the average size of a frame too.
+void BenchJPEG( cc3_camera_resolution_t res, uint32_t baseline, const char *name, const ISC_out_jpeg_profile *profile )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_jpeg *ijc;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ijc = ISC_out_jpeg_start( ISC_in_cmucam_context( iic ), fp, profile );
+		while ( ISC_out_jpeg_running( ijc ) )
+			ISC_out_jpeg_feed( ijc, ISC_in_cmucam_process( iic ) );
+		ISC_out_jpeg_end( ijc );
+		ISC_in_cmucam_end( iic );
+		fflush( fp );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( name, res, total, baseline );
+	printf( "\t%lu bytes/frame\n", (unsigned long)ftell( fp ) / BENCH_FRAMES );
+	fclose( fp );
+}
+
+// Time encoding frames to BENCH_FILE with an ISC_out_png profile, and print
+// the average size of a frame too.
+void BenchPNG( cc3_camera_resolution_t res, uint32_t baseline, const char *name, const ISC_out_png_profile *profile )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_png *ipw;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ipw = ISC_out_png_start( ISC_in_cmucam_context( iic ), fp, profile );
+		while ( ISC_out_png_running( ipw ) )
+			ISC_out_png_feed( ipw, ISC_in_cmucam_process( iic ) );
+		ISC_out_png_end( ipw );
+		ISC_in_cmucam_end( iic );
+		fflush( fp );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	PrintResult( name, res, total, baseline );
+	printf( "\t%lu bytes/frame\n", (unsigned long)ftell( fp ) / BENCH_FRAMES );
+	fclose( fp );
+}
+
+// Time recording BENCH_FRAMES frames into one AVI with ISC_out_mjpeg and the
+// fast preview profile.  Compare with "out_jpeg fast preview", which makes a
+// new compressor for every frame.
+void BenchMJPEG( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_mjpeg *imj;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	fp = fopen( BENCH_FILE, "w+b" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	cc3_pixbuf_load();
+	start = cc3_timer_get_current_ms();
+	iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+	imj = ISC_out_mjpeg_start( ISC_in_cmucam_context( iic ), fp, ISC_OUT_MJPEG_AVI, 15, &ISC_out_jpeg_profile_fastpreview );
+	total += cc3_timer_get_current_ms() - start;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		if ( frame > 0 )
+			cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		if ( frame > 0 )
+		{
+			ISC_in_cmucam_reset( iic );
+			ISC_out_mjpeg_reset( imj );
+		}
+		while ( ISC_out_mjpeg_running( imj ) )
+			ISC_out_mjpeg_feed( imj, ISC_in_cmucam_process( iic ) );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	start = cc3_timer_get_current_ms();
+	ISC_out_mjpeg_end( imj );
+	ISC_in_cmucam_end( iic );
+	total += cc3_timer_get_current_ms() - start;
+
+	PrintResult( "out_mjpeg AVI, fast preview", res, total, baseline );
+	printf( "\t%lu bytes/frame\n", (unsigned long)ftell( fp ) / BENCH_FRAMES );
+	fclose( fp );
+}
+
+// Time logging BENCH_FRAMES raw frames with ISC_out_framelog.  Compare with
+// "out_ppm, 8 buffered rows", which writes the same pixels.
+void BenchFrameLog( cc3_camera_resolution_t res, uint32_t baseline )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_framelog *iol;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	cc3_pixbuf_load();
+	start = cc3_timer_get_current_ms();
+	iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+	iol = ISC_out_framelog_start( ISC_in_cmucam_context( iic ), fp );
+	total += cc3_timer_get_current_ms() - start;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		if ( frame > 0 )
+			cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		if ( frame > 0 )
+		{
+			ISC_in_cmucam_reset( iic );
+			ISC_out_framelog_reset( iol );
+		}
+		while ( ISC_out_framelog_running( iol ) )
+			ISC_out_framelog_feed( iol, ISC_in_cmucam_process( iic ) );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	start = cc3_timer_get_current_ms();
+	ISC_out_framelog_end( iol );
+	ISC_in_cmucam_end( iic );
+	total += cc3_timer_get_current_ms() - start;
+	fclose( fp );
+
+	PrintResult( "out_framelog", res, total, baseline );
+}
+
+// Time streaming BENCH_FRAMES frames to BENCH_FILE with ISC_out_y4m.
+void BenchY4M( cc3_camera_resolution_t res, uint32_t baseline, const char *name, ISC_out_y4m_chroma chroma )
+{
+	ISC_in_cmucam *iic;
+	ISC_out_y4m *iy4;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	cc3_pixbuf_load();
+	start = cc3_timer_get_current_ms();
+	iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+	iy4 = ISC_out_y4m_start( ISC_in_cmucam_context( iic ), ISC_util_sink_fromfile( fp ), chroma, 15 );
+	total += cc3_timer_get_current_ms() - start;
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		if ( frame > 0 )
+			cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		if ( frame > 0 )
+		{
+			ISC_in_cmucam_reset( iic );
+			ISC_out_y4m_reset( iy4 );
+		}
+		while ( ISC_out_y4m_running( iy4 ) )
+			ISC_out_y4m_feed( iy4, ISC_in_cmucam_process( iic ) );
+		total += cc3_timer_get_current_ms() - start;
+	}
+
+	start = cc3_timer_get_current_ms();
+	ISC_out_y4m_end( iy4 );
+	ISC_in_cmucam_end( iic );
+	fflush( fp );
+	total += cc3_timer_get_current_ms() - start;
+	fclose( fp );
+
+	PrintResult( name, res, total, baseline );
+}
+
+// Time histogramming and logging the same frames.  With useTee, both
+// out-modules get each row through an ISC_process_tee; without it, the
+// framelog gets a copy of every row, which is how it had to be done before.
+void BenchTee( cc3_camera_resolution_t res, uint32_t baseline, bool useTee )
+{
+	ISC_in_cmucam *iic;
+	ISC_process_tee *ipt = NULL;
+	ISC_out_histogram *ihs;
+	ISC_out_framelog *iol;
+	ISC_util_imagecontext context;
+	FILE *fp;
+	uint32_t start, total = 0;
+	uint16_t frame;
+	uint8_t *row, *copy;
+
+	fp = fopen( BENCH_FILE, "wb" );
+	if ( !fp )
+		ISC_util_assert_message( "FATAL: Couldn't open the benchmark file!" );
+
+	for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+	{
+		cc3_pixbuf_load();
+		start = cc3_timer_get_current_ms();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		context = ISC_in_cmucam_context( iic );
+		if ( useTee )
+			ipt = ISC_process_tee_start( context, 2 );
+		ihs = ISC_out_histogram_start( context, 16, 16, 4 );
+		iol = ISC_out_framelog_start( context, fp );
+		while ( ISC_out_histogram_running( ihs ) || ISC_out_framelog_running( iol ) )
+		{
+			row = ISC_in_cmucam_process( iic );
+			if ( useTee )
+			{
+				ISC_process_tee_feed( ipt, row );
+				ISC_out_histogram_feed( ihs, ISC_process_tee_process( ipt, 0 ) );
+				ISC_out_framelog_feed( iol, ISC_process_tee_process( ipt, 1 ) );
+			}
+			else
+			{
+				copy = NULL;
+				if ( row )
+				{
+					copy = MallocRow( &context );
+					memcpy( copy, row, context.frame.width * context.frame.channels );
+				}
+				ISC_out_histogram_feed( ihs, row );
+				ISC_out_framelog_feed( iol, copy );
+			}
+		}
+		ISC_out_framelog_end( iol );
+		ISC_out_histogram_end( ihs );
+		if ( useTee )
+			ISC_process_tee_end( ipt );
+		ISC_in_cmucam_end( iic );
+		fflush( fp );
+		total += cc3_timer_get_current_ms() - start;
+	}
+	fclose( fp );
+
+	PrintResult( useTee ? "out_histogram + out_framelog, tee" : "out_histogram + out_framelog, copied rows", res, total, baseline );
+}
+
+// Time a 3x3 blur and out_histogram over BENCH_FRAMES frames, loading the
+// frames included, first loading each frame after the last one is done and
+// then with ISC_in_cmucam prefetching.  On virtual-cam the prefetched frames
+// are loaded on another thread, so the difference is the load time hidden
+// behind the pipeline.
+void BenchPrefetch( cc3_camera_resolution_t res )
+{
+	ISC_in_cmucam *iic;
+	ISC_process_convolution *ipc;
+	ISC_process_convolution_kernel blur = { { { 1, 2, 1 }, { 2, 4, 2 }, { 1, 2, 1 } }, 3, 1, 1, 0 };
+	ISC_out_histogram *ihs;
+	uint32_t start, plain = 0, prefetched = 0;
+	uint16_t frame;
+	uint8_t prefetch;
+
+	for ( prefetch = 0; prefetch < 2; prefetch++ )
+	{
+		start = cc3_timer_get_current_ms();
+		cc3_pixbuf_load();
+		if ( prefetch )
+			iic = ISC_in_cmucam_start_prefetch( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		else
+			iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		ipc = ISC_process_convolution_start( ISC_in_cmucam_context( iic ), blur );
+		ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, 4 );
+
+		for ( frame = 0; frame < BENCH_FRAMES; frame++ )
+		{
+			if ( frame > 0 )
+			{
+				if ( !prefetch )
+					cc3_pixbuf_load();
+				ISC_in_cmucam_reset( iic );
+				ISC_process_convolution_reset( ipc );
+				ISC_out_histogram_reset( ihs );
+			}
+			while ( ISC_out_histogram_running( ihs ) )
+			{
+				ISC_process_convolution_feed( ipc, ISC_in_cmucam_process( iic ) );
+				ISC_out_histogram_feed( ihs, ISC_process_convolution_process( ipc ) );
+			}
+		}
+
+		ISC_out_histogram_end( ihs );
+		ISC_process_convolution_end( ipc );
+		ISC_in_cmucam_end( iic );
+		if ( prefetch )
+			prefetched = cc3_timer_get_current_ms() - start;
+		else
+			plain = cc3_timer_get_current_ms() - start;
+	}
+
+	if ( prefetched == 0 )
+		prefetched = 1;
+	printf( "%s: blur + out_histogram with loads: %lu us/frame, %lu us/frame prefetched (%lu.%02lux)\n",
+		res == CC3_CAMERA_RESOLUTION_LOW ? "LOW" : "HIGH",
+		(unsigned long)( plain * 1000 / BENCH_FRAMES ), (unsigned long)( prefetched * 1000 / BENCH_FRAMES ),
+		(unsigned long)( plain / prefetched ), (unsigned long)( plain * 100 / prefetched % 100 ) );
+}
+
+#ifdef VIRTUAL_CAM
+// Load the next frame; the in-module's reset hook for BenchPipeline.
+static void NextFrame( void *iic )
+{
+	cc3_pixbuf_load();
+	ISC_in_cmucam_reset( iic );
+}
+
+// Time in_cmucam, some 3x3 blurs and out_histogram run as one pipeline with
+// ISC_util_pipeline, first on one thread and then with a thread per stage.
+// Both times are for whole frames, cc3_pixbuf_load included, since in the
+// threaded run loading overlaps with the other stages.
+void BenchPipeline( cc3_camera_resolution_t res, uint8_t convolutions )
+{
+	ISC_in_cmucam *iic;
+	ISC_process_convolution *ipc[3];
+	ISC_process_convolution_kernel blur = { { { 1, 2, 1 }, { 2, 4, 2 }, { 1, 2, 1 } }, 3, 1, 1, 0 };
+	ISC_out_histogram *ihs;
+	ISC_util_stage stages[5];
+	uint32_t start, serial = 0, threaded = 0;
+	uint8_t i, threads;
+
+	for ( threads = 0; threads < 2; threads++ )
+	{
+		cc3_pixbuf_load();
+		iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+		stages[0] = ISC_UTIL_STAGE_IN( ISC_in_cmucam, iic );
+		stages[0].reset = NextFrame;
+		for ( i = 0; i < convolutions; i++ )
+		{
+			ipc[i] = ISC_process_convolution_start( ISC_in_cmucam_context( iic ), blur );
+			stages[i+1] = ISC_UTIL_STAGE_PROCESS( ISC_process_convolution, ipc[i] );
+			stages[i+1].reset = (ISC_util_stage_hook)ISC_process_convolution_reset;
+		}
+		ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, 4 );
+		stages[i+1] = ISC_UTIL_STAGE_OUT( ISC_out_histogram, ihs );
+		stages[i+1].reset = (ISC_util_stage_hook)ISC_out_histogram_reset;
+
+		start = cc3_timer_get_current_ms();
+		if ( threads )
+			ISC_util_pipeline_runthreaded( stages, convolutions + 2, BENCH_FRAMES, 8 );
+		else
+			ISC_util_pipeline_runserial( stages, convolutions + 2, BENCH_FRAMES );
+		if ( threads )
+			threaded = cc3_timer_get_current_ms() - start;
+		else
+			serial = cc3_timer_get_current_ms() - start;
+
+		ISC_out_histogram_end( ihs );
+		for ( i = 0; i < convolutions; i++ )
+			ISC_process_convolution_end( ipc[i] );
+		ISC_in_cmucam_end( iic );
+	}
+
+	if ( threaded == 0 )
+		threaded = 1;
+	printf( "%s: pipeline with %u blur stage%s: %lu us/frame serial, %lu us/frame threaded (%lu.%02lux)\n",
+		res == CC3_CAMERA_RESOLUTION_LOW ? "LOW" : "HIGH", convolutions, convolutions > 1 ? "s" : "",
+		(unsigned long)( serial * 1000 / BENCH_FRAMES ), (unsigned long)( threaded * 1000 / BENCH_FRAMES ),
+		(unsigned long)( serial / threaded ), (unsigned long)( serial * 100 / threaded % 100 ) );
+}
+
+// Time the same in_cmucam, 3x3 blurs and out_histogram pipeline as
+// BenchPipeline, first on one thread and then with the blurs run on
+// 2*threads horizontal bands at once with ISC_util_bands.
+void BenchBands( cc3_camera_resolution_t res, uint8_t convolutions, uint8_t threads )
+{
+	ISC_in_cmucam *iic;
+	ISC_process_convolution *ipc[3];
+	ISC_process_convolution_kernel blur = { { { 1, 2, 1 }, { 2, 4, 2 }, { 1, 2, 1 } }, 3, 1, 1, 0 };
+	ISC_out_histogram *ihs;
+	ISC_util_stage stages[5];
+	ISC_util_bandstage bandStages[3];
+	ISC_util_threadpool *pool;
+	uint32_t start, serial, banded;
+	uint8_t i;
+
+	// One thread, one module per stage.
+	cc3_pixbuf_load();
+	iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+	stages[0] = ISC_UTIL_STAGE_IN( ISC_in_cmucam, iic );
+	stages[0].reset = NextFrame;
+	for ( i = 0; i < convolutions; i++ )
+	{
+		ipc[i] = ISC_process_convolution_start( ISC_in_cmucam_context( iic ), blur );
+		stages[i+1] = ISC_UTIL_STAGE_PROCESS( ISC_process_convolution, ipc[i] );
+		stages[i+1].reset = (ISC_util_stage_hook)ISC_process_convolution_reset;
+	}
+	ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, 4 );
+	stages[i+1] = ISC_UTIL_STAGE_OUT( ISC_out_histogram, ihs );
+	stages[i+1].reset = (ISC_util_stage_hook)ISC_out_histogram_reset;
+
+	start = cc3_timer_get_current_ms();
+	ISC_util_pipeline_runserial( stages, convolutions + 2, BENCH_FRAMES );
+	serial = cc3_timer_get_current_ms() - start;
+
+	ISC_out_histogram_end( ihs );
+	for ( i = 0; i < convolutions; i++ )
+		ISC_process_convolution_end( ipc[i] );
+	ISC_in_cmucam_end( iic );
+
+	// The blurs in bands.
+	cc3_pixbuf_load();
+	iic = ISC_in_cmucam_start( ISC_util_imagecontext_getfromcurrent( res, CC3_COLORSPACE_RGB ) );
+	stages[0] = ISC_UTIL_STAGE_IN( ISC_in_cmucam, iic );
+	stages[0].reset = NextFrame;
+	for ( i = 0; i < convolutions; i++ )
+		bandStages[i] = ISC_util_bandstage_convolution( &blur );
+	ihs = ISC_out_histogram_start( ISC_in_cmucam_context( iic ), 16, 16, 4 );
+	stages[1] = ISC_UTIL_STAGE_OUT( ISC_out_histogram, ihs );
+	stages[1].reset = (ISC_util_stage_hook)ISC_out_histogram_reset;
+	pool = ISC_util_threadpool_start( threads );
+
+	start = cc3_timer_get_current_ms();
+	ISC_util_bands_run( pool, 2 * threads, stages, ISC_in_cmucam_context( iic ), bandStages, convolutions, stages + 1, BENCH_FRAMES );
+	banded = cc3_timer_get_current_ms() - start;
+
+	ISC_util_threadpool_end( pool );
+	ISC_out_histogram_end( ihs );
+	ISC_in_cmucam_end( iic );
+
+	if ( banded == 0 )
+		banded = 1;
+	printf( "%s: %u blur stage%s in %u bands on %u thread%s: %lu us/frame serial, %lu us/frame banded (%lu.%02lux)\n",
+		res == CC3_CAMERA_RESOLUTION_LOW ? "LOW" : "HIGH", convolutions, convolutions > 1 ? "s" : "",
+		2 * threads, threads, threads > 1 ? "s" : "",
+		(unsigned long)( serial * 1000 / BENCH_FRAMES ), (unsigned long)( banded * 1000 / BENCH_FRAMES ),
+		(unsigned long)( serial / banded ), (unsigned long)( serial * 100 / banded % 100 ) );
+}
+#endif
@@ -0,0 +1,155 @@
+/***************************************************************************//**
+ * \file ISC_host_histdecode.c
+ * \brief Host-side decoder for ISC_out_histogram binary exports.
+ *
+ * ISC_host_histdecode.c reads the binary tile-row records written by
+ * ISC_out_histogram_export_binary from a file or the serial port and prints
+ * them as the same text ISC_out_histogram_export_text would have.  Anything
+ * that isn't a record (like the prompt or other printf output from the
+ * camera) is skipped until the next pair of magic bytes.
+ *
+ * This runs on the PC, not the CMUcam3.  Build it with:
+ *     gcc -o histdecode ISC_host_histdecode.c
+ * and run it as:
+ *     histdecode [capturefile]
+ * If no file is given, it reads from stdin.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// These have to match ISC_out_histogram.h.
+#define ISC_OUT_HISTOGRAM_MAGIC0 'I'
+#define ISC_OUT_HISTOGRAM_MAGIC1 'H'
+#define ISC_OUT_HISTOGRAM_VERSION 1
+#define ISC_OUT_HISTOGRAM_FLAG_VARINT 0x01
+#define ISC_OUT_HISTOGRAM_FLAG_JOINT 0x02
+
+// Read one count.  Returns 0 if the stream ended in the middle of it.
+static int ReadCount( FILE *fp, int varint, uint32_t *count )
+{
+	int c, shift = 0, bytes;
+
+	*count = 0;
+	if ( varint )
+	{
+		do
+		{
+			if ( ( c = getc( fp ) ) == EOF || shift > 28 )
+				return 0;
+			*count |= (uint32_t)( c & 0x7F ) << shift;
+			shift += 7;
+		} while ( c & 0x80 );
+	}
+	else
+	{
+		for ( bytes = 0; bytes < 4; bytes++ )
+		{
+			if ( ( c = getc( fp ) ) == EOF )
+				return 0;
+			*count |= (uint32_t)c << ( 8 * bytes );
+		}
+	}
+	return 1;
+}
+
+// Decode one record after the magic bytes.  Returns 0 on a bad or cut-off
+// record.
+static int DecodeRecord( FILE *fp )
+{
+	int header[6], i;
+	int flags, ySub, xSubs, channels, colorBins;
+	int xSub, channel, bin, countsPerSub;
+	uint32_t *counts;
+
+	for ( i = 0; i < 6; i++ )
+		if ( ( header[i] = getc( fp ) ) == EOF )
+			return 0;
+
+	if ( header[0] != ISC_OUT_HISTOGRAM_VERSION )
+	{
+		fprintf( stderr, "histdecode: skipping record with version %d\n", header[0] );
+		return 0;
+	}
+	flags = header[1];
+	ySub = header[2];
+	xSubs = header[3];
+	channels = header[4];
+	colorBins = header[5];
+
+	// Joint records have a count for every combination of bins.
+	countsPerSub = channels * colorBins;
+	if ( flags & ISC_OUT_HISTOGRAM_FLAG_JOINT )
+		for ( countsPerSub = 1, i = 0; i < channels; i++ )
+			countsPerSub *= colorBins;
+
+	counts = malloc( sizeof(uint32_t) * countsPerSub );
+	if ( !counts )
+		return 0;
+
+	printf( "Y-SUBDIVISION %d:\n", ySub );
+	for ( xSub = 0; xSub < xSubs; xSub++ )
+	{
+		for ( i = 0; i < countsPerSub; i++ )
+		{
+			if ( !ReadCount( fp, flags & ISC_OUT_HISTOGRAM_FLAG_VARINT, &counts[i] ) )
+			{
+				free( counts );
+				return 0;
+			}
+		}
+
+		printf( "\tX-SUBDIVISION %d:\n", xSub );
+		if ( flags & ISC_OUT_HISTOGRAM_FLAG_JOINT )
+		{
+			for ( i = 0; i < countsPerSub; i++ )
+				if ( counts[i] )
+					printf( "\t\tCELL %d: %lu\n", i, (unsigned long)counts[i] );
+			continue;
+		}
+		for ( bin = 0; bin < colorBins; bin++ )
+		{
+			if ( channels == 3 )
+				printf( "\t\tRBIN %d: %lu, GBIN %d: %lu, BBIN %d: %lu\n", bin, (unsigned long)counts[bin], bin, (unsigned long)counts[colorBins+bin], bin, (unsigned long)counts[2*colorBins+bin] );
+			else
+			{
+				printf( "\t\t" );
+				for ( channel = 0; channel < channels; channel++ )
+					printf( "%sC%dBIN %d: %lu", channel ? ", " : "", channel, bin, (unsigned long)counts[channel*colorBins+bin] );
+				printf( "\n" );
+			}
+		}
+	}
+
+	free( counts );
+	return 1;
+}
+
+int main( int argc, char **argv )
+{
+	FILE *fp = stdin;
+	int c, last = EOF;
+
+	if ( argc > 1 && !( fp = fopen( argv[1], "rb" ) ) )
+	{
+		perror( argv[1] );
+		return 1;
+	}
+
+	// Hunt for the magic bytes, decode a record, repeat.
+	while ( ( c = getc( fp ) ) != EOF )
+	{
+		if ( last == ISC_OUT_HISTOGRAM_MAGIC0 && c == ISC_OUT_HISTOGRAM_MAGIC1 )
+		{
+			if ( !DecodeRecord( fp ) )
+				fprintf( stderr, "histdecode: bad or truncated record\n" );
+			c = EOF;
+		}
+		last = c;
+	}
+
+	if ( fp != stdin )
+		fclose( fp );
+	return 0;
+}
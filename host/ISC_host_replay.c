@@ -0,0 +1,232 @@
+/***************************************************************************//**
+ * \file ISC_host_replay.c
+ * \brief Replays frame logs through a convolution on every core of the PC.
+ *
+ * ISC_host_replay.c reads frame logs written by ISC_out_framelog, runs every
+ * frame through ISC_process_convolution with the kernel you pick, and writes
+ * the results as a new frame log, in the same order and with the same frame
+ * ids.  Frames are spread over worker threads with ISC_util_replay, and the
+ * frame rate and the time spent in each module are printed at the end.  It
+ * is the starting point for trying a new kernel or classifier on logged
+ * frames; change BuildPipeline to replay a different pipeline.
+ *
+ * This runs on the PC, not the CMUcam3.  Build it like a virtual-cam
+ * pipeline, with host/ISC_host_replay.c in place of main.c in CSOURCES, plus
+ * ISC_util_replay.c, ISC_util_threadpool.c, ISC_util_pipeline.c,
+ * ISC_util_spscqueue.c, ISC_in_framelog.c, ISC_out_framelog.c and
+ * ISC_process_convolution.c, and link with -lpthread.
+ * Run it as:
+ *     replay [-j workers] [-k none|blur|sharpen|edges] [-o out.log] log...
+ * Any log that is a directory stands for every file in it, in name order.
+ * Without -o, the new log goes to stdout.
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../ISC_util_replay.h"
+#include "../ISC_util_pipeline.h"
+#include "../ISC_in_framelog.h"
+#include "../ISC_out_framelog.h"
+#include "../ISC_process_convolution.h"
+
+// The kernels -k can pick.
+static const ISC_process_convolution_kernel blur = { { { 1, 2, 1 }, { 2, 4, 2 }, { 1, 2, 1 } }, 3, 1, 1, 0 };
+static const ISC_process_convolution_kernel sharpen = { { { 0, -1, 0 }, { -1, 5, -1 }, { 0, -1, 0 } }, 3, 1, 1, 0 };
+static const ISC_process_convolution_kernel edges = { { { -1, -1, -1 }, { -1, 8, -1 }, { -1, -1, -1 } }, 3, 1, 1, 0 };
+
+// The out-module of a worker's pipeline, and the log it is replaying, so
+// the new log can keep the old frame ids.
+typedef struct
+{
+	ISC_out_framelog *iol;
+	ISC_in_framelog *source;
+} LogOut;
+
+// Feed a row to the new log, giving each frame the id it had in the old one.
+static void LogOutFeed( void *module, uint8_t *row )
+{
+	LogOut *out = module;
+
+	if ( row && !out->iol->frameStarted )
+		out->iol->frameId = ISC_in_framelog_frameid( out->source );
+	ISC_out_framelog_feed( out->iol, row );
+}
+
+static bool LogOutRunning( void *module )
+{
+	return ISC_out_framelog_running( ( (LogOut *)module )->iol );
+}
+
+static void LogOutReset( void *module )
+{
+	ISC_out_framelog_reset( ( (LogOut *)module )->iol );
+}
+
+// Build one worker's pipeline: the convolution, if there is one, and the
+// new log.
+static uint8_t BuildPipeline( ISC_util_imagecontext context, FILE *fp, ISC_in_framelog *source, ISC_util_stage *stages, void *user )
+{
+	const ISC_process_convolution_kernel *kernel = user;
+	ISC_process_convolution *ipc;
+	LogOut *out;
+	uint8_t count = 0;
+
+	if ( kernel )
+	{
+		ipc = ISC_process_convolution_start( context, *kernel );
+		stages[count] = ISC_UTIL_STAGE_PROCESS( ISC_process_convolution, ipc );
+		stages[count++].reset = (ISC_util_stage_hook)ISC_process_convolution_reset;
+	}
+
+	out = malloc( sizeof( LogOut ) );
+	if ( !out )
+	{
+		fprintf( stderr, "replay: out of memory\n" );
+		exit( 1 );
+	}
+	out->iol = ISC_out_framelog_start( context, fp );
+	out->source = source;
+	stages[count] = ISC_util_stage_make( "ISC_out_framelog", out, LogOutFeed, NULL, LogOutRunning );
+	stages[count++].reset = LogOutReset;
+
+	return count;
+}
+
+// End one worker's pipeline.
+static void EndPipeline( ISC_util_stage *stages, uint8_t count, void *user )
+{
+	LogOut *out = stages[count-1].module;
+
+	(void)user;
+	if ( count > 1 )
+		ISC_process_convolution_end( stages[0].module );
+	ISC_out_framelog_end( out->iol );
+	free( out );
+}
+
+// Replay a log, or every file in a directory.
+static bool ReplayPath( const char *path, uint8_t workers, const ISC_process_convolution_kernel *kernel, FILE *fp, ISC_util_replay_report *report )
+{
+	struct dirent **names;
+	struct stat status;
+	char *file;
+	bool ok = true;
+	int count, i;
+
+	if ( stat( path, &status ) != 0 )
+	{
+		fprintf( stderr, "replay: can't find %s\n", path );
+		return false;
+	}
+	if ( !S_ISDIR( status.st_mode ) )
+	{
+		if ( ISC_util_replay_run( path, workers, BuildPipeline, EndPipeline, (void *)kernel, fp, report ) )
+			return true;
+		fprintf( stderr, "replay: couldn't replay %s\n", path );
+		return false;
+	}
+
+	count = scandir( path, &names, NULL, alphasort );
+	if ( count < 0 )
+	{
+		fprintf( stderr, "replay: can't read %s\n", path );
+		return false;
+	}
+	for ( i = 0; i < count; i++ )
+	{
+		file = malloc( strlen( path ) + strlen( names[i]->d_name ) + 2 );
+		if ( file && names[i]->d_name[0] != '.' )
+		{
+			sprintf( file, "%s/%s", path, names[i]->d_name );
+			if ( stat( file, &status ) == 0 && S_ISREG( status.st_mode ) )
+				ok = ReplayPath( file, workers, kernel, fp, report ) && ok;
+		}
+		free( file );
+		free( names[i] );
+	}
+	free( names );
+	return ok;
+}
+
+int main( int argc, char **argv )
+{
+	const ISC_process_convolution_kernel *kernel = &blur;
+	ISC_util_replay_report report;
+	long cores = sysconf( _SC_NPROCESSORS_ONLN );
+	uint8_t workers = cores > 0 ? ( cores > 255 ? 255 : cores ) : 1;
+	const char *outPath = NULL;
+	FILE *fp = stdout;
+	bool ok = true;
+	int option;
+	uint8_t i;
+
+	while ( ( option = getopt( argc, argv, "j:k:o:" ) ) != -1 )
+	{
+		switch ( option )
+		{
+		case 'j':
+			workers = atoi( optarg ) > 0 ? atoi( optarg ) : 1;
+			break;
+		case 'k':
+			if ( strcmp( optarg, "none" ) == 0 )
+				kernel = NULL;
+			else if ( strcmp( optarg, "blur" ) == 0 )
+				kernel = &blur;
+			else if ( strcmp( optarg, "sharpen" ) == 0 )
+				kernel = &sharpen;
+			else if ( strcmp( optarg, "edges" ) == 0 )
+				kernel = &edges;
+			else
+			{
+				fprintf( stderr, "replay: unknown kernel %s\n", optarg );
+				return 1;
+			}
+			break;
+		case 'o':
+			outPath = optarg;
+			break;
+		default:
+			fprintf( stderr, "usage: replay [-j workers] [-k none|blur|sharpen|edges] [-o out.log] log...\n" );
+			return 1;
+		}
+	}
+	if ( optind >= argc )
+	{
+		fprintf( stderr, "usage: replay [-j workers] [-k none|blur|sharpen|edges] [-o out.log] log...\n" );
+		return 1;
+	}
+	if ( outPath && !( fp = fopen( outPath, "wb" ) ) )
+	{
+		fprintf( stderr, "replay: can't write %s\n", outPath );
+		return 1;
+	}
+
+	memset( &report, 0, sizeof( report ) );
+	for ( ; optind < argc; optind++ )
+		ok = ReplayPath( argv[optind], workers, kernel, fp, &report ) && ok;
+	if ( fp != stdout && fclose( fp ) != 0 )
+		report.writeFailed = true;
+	if ( report.writeFailed )
+	{
+		fprintf( stderr, "replay: couldn't write all of the new log\n" );
+		ok = false;
+	}
+
+	fprintf( stderr, "%lu frames in %lu ms on %u worker%s: %lu.%01lu frames/s\n",
+		(unsigned long)report.frames, (unsigned long)report.milliseconds, workers, workers > 1 ? "s" : "",
+		(unsigned long)( report.milliseconds ? report.frames * 1000ULL / report.milliseconds : 0 ),
+		(unsigned long)( report.milliseconds ? report.frames * 10000ULL / report.milliseconds % 10 : 0 ) );
+	for ( i = 0; i < report.stageCount && report.frames > 0; i++ )
+		fprintf( stderr, "  %-24s %8lu ms %8lu us/frame\n", report.stageNames[i],
+			(unsigned long)( report.stageMicroseconds[i] / 1000 ),
+			(unsigned long)( report.stageMicroseconds[i] / report.frames ) );
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+/***************************************************************************//**
+ * \file ISC_host_serialdecode.c
+ * \brief Host-side receiver for ISC_out_serial frames.
+ *
+ * ISC_host_serialdecode.c reads the framed records sent by ISC_out_serial from
+ * a file or the serial port, checks the CRC of every frame, puts records that
+ * were split over several frames back together, and prints one line per
+ * record.  Bytes between frames (like printf output from the camera) are
+ * skipped, and frames with a bad CRC or missing frame numbers are reported.
+ * A bad frame may just have been a sync word that turned up in other data, so
+ * the search for the next frame starts again right after its sync word.
+ *
+ * This runs on the PC, not the CMUcam3.  Build it with:
+ *     gcc -o serialdecode ISC_host_serialdecode.c
+ * and run it as:
+ *     serialdecode [-o type file]... [capturefile]
+ * Each -o writes the payloads of every record of that type to the file, one
+ * after another.  For JPEG records that gives the JPEG files themselves, and
+ * for row records it gives the raw pixels without the row headers.  If no
+ * capture file is given, it reads from stdin.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// These have to match ISC_out_serial.h.
+#define ISC_OUT_SERIAL_SYNC0 0xA5
+#define ISC_OUT_SERIAL_SYNC1 0x5A
+#define ISC_OUT_SERIAL_MORE 0x80
+#define ISC_OUT_SERIAL_TYPE_ROW 1
+#define ISC_OUT_SERIAL_TYPE_JPEG 2
+#define ISC_OUT_SERIAL_TYPE_HISTOGRAM 3
+#define ISC_OUT_SERIAL_TYPE_BLOB 4
+#define ISC_OUT_SERIAL_TYPE_TEXT 5
+
+#define MAXOUTPUTS 8
+
+static const char *typeNames[] = { "?", "ROW", "JPEG", "HISTOGRAM", "BLOB", "TEXT" };
+
+static struct
+{
+	int type;
+	FILE *fp;
+} outputs[MAXOUTPUTS];
+static int outputCount;
+
+static FILE *input;
+static uint8_t frame[6 + 65535 + 2];
+static uint8_t again[sizeof( frame )];
+static uint32_t againLength, againPosition;
+
+static uint8_t *record;
+static uint32_t recordLength, recordSize;
+static int recordType = -1;
+
+// Get the next byte, from the bytes to look at again first.
+static int GetByte( void )
+{
+	if ( againPosition < againLength )
+		return again[againPosition++];
+	return getc( input );
+}
+
+// Get several bytes.  Returns 0 if the stream ended first.
+static int GetBytes( uint8_t *to, uint32_t count )
+{
+	int c;
+
+	while ( count-- )
+	{
+		if ( ( c = GetByte() ) == EOF )
+			return 0;
+		*to++ = c;
+	}
+	return 1;
+}
+
+// Look at the bytes of a bad frame again, after its sync word.
+static void LookAgain( uint32_t count )
+{
+	// Anything not looked at yet goes after them.
+	memmove( again + count, again + againPosition, againLength - againPosition );
+	memcpy( again, frame + 2, count );
+	againLength = count + againLength - againPosition;
+	againPosition = 0;
+}
+
+// Add bytes to a running CRC-16-CCITT.
+static uint16_t UpdateCRC( uint16_t crc, const uint8_t *data, uint32_t length )
+{
+	int bit;
+
+	while ( length-- )
+	{
+		crc ^= (uint16_t)*data++ << 8;
+		for ( bit = 0; bit < 8; bit++ )
+			crc = crc & 0x8000 ? ( crc << 1 ) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+// Print a finished record and write it to any matching -o files.
+static void FinishRecord( void )
+{
+	int i;
+	uint32_t skip = 0;
+
+	if ( recordType >= 1 && recordType <= ISC_OUT_SERIAL_TYPE_TEXT )
+		printf( "%s", typeNames[recordType] );
+	else
+		printf( "TYPE %d", recordType );
+
+	if ( recordType == ISC_OUT_SERIAL_TYPE_ROW && recordLength >= 3 && record[2] )
+	{
+		printf( " %d: %lu pixels, %d channels\n", record[0] | record[1] << 8, (unsigned long)( recordLength - 3 ) / record[2], record[2] );
+		skip = 3;
+	}
+	else if ( recordType == ISC_OUT_SERIAL_TYPE_TEXT )
+		printf( ": %.*s\n", (int)recordLength, (const char *)record );
+	else
+		printf( ": %lu bytes\n", (unsigned long)recordLength );
+
+	for ( i = 0; i < outputCount; i++ )
+		if ( outputs[i].type == recordType )
+			fwrite( record + skip, 1, recordLength - skip, outputs[i].fp );
+
+	recordLength = 0;
+	recordType = -1;
+}
+
+// Add a frame's payload to the record being put together.
+static int AddToRecord( int type, const uint8_t *payload, uint32_t length )
+{
+	uint8_t *bigger;
+
+	// A record that changes type in the middle lost its end.
+	if ( recordType != -1 && recordType != ( type & ~ISC_OUT_SERIAL_MORE ) )
+	{
+		fprintf( stderr, "serialdecode: dropping a cut-off record\n" );
+		recordLength = 0;
+	}
+	recordType = type & ~ISC_OUT_SERIAL_MORE;
+
+	if ( recordLength + length > recordSize )
+	{
+		recordSize = ( recordLength + length ) * 2;
+		bigger = realloc( record, recordSize );
+		if ( !bigger )
+			return 0;
+		record = bigger;
+	}
+	memcpy( record + recordLength, payload, length );
+	recordLength += length;
+
+	if ( !( type & ISC_OUT_SERIAL_MORE ) )
+		FinishRecord();
+	return 1;
+}
+
+int main( int argc, char **argv )
+{
+	int c, last = EOF, arg, expectedId = -1;
+	uint32_t length;
+	unsigned long frames = 0, badFrames = 0, lostFrames = 0;
+
+	for ( arg = 1; arg + 2 < argc && !strcmp( argv[arg], "-o" ); arg += 3 )
+	{
+		if ( outputCount == MAXOUTPUTS )
+		{
+			fprintf( stderr, "serialdecode: too many -o options\n" );
+			return 1;
+		}
+		outputs[outputCount].type = atoi( argv[arg+1] );
+		if ( !( outputs[outputCount].fp = fopen( argv[arg+2], "wb" ) ) )
+		{
+			perror( argv[arg+2] );
+			return 1;
+		}
+		outputCount++;
+	}
+	input = stdin;
+	if ( arg < argc && !( input = fopen( argv[arg], "rb" ) ) )
+	{
+		perror( argv[arg] );
+		return 1;
+	}
+
+	// Hunt for the sync word, read a frame, check it, repeat.
+	while ( ( c = GetByte() ) != EOF )
+	{
+		if ( last != ISC_OUT_SERIAL_SYNC0 || c != ISC_OUT_SERIAL_SYNC1 )
+		{
+			last = c;
+			continue;
+		}
+		last = EOF;
+
+		frame[0] = ISC_OUT_SERIAL_SYNC0;
+		frame[1] = ISC_OUT_SERIAL_SYNC1;
+		if ( !GetBytes( frame + 2, 4 ) )
+			break;
+		length = frame[4] | frame[5] << 8;
+		if ( !GetBytes( frame + 6, length + 2 ) )
+			break;
+
+		if ( UpdateCRC( 0xFFFF, frame + 2, length + 4 ) != ( frame[6+length] | frame[7+length] << 8 ) )
+		{
+			fprintf( stderr, "serialdecode: bad CRC on frame %d\n", frame[2] );
+			badFrames++;
+			LookAgain( length + 6 );
+			continue;
+		}
+
+		frames++;
+		if ( expectedId != -1 && frame[2] != expectedId )
+		{
+			lostFrames += ( frame[2] - expectedId ) & 0xFF;
+			fprintf( stderr, "serialdecode: frames %d to %d are missing\n", expectedId, ( frame[2] - 1 ) & 0xFF );
+			// The record being put together is missing a piece.
+			recordLength = 0;
+			recordType = -1;
+		}
+		expectedId = ( frame[2] + 1 ) & 0xFF;
+
+		if ( !AddToRecord( frame[3], frame + 6, length ) )
+		{
+			fprintf( stderr, "serialdecode: out of memory\n" );
+			return 1;
+		}
+	}
+
+	fprintf( stderr, "serialdecode: %lu good frames, %lu bad, %lu missing\n", frames, badFrames, lostFrames );
+
+	free( record );
+	for ( arg = 0; arg < outputCount; arg++ )
+		fclose( outputs[arg].fp );
+	if ( input != stdin )
+		fclose( input );
+	return 0;
+}
@@ -13,11 +13,26 @@
 #include <cc3.h>
 
 #include "ISC_util_assert.h"
-#include "ISC_out_histogram.h"
+#include "ISC_out_classify.h"
 #include "ISC_in_cmucam.h"
 
+// How many frames go by between frame rate reports in continuous mode.
+#define FPS_FRAMES 30
+
+// Virtual-cam can't be stopped with a key, so continuous mode runs this many
+// frames there.
+#define VIRTUAL_CAM_FRAMES 90
+
+// What each line of tile classes ends with.
+#ifndef VIRTUAL_CAM
+#define LINE_END "\r"
+#else
+#define LINE_END "\n"
+#endif
+
 void EnterMainLoop( void );
 void TestConvolution(void);
+void RunContinuous( void );
 
 int main (void)
 {
@@ -67,29 +82,32 @@ void EnterMainLoop( void )
 	#ifndef VIRTUAL_CAM
 	// If we're on the real hardware, we will go into an infinite loop waiting for
 	// the user to hit "Enter" on the keyboard in HyperTerminal.  When this
-	// happens, the code will engage.
+	// happens, the code will engage.  Hitting "c" instead runs frames
+	// continuously until another key is hit.
     while ( 1 )
 	{
 		printf( "\r> ");
 		c = getchar();
 		if ( c == '\r' )
 			TestConvolution( );
+		else if ( c == 'c' )
+			RunContinuous( );
 	}
 	#else
 	// If we're in Virtual-cam, it is thoroughly unnecessary to have this loop.
 	// Instead, we will just run through once and then exit.
 	TestConvolution();
+	RunContinuous();
 	#endif	
 }
 
 void TestConvolution( void )
 {
     uint8_t *inRow;
-    ISC_out_histogram *ijc;
+    ISC_out_classify *ico;
     ISC_in_cmucam *iic;
     ISC_util_imagecontext ic;
-    uint16_t count;
-    uint8_t *maxes;
+    uint8_t table[64];
     
     cc3_pixbuf_load();
 
@@ -101,46 +119,89 @@ void TestConvolution( void )
 
     // Notice that it uses the context function of the previous module in
     // the pipeline as its input.  This is an important theme in ISC Pipeline.
-    ijc = ISC_out_histogram_start( ISC_in_cmucam_context(iic), 16, 16, 4 );
+    // The classifier uses the color modes of each tile to decide what regions
+    // are grass, sand, and white lines.  It is a crude strategy, but it is
+    // somewhat effective.  It also fulfills its intended purpose perfectly
+    // (to be a demo).
+    ISC_out_classify_table_igvc( table );
+    ico = ISC_out_classify_start( ISC_in_cmucam_context(iic), 16, 16, 4, table );
 
     // The pipeline loop.
-    while ( ISC_out_histogram_running(ijc) )
+    while ( ISC_out_classify_running(ico) )
     {
 		// In-Module: CMUCAM
         inRow = ISC_in_cmucam_process( iic );
 
-		// Out-Module: HISTOGRAM
-		ISC_out_histogram_feed( ijc, inRow );
-
-		// This code uses the histogram generated by ISC_out_histogram to determine
-		// what regions are grass, sand, and white lines.  It is a crude strategy,
-		// but it is somewhat effective.  It also fulfills its intended purpose
-		// perfectly (to be a demo).
-        if ( ijc->linesLeft == 0 )
-		{
-	    	for ( count = 0; count < 16; count++ )
-	    	{
-		    	maxes = ISC_out_histogram_getmaxes( ijc, count );
-		    	if ( maxes[0] < 3 && maxes[2] == 0 )
-					printf( "G" );
-		    	else if ( maxes[0] == 2 && maxes[1] == 2 && (maxes[2] == 1 || maxes[2] == 2) )
-					printf( "S" );
-		    	else if ( maxes[0] >= 2 && maxes[1] >= 2 && maxes[2] >= 2 )
-					printf( "W" );
-		    	else
-					printf( "?" );
-		    	free( maxes );
-	    	}
+		// Out-Module: CLASSIFY
+		ISC_out_classify_feed( ico, inRow );
+    }
+
+	// Send the tile classes, one line per row of tiles.
+	ISC_out_classify_exportlines( ico, stdout, LINE_END );
+
+	// The ever-important "cleanup" phase.
+    ISC_out_classify_end( ico );
+    ISC_in_cmucam_end( iic );
+}
+
+void RunContinuous( void )
+{
+    uint8_t *inRow;
+    ISC_out_classify *ico;
+    ISC_in_cmucam *iic;
+    uint8_t table[64];
+    uint32_t frames = 0, start, elapsed;
+    uint64_t centiFps;
+    bool stop = false;
+
+    cc3_pixbuf_load();
+
+    // The modules are only set up once.  After each frame they are reset,
+    // which keeps their memory and tables, so the per-frame cost is just
+    // the rows themselves.  The in-module prefetches: it asks for the next
+    // frame as soon as the last row leaves the FIFO, instead of after this
+    // one is finished and sent.
+    iic = ISC_in_cmucam_start_prefetch( ISC_util_imagecontext_getfromcurrent(CC3_CAMERA_RESOLUTION_HIGH, CC3_COLORSPACE_RGB) );
+    ISC_out_classify_table_igvc( table );
+    ico = ISC_out_classify_start( ISC_in_cmucam_context(iic), 16, 16, 4, table );
+
+    start = cc3_timer_get_current_ms();
+    while ( !stop )
+    {
+        while ( ISC_out_classify_running(ico) )
+        {
+            inRow = ISC_in_cmucam_process( iic );
+            ISC_out_classify_feed( ico, inRow );
+        }
+
+        ISC_out_classify_exportlines( ico, stdout, LINE_END );
+
+        frames++;
+        if ( frames % FPS_FRAMES == 0 )
+        {
+            elapsed = cc3_timer_get_current_ms() - start;
+            if ( elapsed == 0 )
+                elapsed = 1;
+            // In 64 bits, since frames * 100000 passes 2^32 within an hour.
+            centiFps = (uint64_t)frames * 100000 / elapsed;
+            printf( "FPS: %lu.%02lu\n", (unsigned long)( centiFps / 100 ), (unsigned long)( centiFps % 100 ) );
+        }
+
+        ISC_in_cmucam_reset( iic );
+        ISC_out_classify_reset( ico );
+
 #ifndef VIRTUAL_CAM
-	    	printf( "\r" );
+        stop = cc3_uart_has_data( 0 );
 #else
-			printf( "\n" );
+        stop = frames == VIRTUAL_CAM_FRAMES;
 #endif
-		}
     }
 
-	// The ever-important "cleanup" phase.
-    ISC_out_histogram_end( ijc );
+#ifndef VIRTUAL_CAM
+    // Eat the key that stopped it.
+    getchar();
+#endif
+
+    ISC_out_classify_end( ico );
     ISC_in_cmucam_end( iic );
 }
-
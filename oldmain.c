@@ -164,7 +164,7 @@ convkern.matrix[2][0] = 0;convkern.matrix[2][1] = 1;convkern.matrix[2][2] = 2;
     // the pipeline as its input.  This is an important theme in ISC Pipeline.
 	printf( "ySize = %d", ic.frame.height );
     ijc = ISC_out_histogram_start( ISC_in_cmucam_context(iic), 16, 16, 4 );
-    //iop = ISC_out_jpeg_start( ISC_in_cmucam_context( iic ), stdout );
+    //iop = ISC_out_jpeg_start( ISC_in_cmucam_context( iic ), stdout, &ISC_out_jpeg_profile_fastpreview );
 
     // The pipeline loop.
     while ( ISC_out_histogram_running(ijc) )